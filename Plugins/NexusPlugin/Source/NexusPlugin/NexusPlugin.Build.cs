@@ -1,4 +1,4 @@
-// Copyright Epic Games, Inc. All Rights Reserved.
+﻿// Copyright Epic Games, Inc. All Rights Reserved.
 
 using UnrealBuildTool;
 using System.IO;
@@ -50,6 +50,8 @@ public class NexusPlugin : ModuleRules
 			"Core", "CoreUObject", "Projects", "Engine",
 			"RHI", "RenderCore" });
 			
+		PrivateDependencyModuleNames.AddRange(new string[] { "ImageWrapper" });
+			
 		
 		
 		DynamicallyLoadedModuleNames.AddRange(
@@ -0,0 +1,156 @@
+﻿#include "NexusBufferPool.h"
+
+DECLARE_MEMORY_STAT(TEXT("Live Node Buffers"), STATID_NexusLiveBuffers, STATGROUP_NexusMemory);
+DECLARE_MEMORY_STAT(TEXT("Peak Live Node Buffers"), STATID_NexusPeakLiveBuffers, STATGROUP_NexusMemory);
+DECLARE_MEMORY_STAT(TEXT("Pooled Node Buffers"), STATID_NexusPooledBuffers, STATGROUP_NexusMemory);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Recycled Node Buffers"), STATID_NexusRecycledBuffers, STATGROUP_NexusMemory);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Allocated Node Buffers"), STATID_NexusAllocatedBuffers, STATGROUP_NexusMemory);
+
+static TAutoConsoleVariable<int32> CVarNexusBufferPoolSize(
+    TEXT("nexus.BufferPoolSize"),
+    64,
+    TEXT("Maximum amount of MB kept around by the nexus node buffer pool"),
+    ECVF_Default);
+
+FNexusBufferPool& FNexusBufferPool::Get()
+{
+    // Never destroyed, node buffers may still be released during static destruction
+    static FNexusBufferPool* Pool = new FNexusBufferPool();
+    return *Pool;
+}
+
+int32 FNexusBufferPool::GetSizeClass(const uint32 Size)
+{
+    if (Size > (1u << MaxSizeLog2)) return INDEX_NONE;
+    if (Size <= (1u << MinSizeLog2)) return 0;
+
+    // Size falls in (Base, 2 * Base], which is split in StepsPerPowerOfTwo classes
+    const uint32 BaseLog2 = FMath::FloorLog2(Size - 1);
+    const uint32 Base = 1u << BaseLog2;
+    const uint32 Step = Base / StepsPerPowerOfTwo;
+    const uint32 SubClass = (Size - Base + Step - 1) / Step - 1;
+    return (BaseLog2 - MinSizeLog2) * StepsPerPowerOfTwo + SubClass;
+}
+
+uint32 FNexusBufferPool::GetSizeClassBytes(const int32 SizeClass)
+{
+    const uint32 Base = 1u << (MinSizeLog2 + SizeClass / StepsPerPowerOfTwo);
+    return Base + (SizeClass % StepsPerPowerOfTwo + 1) * (Base / StepsPerPowerOfTwo);
+}
+
+uint8* FNexusBufferPool::Allocate(const uint32 Size, int32& OutSizeClass)
+{
+    OutSizeClass = GetSizeClass(Size);
+    const uint32 AllocatedSize = OutSizeClass == INDEX_NONE ? Size : GetSizeClassBytes(OutSizeClass);
+    uint8* Buffer = nullptr;
+    {
+        FScopeLock Lock(&PoolMutex);
+        if (OutSizeClass != INDEX_NONE && FreeBuffers[OutSizeClass].Num() > 0)
+        {
+            Buffer = FreeBuffers[OutSizeClass].Pop(false);
+            PooledBytes -= AllocatedSize;
+            INC_DWORD_STAT(STATID_NexusRecycledBuffers);
+        }
+        LiveBytes += AllocatedSize;
+        PeakLiveBytes = FMath::Max(PeakLiveBytes, LiveBytes);
+        SET_MEMORY_STAT(STATID_NexusLiveBuffers, LiveBytes);
+        SET_MEMORY_STAT(STATID_NexusPeakLiveBuffers, PeakLiveBytes);
+        SET_MEMORY_STAT(STATID_NexusPooledBuffers, PooledBytes);
+    }
+    
+    if (!Buffer)
+    {
+        Buffer = static_cast<uint8*>(FMemory::Malloc(AllocatedSize));
+        INC_DWORD_STAT(STATID_NexusAllocatedBuffers);
+    }
+    return Buffer;
+}
+
+void FNexusBufferPool::Release(uint8* Buffer, const uint32 Size, const int32 SizeClass)
+{
+    if (!Buffer) return;
+    const uint32 AllocatedSize = SizeClass == INDEX_NONE ? Size : GetSizeClassBytes(SizeClass);
+    const uint64 MaxPooledBytes = static_cast<uint64>(CVarNexusBufferPoolSize.GetValueOnAnyThread()) * 1024 * 1024;
+    bool bKeepBuffer;
+    {
+        FScopeLock Lock(&PoolMutex);
+        LiveBytes -= AllocatedSize;
+        bKeepBuffer = SizeClass != INDEX_NONE && PooledBytes + AllocatedSize <= MaxPooledBytes;
+        if (bKeepBuffer)
+        {
+            FreeBuffers[SizeClass].Push(Buffer);
+            PooledBytes += AllocatedSize;
+        }
+        SET_MEMORY_STAT(STATID_NexusLiveBuffers, LiveBytes);
+        SET_MEMORY_STAT(STATID_NexusPooledBuffers, PooledBytes);
+    }
+    
+    if (!bKeepBuffer)
+    {
+        FMemory::Free(Buffer);
+    }
+}
+
+void FNexusBufferPool::Trim()
+{
+    FScopeLock Lock(&PoolMutex);
+    for (TArray<uint8*>& Buffers : FreeBuffers)
+    {
+        for (uint8* Buffer : Buffers)
+        {
+            FMemory::Free(Buffer);
+        }
+        Buffers.Empty();
+    }
+    PooledBytes = 0;
+    SET_MEMORY_STAT(STATID_NexusPooledBuffers, PooledBytes);
+}
+
+FNexusPooledBuffer::FNexusPooledBuffer(const uint32 InSize)
+{
+    Allocate(InSize);
+}
+
+FNexusPooledBuffer::~FNexusPooledBuffer()
+{
+    Reset();
+}
+
+FNexusPooledBuffer::FNexusPooledBuffer(FNexusPooledBuffer&& Other) noexcept
+    : Data(Other.Data), Size(Other.Size), SizeClass(Other.SizeClass)
+{
+    Other.Data = nullptr;
+    Other.Size = 0;
+    Other.SizeClass = INDEX_NONE;
+}
+
+FNexusPooledBuffer& FNexusPooledBuffer::operator=(FNexusPooledBuffer&& Other) noexcept
+{
+    if (this != &Other)
+    {
+        Reset();
+        Data = Other.Data;
+        Size = Other.Size;
+        SizeClass = Other.SizeClass;
+        Other.Data = nullptr;
+        Other.Size = 0;
+        Other.SizeClass = INDEX_NONE;
+    }
+    return *this;
+}
+
+void FNexusPooledBuffer::Allocate(const uint32 InSize)
+{
+    Reset();
+    Size = InSize;
+    Data = FNexusBufferPool::Get().Allocate(Size, SizeClass);
+}
+
+void FNexusPooledBuffer::Reset()
+{
+    if (!Data) return;
+    FNexusBufferPool::Get().Release(Data, Size, SizeClass);
+    Data = nullptr;
+    Size = 0;
+    SizeClass = INDEX_NONE;
+}
@@ -1,4 +1,5 @@
 ﻿#include "NexusCommons.h"
+#include "NexusBufferPool.h"
 
 #include "Core.h"
 
@@ -21,27 +22,23 @@ FStreamableManager& NexusCommons::GetStreamableManager()
 }
 
 
-void LoadUtils::LoadNodeData(nx::Header& Header, int VertCount, int FacesCount, nx::NodeData& TheNodeData, const uint64 DataSizeOnDisk, UTexture2D*& OutputTexture)
+void LoadUtils::LoadNodeData(nx::Header& Header, int VertCount, int FacesCount, nx::NodeData& TheNodeData, const uint8* Payload, const uint64 DataSizeOnDisk, FNexusPooledBuffer& OutMemory, UTexture2D*& OutputTexture)
 {
 	nx::Signature& Signature = Header.signature;
 	if (!Signature.isCompressed())
 	{
+		OutMemory.Allocate(DataSizeOnDisk);
+		TheNodeData.memory = reinterpret_cast<char*>(OutMemory.GetData());
+		FMemory::Memcpy(TheNodeData.memory, Payload, DataSizeOnDisk);
 		return;
 	} else if (Signature.flags & nx::Signature::CORTO)
 	{
 		const uint32 RealSize = VertCount * Signature.vertex.size() + FacesCount * Signature.face.size();
-		char* Buffer = new char[DataSizeOnDisk];
-		FMemory::Memcpy(Buffer, TheNodeData.memory, DataSizeOnDisk);
-		delete[] TheNodeData.memory;
-		TheNodeData.memory = new char[RealSize];
-		uint32 Magic = *reinterpret_cast<uint32*>(Buffer);
-		char Magic0 = Buffer[0];
-		char Magic1 = Buffer[1];
-		char Magic2 = Buffer[2];
-		char Magic3 = Buffer[3];
+		OutMemory.Allocate(RealSize);
+		TheNodeData.memory = reinterpret_cast<char*>(OutMemory.GetData());
 
-
-		crt::Decoder Decoder(DataSizeOnDisk, reinterpret_cast<unsigned char*>(Buffer));
+		// The decoder reads straight from the payload, no need for an intermediate copy
+		crt::Decoder Decoder(DataSizeOnDisk, Payload);
 		Decoder.setPositions(reinterpret_cast<float*>(TheNodeData.coords()));
 		if(Signature.vertex.hasNormals())
 			Decoder.setNormals(reinterpret_cast<int16_t*>(TheNodeData.normals(Signature, VertCount)));
@@ -53,8 +50,6 @@ void LoadUtils::LoadNodeData(nx::Header& Header, int VertCount, int FacesCount,
 			Decoder.setIndex(TheNodeData.faces(Signature, VertCount));
 
 		Decoder.decode();
-
-        // delete Buffer;
     } else if (Signature.isCompressed())
     {
         UE_LOG(NexusInfo, Error, TEXT("Only CORTO compression is supported"));
@@ -82,7 +77,7 @@ void LoadUtils::LoadNodeData(nx::Header& Header, int VertCount, int FacesCount,
             Normals.SetNum(VertCount);
 			for(int i = 0; i < VertCount; i++)
                 Normals[i] = n[Order[i]];
-			FMemory::Memcpy(n, Normals.GetData(), sizeof(vcg::Point3f) * VertCount);
+			FMemory::Memcpy(n, Normals.GetData(), sizeof(vcg::Point3s) * VertCount);
 		}
 
 		if(Signature.vertex.hasColors()) {
@@ -0,0 +1,132 @@
+﻿#include "NexusContainerFile.h"
+
+#include "NexusCommons.h"
+#include "Async/Async.h"
+#include "Async/AsyncFileHandle.h"
+#include "HAL/PlatformFilemanager.h"
+
+FNexusStreamedNode::~FNexusStreamedNode()
+{
+    WaitForReads();
+}
+
+void FNexusStreamedNode::WaitForReads()
+{
+    if (ReadRequest)
+    {
+        ReadRequest->WaitCompletion();
+        delete ReadRequest;
+        ReadRequest = nullptr;
+    }
+}
+
+void FNexusStreamedNode::DecodeData(nx::Header& Header, const int VertsCount, const int FacesCount)
+{
+    if (DidDecodeData) return;
+    if (!Header.signature.isCompressed())
+    {
+        // Uncompressed payloads already have the final layout, use them in place
+        DecodedMemory = MoveTemp(Payload);
+        NexusNodeData.memory = reinterpret_cast<char*>(DecodedMemory.GetData());
+    } else
+    {
+        UTexture2D* UnusedTexture = nullptr;
+        LoadUtils::LoadNodeData(Header, VertsCount, FacesCount, NexusNodeData, Payload.GetData(), Payload.Num(), DecodedMemory, UnusedTexture);
+
+        // The compressed payload isn't needed anymore
+        Payload.Reset();
+    }
+    DidDecodeData = true;
+}
+
+FNexusContainerFile::FNexusContainerFile(const FString& FilePath)
+{
+    FileHandle.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenAsyncRead(*FilePath));
+    if (!FileHandle)
+    {
+        UE_LOG(NexusErrors, Error, TEXT("Could not open the nexus container %s"), *FilePath);
+    }
+}
+
+FNexusContainerFile::~FNexusContainerFile()
+{
+    // Pending reads must be done before the handle goes away, even for the nodes a job still holds
+    for (const auto& Entry : StreamedNodes)
+    {
+        Entry.Value->WaitForReads();
+    }
+    StreamedNodes.Empty();
+    for (const auto& Entry : ImageReads)
+    {
+        Entry.Value->Request->WaitCompletion();
+        delete Entry.Value->Request;
+    }
+    ImageReads.Empty();
+    FileHandle.Reset();
+}
+
+void FNexusContainerFile::RequestNode(const uint32 NodeID, const int64 Offset, const int64 Size, TFunction<void(uint32)> OnRead)
+{
+    if (!FileHandle || StreamedNodes.Contains(NodeID)) return;
+    
+    FNexusStreamedNode* Node = StreamedNodes.Add(NodeID, MakeShared<FNexusStreamedNode, ESPMode::ThreadSafe>()).Get();
+    Node->Payload.Allocate(Size);
+    Node->RequestSerial = NextRequestSerial ++;
+    // The callback and the destination must not move while the read is in flight
+    Node->ReadCallback = [OnRead, RequestSerial = Node->RequestSerial](bool bWasCancelled, IAsyncReadRequest*)
+    {
+        if (bWasCancelled) return;
+        AsyncTask(ENamedThreads::GameThread, [OnRead, RequestSerial]() { OnRead(RequestSerial); });
+    };
+    Node->ReadRequest = FileHandle->ReadRequest(Offset, Size, AIOP_Normal, &Node->ReadCallback, Node->Payload.GetData());
+}
+
+void FNexusContainerFile::RequestImage(const uint32 TextureID, const int64 Offset, const int64 Size, TFunction<void()> OnRead)
+{
+    if (!FileHandle || ImageReads.Contains(TextureID)) return;
+
+    FImageRead* Read = ImageReads.Add(TextureID, MakeUnique<FImageRead>()).Get();
+    Read->Image.TextureID = TextureID;
+    Read->Image.Bytes.SetNumUninitialized(Size);
+    Read->Callback = [OnRead](bool bWasCancelled, IAsyncReadRequest*)
+    {
+        if (bWasCancelled) return;
+        AsyncTask(ENamedThreads::GameThread, OnRead);
+    };
+    Read->Request = FileHandle->ReadRequest(Offset, Size, AIOP_Normal, &Read->Callback, Read->Image.Bytes.GetData());
+}
+
+bool FNexusContainerFile::TakeImage(const uint32 TextureID, FNexusTextureImage& OutImage)
+{
+    TUniquePtr<FImageRead>* Read = ImageReads.Find(TextureID);
+    if (!Read) return false;
+    
+    (*Read)->Request->WaitCompletion();
+    delete (*Read)->Request;
+    OutImage = MoveTemp((*Read)->Image);
+    ImageReads.Remove(TextureID);
+    return true;
+}
+
+void FNexusContainerFile::ReleaseNode(const uint32 NodeID)
+{
+    // A queued or running decoding job keeps its own reference, the node is freed with it
+    StreamedNodes.Remove(NodeID);
+}
+
+bool FNexusContainerFile::IsCurrentRequest(const uint32 NodeID, const uint32 RequestSerial) const
+{
+    const TSharedPtr<FNexusStreamedNode, ESPMode::ThreadSafe>* Node = StreamedNodes.Find(NodeID);
+    return Node && (*Node)->RequestSerial == RequestSerial;
+}
+
+FNexusStreamedNode* FNexusContainerFile::GetNode(const uint32 NodeID)
+{
+    TSharedPtr<FNexusStreamedNode, ESPMode::ThreadSafe>* Node = StreamedNodes.Find(NodeID);
+    if (!Node) return nullptr;
+    
+    // Only reached from the callback of the current read, which has completed or is about to
+    FNexusStreamedNode* StreamedNode = Node->Get();
+    StreamedNode->WaitForReads();
+    return StreamedNode;
+}
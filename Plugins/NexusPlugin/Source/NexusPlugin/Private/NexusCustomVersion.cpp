@@ -0,0 +1,7 @@
+﻿#include "NexusCustomVersion.h"
+
+#include "Serialization/CustomVersion.h"
+
+const FGuid FNexusCustomVersion::GUID(0x4E787320, 0x8C2B4F31, 0xA6D04B7E, 0x91E35D02);
+
+FCustomVersionRegistration GRegisterNexusCustomVersion(FNexusCustomVersion::GUID, FNexusCustomVersion::LatestVersion, TEXT("NexusVer"));
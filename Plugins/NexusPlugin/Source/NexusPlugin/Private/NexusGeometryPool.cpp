@@ -0,0 +1,587 @@
+﻿#include "NexusGeometryPool.h"
+#include "NexusBufferPool.h"
+#include "Algo/BinarySearch.h"
+
+#include "UnrealNexusNodeData.h"
+#include "dag.h"
+#include "nexusdata.h"
+
+DECLARE_MEMORY_STAT(TEXT("Geometry Pages"), STATID_NexusGeometryPages, STATGROUP_NexusMemory);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Open Geometry Pages"), STATID_NexusOpenGeometryPages, STATGROUP_NexusMemory);
+
+static TAutoConsoleVariable<int32> CVarNexusGeometryPageVertices(
+    TEXT("nexus.GeometryPageVertices"),
+    512 * 1024,
+    TEXT("Vertices held by every nexus geometry page, a page takes 32 bytes per vertex plus its indices"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusGeometryIdleFrames(
+    TEXT("nexus.GeometryIdleFrames"),
+    60,
+    TEXT("Frames without nodes being loaded or dropped before the geometry pages are compacted, 0 disables it"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusUsePrecomputedTangents(
+    TEXT("nexus.UsePrecomputedTangents"),
+    1,
+    TEXT("Use the tangent frames computed at import when a node has them, 0 always generates them at load time.\n")
+    TEXT("Compare the Tangent Generation and Tangent Copy timings in stat NexusLoading"),
+    ECVF_Default);
+
+DECLARE_CYCLE_STAT(TEXT("Tangent Generation"), STATID_NexusTangentGeneration, STATGROUP_NexusLoading);
+DECLARE_CYCLE_STAT(TEXT("Tangent Copy"), STATID_NexusTangentCopy, STATGROUP_NexusLoading);
+
+// A page holds twice as many triangles as vertices, like most meshes do
+constexpr uint32 GIndicesPerVertex = 6;
+
+void FNexusRangeAllocator::Init(const uint32 InCapacity)
+{
+    Capacity = InCapacity;
+    Used = 0;
+    FreeRanges.Reset();
+    FreeRanges.Add({ 0, Capacity });
+}
+
+bool FNexusRangeAllocator::Allocate(const uint32 Size, uint32& OutOffset)
+{
+    if (Size == 0)
+    {
+        OutOffset = 0;
+        return true;
+    }
+    int32 BestRange = INDEX_NONE;
+    for (int32 i = 0; i < FreeRanges.Num(); i ++)
+    {
+        const uint32 RangeSize = FreeRanges[i].Size;
+        if (RangeSize >= Size && (BestRange == INDEX_NONE || RangeSize < FreeRanges[BestRange].Size))
+        {
+            BestRange = i;
+            if (RangeSize == Size) break;
+        }
+    }
+    if (BestRange == INDEX_NONE) return false;
+
+    FRange& Range = FreeRanges[BestRange];
+    OutOffset = Range.Offset;
+    Range.Offset += Size;
+    Range.Size -= Size;
+    if (Range.Size == 0)
+    {
+        FreeRanges.RemoveAt(BestRange);
+    }
+    Used += Size;
+    return true;
+}
+
+void FNexusRangeAllocator::Free(const uint32 Offset, const uint32 Size)
+{
+    if (Size == 0) return;
+    check(Offset + Size <= Capacity && Used >= Size);
+    Used -= Size;
+    
+    // The ranges are sorted by offset, find the first one after the released range
+    int32 Next = Algo::LowerBoundBy(FreeRanges, Offset, [](const FRange& Range) { return Range.Offset; });
+    const bool bMergesWithPrevious = Next > 0 && FreeRanges[Next - 1].Offset + FreeRanges[Next - 1].Size == Offset;
+    const bool bMergesWithNext = Next < FreeRanges.Num() && Offset + Size == FreeRanges[Next].Offset;
+    checkSlow(Next == FreeRanges.Num() || Offset + Size <= FreeRanges[Next].Offset);
+    
+    if (bMergesWithPrevious && bMergesWithNext)
+    {
+        FreeRanges[Next - 1].Size += Size + FreeRanges[Next].Size;
+        FreeRanges.RemoveAt(Next);
+    }
+    else if (bMergesWithPrevious)
+    {
+        FreeRanges[Next - 1].Size += Size;
+    }
+    else if (bMergesWithNext)
+    {
+        FreeRanges[Next].Offset = Offset;
+        FreeRanges[Next].Size += Size;
+    }
+    else
+    {
+        FreeRanges.Insert({ Offset, Size }, Next);
+    }
+}
+
+bool FNexusGeometryAllocator::AllocateInPage(const int32 PageIndex, FNexusGeometryAllocation& OutAllocation)
+{
+    FPage& Page = Pages[PageIndex];
+    if (!Page.Vertices.Allocate(OutAllocation.VertexCount, OutAllocation.VertexOffset)) return false;
+    if (!Page.Indices.Allocate(OutAllocation.IndexCount, OutAllocation.IndexOffset))
+    {
+        Page.Vertices.Free(OutAllocation.VertexOffset, OutAllocation.VertexCount);
+        return false;
+    }
+    OutAllocation.Page = PageIndex;
+    return true;
+}
+
+bool FNexusGeometryAllocator::Allocate(const uint32 VertexCount, const uint32 IndexCount, FNexusGeometryAllocation& OutAllocation, bool& bOutCreatedPage)
+{
+    bOutCreatedPage = false;
+    OutAllocation.VertexCount = VertexCount;
+    OutAllocation.IndexCount = IndexCount;
+    for (int32 i = 0; i < Pages.Num(); i ++)
+    {
+        if (Pages[i].bInUse && AllocateInPage(i, OutAllocation)) return true;
+    }
+
+    // No room left, open a new page in the first closed slot
+    int32 NewPage = Pages.IndexOfByPredicate([](const FPage& Page) { return !Page.bInUse; });
+    if (NewPage == INDEX_NONE)
+    {
+        NewPage = Pages.AddDefaulted();
+    }
+    FPage& Page = Pages[NewPage];
+    Page.bInUse = true;
+    Page.Vertices.Init(NexusGeometryPool::GetPageVertexCapacity(VertexCount));
+    Page.Indices.Init(NexusGeometryPool::GetPageIndexCapacity(IndexCount));
+    verify(Page.Vertices.Allocate(VertexCount, OutAllocation.VertexOffset));
+    verify(Page.Indices.Allocate(IndexCount, OutAllocation.IndexOffset));
+    OutAllocation.Page = NewPage;
+    bOutCreatedPage = true;
+    INC_DWORD_STAT(STATID_NexusOpenGeometryPages);
+    return true;
+}
+
+bool FNexusGeometryAllocator::AllocateInUsedPages(const uint32 VertexCount, const uint32 IndexCount, FNexusGeometryAllocation& OutAllocation, const int32 ExcludedPage)
+{
+    OutAllocation.VertexCount = VertexCount;
+    OutAllocation.IndexCount = IndexCount;
+    for (int32 i = 0; i < Pages.Num(); i ++)
+    {
+        const FPage& Page = Pages[i];
+        if (!Page.bInUse || Page.Vertices.IsEmpty() || i == ExcludedPage) continue;
+        if (AllocateInPage(i, OutAllocation)) return true;
+    }
+    OutAllocation.Page = INDEX_NONE;
+    return false;
+}
+
+void FNexusGeometryAllocator::Free(const FNexusGeometryAllocation& Allocation)
+{
+    if (!Allocation.IsValid()) return;
+    FPage& Page = Pages[Allocation.Page];
+    check(Page.bInUse);
+    Page.Vertices.Free(Allocation.VertexOffset, Allocation.VertexCount);
+    Page.Indices.Free(Allocation.IndexOffset, Allocation.IndexCount);
+}
+
+TArray<int32> FNexusGeometryAllocator::CloseEmptyPages(const int32 KeepCount)
+{
+    TArray<int32> ClosedPages;
+    int32 Kept = 0;
+    for (int32 i = 0; i < Pages.Num(); i ++)
+    {
+        FPage& Page = Pages[i];
+        if (!Page.bInUse || !Page.Vertices.IsEmpty()) continue;
+        if (Kept < KeepCount)
+        {
+            Kept ++;
+            continue;
+        }
+        Page.bInUse = false;
+        ClosedPages.Add(i);
+        DEC_DWORD_STAT(STATID_NexusOpenGeometryPages);
+    }
+    return ClosedPages;
+}
+
+int32 FNexusGeometryAllocator::FindSparsePage(const float MaxOccupancy) const
+{
+    int32 SparsePage = INDEX_NONE;
+    float LowestOccupancy = MaxOccupancy;
+    for (int32 i = 0; i < Pages.Num(); i ++)
+    {
+        const FPage& Page = Pages[i];
+        if (!Page.bInUse || Page.Vertices.IsEmpty()) continue;
+        const float Occupancy = static_cast<float>(Page.Vertices.GetUsed()) / Page.Vertices.GetCapacity();
+        if (Occupancy < LowestOccupancy)
+        {
+            LowestOccupancy = Occupancy;
+            SparsePage = i;
+        }
+    }
+    return SparsePage;
+}
+
+uint32 NexusGeometryPool::GetPageVertexCapacity(const uint32 MinVertices)
+{
+    return FMath::Max<uint32>(CVarNexusGeometryPageVertices.GetValueOnAnyThread(), MinVertices);
+}
+
+uint32 NexusGeometryPool::GetPageIndexCapacity(const uint32 MinIndices)
+{
+    return FMath::Max<uint32>(CVarNexusGeometryPageVertices.GetValueOnAnyThread() * GIndicesPerVertex, MinIndices);
+}
+
+int32 NexusGeometryPool::GetIdleFramesBeforeCompaction()
+{
+    return CVarNexusGeometryIdleFrames.GetValueOnGameThread();
+}
+
+FNexusGeometryPage::FNexusGeometryPage(const ERHIFeatureLevel::Type InFeatureLevel, const uint32 InVertexCapacity, const uint32 InIndexCapacity, const bool bInHasColors, const bool bInCompactVertices)
+    : VertexFactory(InFeatureLevel, "NexusGeometryPageVertexFactory"),
+        VertexCapacity(InVertexCapacity),
+        IndexCapacity(InIndexCapacity),
+        bHasColors(bInHasColors),
+        bCompactVertices(bInCompactVertices)
+{
+}
+
+static FVertexBufferRHIRef CreatePageBuffer(const uint32 Size)
+{
+    FRHIResourceCreateInfo CreateInfo;
+    return RHICreateVertexBuffer(Size, BUF_Static | BUF_ShaderResource, CreateInfo);
+}
+
+void FNexusGeometryPage::InitRHI()
+{
+    PositionBuffer.VertexBufferRHI = CreatePageBuffer(VertexCapacity * NexusGeometryPool::GetPositionStride(bCompactVertices));
+    PositionBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(PositionBuffer.VertexBufferRHI, bCompactVertices ? PF_R16G16B16A16_SNORM : PF_R32_FLOAT));
+    PositionBuffer.InitResource();
+
+    TexCoordsBuffer.VertexBufferRHI = CreatePageBuffer(VertexCapacity * NexusGeometryPool::GetTexCoordStride(bCompactVertices));
+    TexCoordsBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(TexCoordsBuffer.VertexBufferRHI, bCompactVertices ? PF_G16R16F : PF_G32R32F));
+    TexCoordsBuffer.InitResource();
+
+    TangentBuffer.VertexBufferRHI = CreatePageBuffer(VertexCapacity * 2 * sizeof(FPackedNormal));
+    TangentBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(TangentBuffer.VertexBufferRHI, PF_R8G8B8A8_SNORM));
+    TangentBuffer.InitResource();
+
+    if (bHasColors)
+    {
+        ColorBuffer.VertexBufferRHI = CreatePageBuffer(VertexCapacity * sizeof(FColor));
+        ColorBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(ColorBuffer.VertexBufferRHI, PF_R8G8B8A8));
+        ColorBuffer.InitResource();
+    }
+
+    FRHIResourceCreateInfo Info;
+    IndexBuffer.IndexBufferRHI = RHICreateIndexBuffer(sizeof(uint16), IndexCapacity * sizeof(uint16), BUF_Static, Info);
+    IndexBuffer.InitResource();
+
+    InitVertexFactory();
+    INC_MEMORY_STAT_BY(STATID_NexusGeometryPages, GetAllocatedSize());
+}
+
+void FNexusGeometryPage::ReleaseRHI()
+{
+    DEC_MEMORY_STAT_BY(STATID_NexusGeometryPages, GetAllocatedSize());
+    VertexFactory.ReleaseResource();
+    PositionBuffer.ReleaseResource();
+    TexCoordsBuffer.ReleaseResource();
+    TangentBuffer.ReleaseResource();
+    ColorBuffer.ReleaseResource();
+    IndexBuffer.ReleaseResource();
+}
+
+uint64 FNexusGeometryPage::GetAllocatedSize() const
+{
+    const uint64 VertexSize = NexusGeometryPool::GetPositionStride(bCompactVertices) + NexusGeometryPool::GetTexCoordStride(bCompactVertices)
+        + 2 * sizeof(FPackedNormal) + (bHasColors ? sizeof(FColor) : 0);
+    return VertexCapacity * VertexSize + IndexCapacity * sizeof(uint16);
+}
+
+void FNexusGeometryPage::InitVertexFactory()
+{
+    FLocalVertexFactory::FDataType Data;
+    // Compact positions are dequantized by the transform of every node draw
+    Data.PositionComponent = FVertexStreamComponent(
+        &PositionBuffer,
+        0,
+        NexusGeometryPool::GetPositionStride(bCompactVertices),
+        bCompactVertices ? VET_Short4N : VET_Float3
+    );
+    Data.PositionComponentSRV = PositionBuffer.ShaderResourceViewRHI;
+
+    Data.TextureCoordinates.Add(FVertexStreamComponent(
+        &TexCoordsBuffer,
+        0,
+        NexusGeometryPool::GetTexCoordStride(bCompactVertices),
+        bCompactVertices ? VET_Half2 : VET_Float2
+    ));
+    Data.TextureCoordinatesSRV = TexCoordsBuffer.ShaderResourceViewRHI;
+
+    Data.TangentBasisComponents[0] = FVertexStreamComponent(
+        &TangentBuffer,
+        0,
+        2 * sizeof(FPackedNormal),
+        VET_PackedNormal
+    );
+
+    Data.TangentBasisComponents[1] = FVertexStreamComponent(
+        &TangentBuffer,
+        sizeof(FPackedNormal),
+        2 * sizeof(FPackedNormal),
+        VET_PackedNormal
+    );
+    Data.TangentsSRV = TangentBuffer.ShaderResourceViewRHI;
+
+    Data.LightMapCoordinateComponent = FVertexStreamComponent(
+        &TexCoordsBuffer,
+        0,
+        NexusGeometryPool::GetTexCoordStride(bCompactVertices),
+        bCompactVertices ? VET_Half2 : VET_Float2
+    );
+
+    Data.LightMapCoordinateIndex = 0;
+    Data.NumTexCoords = 1;
+
+    Data.ColorIndexMask = 0;
+
+    Data.ColorComponentsSRV = bHasColors ? ColorBuffer.ShaderResourceViewRHI : GNullColorVertexBuffer.VertexBufferSRV;
+    Data.ColorComponent = FVertexStreamComponent(
+        bHasColors ? static_cast<FVertexBuffer*>(&ColorBuffer) : &GNullColorVertexBuffer,
+        0, // Struct offset to color
+        sizeof(FColor), //asserted elsewhere
+        VET_Color,
+        (EVertexStreamUsage::ManualFetch)
+    );
+
+    VertexFactory.SetData(Data);
+    VertexFactory.InitResource();
+}
+
+void FNexusGeometryPage::CalculateTangents(TArrayView<FPackedNormal> OutTangents, nx::Signature& TheSig, nx::NodeData& Data, nx::Node& Node)
+{
+    SCOPE_CYCLE_COUNTER(STATID_NexusTangentGeneration);
+    const uint32 VertexCount = Node.nvert;
+    const vcg::Point3f* Vertices = Data.coords();
+    const vcg::Point3s* Normals = TheSig.vertex.hasNormals() ? Data.normals(TheSig, VertexCount) : nullptr;
+    const vcg::Point2f* TexCoords = TheSig.vertex.hasTextures() ? Data.texCoords(TheSig, VertexCount) : nullptr;
+    const uint16* Indices = Data.faces(TheSig, VertexCount);
+
+    auto Point3FToVector = [](const vcg::Point3f& Point) -> FVector
+    {
+        return FVector(Point.X(), Point.Z(), Point.Y());
+    };
+
+    // Step 1: Sum the UV aligned tangent of every face on its vertices
+    TArray<FVector> TSums;
+    TSums.SetNumZeroed(VertexCount);
+    for (uint32 Face = 0; TexCoords && Face < Node.nface; Face ++)
+    {
+        const uint32 Index1 = Indices[Face * 3 + 0];
+        const uint32 Index2 = Indices[Face * 3 + 1];
+        const uint32 Index3 = Indices[Face * 3 + 2];
+
+        const FVector Edge21 = Point3FToVector(Vertices[Index2]) - Point3FToVector(Vertices[Index1]);
+        const FVector Edge31 = Point3FToVector(Vertices[Index3]) - Point3FToVector(Vertices[Index1]);
+        const FVector2D TexEdge21(TexCoords[Index2].X() - TexCoords[Index1].X(), TexCoords[Index2].Y() - TexCoords[Index1].Y());
+        const FVector2D TexEdge31(TexCoords[Index3].X() - TexCoords[Index1].X(), TexCoords[Index3].Y() - TexCoords[Index1].Y());
+
+        // Weighted by the face area, degenerate UVs don't contribute
+        const float Determinant = TexEdge21.X * TexEdge31.Y - TexEdge31.X * TexEdge21.Y;
+        if (FMath::IsNearlyZero(Determinant)) continue;
+        const FVector FaceTangent = (Edge21 * TexEdge31.Y - Edge31 * TexEdge21.Y) * FMath::Sign(Determinant);
+        
+        TSums[Index1] += FaceTangent;
+        TSums[Index2] += FaceTangent;
+        TSums[Index3] += FaceTangent;
+    }
+
+    // Step 2: Orthogonalize against the vertex normal
+    for (uint32 Index = 0; Index < VertexCount; Index ++)
+    {
+        const FVector Normal = Normals ? FVector(Normals[Index].X(), Normals[Index].Z(), Normals[Index].Y()).GetSafeNormal() : FVector::UpVector;
+        FVector Tangent = (TSums[Index] - Normal * FVector::DotProduct(Normal, TSums[Index])).GetSafeNormal();
+        if (Tangent.IsZero())
+        {
+            FVector Bitangent;
+            Normal.FindBestAxisVectors(Tangent, Bitangent);
+        }
+        OutTangents[Index * 2 + 0] = FPackedNormal(Tangent);
+        OutTangents[Index * 2 + 1] = FPackedNormal(Normal);
+    }
+}
+
+static void WriteBufferRange(FRHIVertexBuffer* Buffer, const uint32 FirstElement, const void* Data, const uint32 Count, const uint32 Stride)
+{
+    if (Count == 0) return;
+    void* Pointer = RHILockVertexBuffer(Buffer, FirstElement * Stride, Count * Stride, RLM_WriteOnly);
+    FMemory::Memcpy(Pointer, Data, Count * Stride);
+    RHIUnlockVertexBuffer(Buffer);
+}
+
+void FNexusGeometryPage::UploadStreams(const FNexusGeometryAllocation& Allocation, const FNexusNodeStreams& Streams)
+{
+    check(IsInRenderingThread());
+    check(Streams.VertexCount == Allocation.VertexCount && Streams.IndexCount == Allocation.IndexCount);
+    check(Streams.bCompactVertices == bCompactVertices);
+    const uint32 VertexOffset = Allocation.VertexOffset;
+    const uint32 VertexCount = Streams.VertexCount;
+
+    WriteBufferRange(PositionBuffer.VertexBufferRHI, VertexOffset, Streams.Positions, VertexCount, NexusGeometryPool::GetPositionStride(bCompactVertices));
+    if (bHasColors)
+    {
+        WriteBufferRange(ColorBuffer.VertexBufferRHI, VertexOffset, Streams.Colors, VertexCount, sizeof(FColor));
+    }
+    WriteBufferRange(TexCoordsBuffer.VertexBufferRHI, VertexOffset, Streams.TexCoords, VertexCount, NexusGeometryPool::GetTexCoordStride(bCompactVertices));
+    // Two packed normals per vertex
+    WriteBufferRange(TangentBuffer.VertexBufferRHI, VertexOffset * 2, Streams.Tangents, VertexCount * 2, sizeof(FPackedNormal));
+
+    // The indices stay relative to the node, the draw offsets them by the base vertex index
+    const uint32 IndicesSize = Streams.IndexCount * sizeof(uint16);
+    void* IndicesPointer = RHILockIndexBuffer(IndexBuffer.IndexBufferRHI, Allocation.IndexOffset * sizeof(uint16), IndicesSize, RLM_WriteOnly);
+    FMemory::Memcpy(IndicesPointer, Streams.Indices, IndicesSize);
+    RHIUnlockIndexBuffer(IndexBuffer.IndexBufferRHI);
+}
+
+uint32 NexusGeometryPool::GetPositionStride(const bool bCompactVertices)
+{
+    return bCompactVertices ? 4 * sizeof(int16) : sizeof(FVector);
+}
+
+uint32 NexusGeometryPool::GetTexCoordStride(const bool bCompactVertices)
+{
+    return bCompactVertices ? sizeof(FVector2DHalf) : sizeof(FVector2D);
+}
+
+uint64 NexusGeometryPool::GetNodeGPUSize(nx::Signature& Sig, const nx::Node& Node, const bool bCompactVertices)
+{
+    const uint64 VertexSize = GetPositionStride(bCompactVertices) + GetTexCoordStride(bCompactVertices)
+        + 2 * sizeof(FPackedNormal) + (Sig.vertex.hasColors() ? sizeof(FColor) : 0);
+    return Node.nvert * VertexSize + Node.nface * 3 * sizeof(uint16);
+}
+
+static uint32 GetStreamsLayout(nx::Signature& Sig, const uint32 VertexCount, const uint32 IndexCount, const bool bCompactVertices, uint32 OutOffsets[5])
+{
+    const uint32 Sizes[5] = {
+        VertexCount * NexusGeometryPool::GetPositionStride(bCompactVertices),
+        Sig.vertex.hasColors() ? VertexCount * static_cast<uint32>(sizeof(FColor)) : 0,
+        VertexCount * NexusGeometryPool::GetTexCoordStride(bCompactVertices),
+        VertexCount * 2 * static_cast<uint32>(sizeof(FPackedNormal)),
+        IndexCount * static_cast<uint32>(sizeof(uint16))
+    };
+    uint32 Size = 0;
+    for (int32 i = 0; i < 5; i ++)
+    {
+        OutOffsets[i] = Size;
+        Size += Align(Sizes[i], 16);
+    }
+    return Size;
+}
+
+uint32 NexusGeometryPool::GetStreamsSize(nx::Signature& Sig, const nx::Node& Node, const bool bCompactVertices)
+{
+    uint32 Offsets[5];
+    return GetStreamsLayout(Sig, Node.nvert, Node.nface * 3, bCompactVertices, Offsets);
+}
+
+FNexusNodeStreams NexusGeometryPool::MapNodeStreams(nx::Signature& Sig, const nx::Node& Node, const uint8* Memory, const bool bCompactVertices)
+{
+    FNexusNodeStreams Streams;
+    Streams.VertexCount = Node.nvert;
+    Streams.IndexCount = Node.nface * 3;
+    Streams.bCompactVertices = bCompactVertices;
+    uint32 Offsets[5];
+    GetStreamsLayout(Sig, Streams.VertexCount, Streams.IndexCount, bCompactVertices, Offsets);
+    
+    Streams.Positions = Memory + Offsets[0];
+    Streams.Colors = Sig.vertex.hasColors() ? reinterpret_cast<const FColor*>(Memory + Offsets[1]) : nullptr;
+    Streams.TexCoords = Memory + Offsets[2];
+    Streams.Tangents = reinterpret_cast<const FPackedNormal*>(Memory + Offsets[3]);
+    Streams.Indices = reinterpret_cast<const uint16*>(Memory + Offsets[4]);
+    return Streams;
+}
+
+FNexusWritableNodeStreams NexusGeometryPool::MapWritableNodeStreams(nx::Signature& Sig, const nx::Node& Node, uint8* Memory, const bool bCompactVertices)
+{
+    uint32 Offsets[5];
+    GetStreamsLayout(Sig, Node.nvert, Node.nface * 3, bCompactVertices, Offsets);
+
+    FNexusWritableNodeStreams Streams;
+    Streams.Positions = Memory + Offsets[0];
+    Streams.Colors = Sig.vertex.hasColors() ? reinterpret_cast<FColor*>(Memory + Offsets[1]) : nullptr;
+    Streams.TexCoords = Memory + Offsets[2];
+    Streams.Tangents = reinterpret_cast<FPackedNormal*>(Memory + Offsets[3]);
+    Streams.Indices = reinterpret_cast<uint16*>(Memory + Offsets[4]);
+    return Streams;
+}
+
+float NexusGeometryPool::GetQuantizationError(const FNexusNodeStreams& Streams)
+{
+    if (!Streams.bCompactVertices) return 0.0f;
+    // Half a step on every axis
+    return Streams.Dequantization.W / MAX_int16 * 0.5f * FMath::Sqrt(3.0f);
+}
+
+FNexusNodeStreams NexusGeometryPool::WriteNodeStreams(nx::Signature& Sig, nx::NodeData& Data, nx::Node& Node, uint8* Memory, const bool bCompactVertices, TArrayView<const FPackedNormal> TangentFrames)
+{
+    check(Sig.face.hasIndex());
+    FNexusNodeStreams Streams = MapNodeStreams(Sig, Node, Memory, bCompactVertices);
+    const FNexusWritableNodeStreams Writable = MapWritableNodeStreams(Sig, Node, Memory, bCompactVertices);
+    const uint32 VertexCount = Streams.VertexCount;
+
+    const vcg::Point3f* Coords = Data.coords();
+    if (bCompactVertices)
+    {
+        // Quantize in the bounding cube of the node, so that a single uniform scale dequantizes it
+        FBox Bounds(ForceInit);
+        for (uint32 i = 0; i < VertexCount; i++)
+        {
+            Bounds += FVector{ Coords[i].X(), Coords[i].Z(), Coords[i].Y() };
+        }
+        const FVector Center = Bounds.GetCenter();
+        const float Scale = FMath::Max(Bounds.GetExtent().GetMax(), SMALL_NUMBER);
+        Streams.Dequantization = FVector4(Center, Scale);
+
+        int16* Positions = static_cast<int16*>(Writable.Positions);
+        for (uint32 i = 0; i < VertexCount; i++)
+        {
+            const FVector Local = (FVector{ Coords[i].X(), Coords[i].Z(), Coords[i].Y() } - Center) / Scale;
+            Positions[i * 4 + 0] = static_cast<int16>(FMath::RoundToInt(FMath::Clamp(Local.X, -1.0f, 1.0f) * MAX_int16));
+            Positions[i * 4 + 1] = static_cast<int16>(FMath::RoundToInt(FMath::Clamp(Local.Y, -1.0f, 1.0f) * MAX_int16));
+            Positions[i * 4 + 2] = static_cast<int16>(FMath::RoundToInt(FMath::Clamp(Local.Z, -1.0f, 1.0f) * MAX_int16));
+            Positions[i * 4 + 3] = MAX_int16;
+        }
+    }
+    else
+    {
+        FVector* Positions = static_cast<FVector*>(Writable.Positions);
+        for (uint32 i = 0; i < VertexCount; i++)
+        {
+            Positions[i] = FVector{ Coords[i].X(), Coords[i].Z(), Coords[i].Y() };
+        }
+    }
+
+    if (Writable.Colors)
+    {
+        FMemory::Memcpy(Writable.Colors, Data.colors(Sig, VertexCount), VertexCount * sizeof(FColor));
+    }
+
+    void* TexCoords = Writable.TexCoords;
+    if (!Sig.vertex.hasTextures())
+    {
+        FMemory::Memzero(TexCoords, VertexCount * GetTexCoordStride(bCompactVertices));
+    }
+    else if (bCompactVertices)
+    {
+        const vcg::Point2f* NodeTexCoords = Data.texCoords(Sig, VertexCount);
+        FVector2DHalf* HalfTexCoords = static_cast<FVector2DHalf*>(TexCoords);
+        for (uint32 i = 0; i < VertexCount; i++)
+        {
+            HalfTexCoords[i] = FVector2DHalf(NodeTexCoords[i].X(), NodeTexCoords[i].Y());
+        }
+    }
+    else
+    {
+        FMemory::Memcpy(TexCoords, Data.texCoords(Sig, VertexCount), VertexCount * sizeof(FVector2D));
+    }
+
+    FPackedNormal* Tangents = Writable.Tangents;
+    if (TangentFrames.Num() == static_cast<int32>(VertexCount * 2) && CVarNexusUsePrecomputedTangents.GetValueOnAnyThread() != 0)
+    {
+        SCOPE_CYCLE_COUNTER(STATID_NexusTangentCopy);
+        FMemory::Memcpy(Tangents, TangentFrames.GetData(), VertexCount * 2 * sizeof(FPackedNormal));
+    }
+    else
+    {
+        FNexusGeometryPage::CalculateTangents(TArrayView<FPackedNormal>(Tangents, VertexCount * 2), Sig, Data, Node);
+    }
+
+    FMemory::Memcpy(Writable.Indices, Data.faces(Sig, VertexCount), Streams.IndexCount * sizeof(uint16));
+    return Streams;
+}
@@ -3,43 +3,79 @@
 #include "nexusfile.h"
 #include "UnrealNexusData.h"
 #include "UnrealNexusNodeData.h"
+#include "NexusCommons.h"
+#include "NexusGeometryPool.h"
+#include "NexusOcclusionBuffer.h"
+#include "HAL/RunnableThread.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
 
-FNexusJobExecutorThread::FNexusJobExecutorThread(nx::NexusFile* InFile)
-    : File(InFile)
+static TAutoConsoleVariable<int32> CVarNexusDecodeWorkers(
+    TEXT("nexus.DecodeWorkers"),
+    0,
+    TEXT("Number of threads decoding nexus nodes, 0 uses all the cores but the game and render thread ones.\n")
+    TEXT("Only read when the pool is created."),
+    ECVF_ReadOnly);
+
+DECLARE_CYCLE_STAT(TEXT("Texture Image Decoding"), STATID_NexusTextureImageDecoding, STATGROUP_NexusLoading);
+
+static FNexusJobExecutor* GNexusJobExecutor = nullptr;
+// Set by the module shutdown, the pool must not be created again after it
+static bool GNexusJobExecutorShutDown = false;
+
+struct FJobPriorityComparator
+{
+    bool operator()(const FNexusJob& A, const FNexusJob& B) const
+    {
+        return A.Priority > B.Priority;
+    }
+};
+
+FNexusJobExecutorThread::FNexusJobExecutorThread(FNexusJobExecutor& InExecutor)
+    : Executor(InExecutor)
 {
     QueueJobInsertedEvent = FGenericPlatformProcess::GetSynchEventFromPool(false);
 }
 
+FNexusJobExecutorThread::~FNexusJobExecutorThread()
+{
+    FGenericPlatformProcess::ReturnSynchEventToPool(QueueJobInsertedEvent);
+}
+
 uint32 FNexusJobExecutorThread::Run()
 {
-    bShouldBeRunning = true;
-    const int MaxTaskWaitTime = 100; // ms;
     while(bShouldBeRunning)
     {
-        while(QueuedJobs.IsEmpty() && bShouldBeRunning)
+        FNexusJob Job;
+        if (!Executor.DequeueJob(this, Job))
         {
-            // TODO Is there a way to avoid waiting for x ms?
-            QueueJobInsertedEvent->Wait(MaxTaskWaitTime);
+            QueueJobInsertedEvent->Wait();
+            continue;
         }
         
-        FNexusJob Job;
-        while(QueuedJobs.Dequeue(Job))
-        {
-            auto NodeId = Job.NodeIndex;
-            auto& Node = Job.Node;
-            auto& Data = Job.NodeData;
-            Data->DecodeData(Job.Data->Header, Node->NexusNode.nvert, Node->NexusNode.nface);
-            
-            if (Job.Data->Header.signature.face.hasTextures())
+        if (Job.NodeData)
+        {
+            Job.NodeData->DecodeData(Job.Data->Header, Job.Node->NexusNode.nvert, Job.Node->NexusNode.nface);
+            if (Job.Streams)
             {
-                // TODO Decode texture
+                Signature& TheSig = Job.Data->Header.signature;
+                Node& TheNode = Job.Node->NexusNode;
+                const bool bCompactVertices = Job.Streams->bCompactVertices;
+                Job.Streams->Memory.Allocate(NexusGeometryPool::GetStreamsSize(TheSig, TheNode, bCompactVertices));
+                Job.Streams->Streams = NexusGeometryPool::WriteNodeStreams(TheSig, Job.NodeData->GetNodeData(), TheNode, Job.Streams->Memory.GetData(),
+                    bCompactVertices, Job.NodeData->GetTangentFrames());
+            }
+            if (Job.Occluder)
+            {
+                FNexusOcclusionBuffer::WriteOccluderMesh(*Job.Occluder, Job.Data->Header.signature, Job.NodeData->GetNodeData(), Job.Node->NexusNode);
             }
-            JobsDone.Enqueue(Job);
         }
+        Executor.DecodeTextureImages(Job);
 #ifdef NEXUS_RUNNING_QUEUE_TESTS
         float MaxSleepTime = 0.5f;
         FPlatformProcess::Sleep(FMath::FRand() * MaxSleepTime);
 #endif
+        Executor.OnJobDone(Job);
     }
     return 0;
 }
@@ -47,15 +83,248 @@ uint32 FNexusJobExecutorThread::Run()
 void FNexusJobExecutorThread::Stop()
 {
     bShouldBeRunning = false;
+    WakeUp();
+}
+
+void FNexusJobExecutorThread::WakeUp() const
+{
+    QueueJobInsertedEvent->Trigger();
+}
+
+FNexusJobExecutor::FNexusJobExecutor(const int32 WorkersCount)
+{
+    JobsCancelledEvent = FGenericPlatformProcess::GetSynchEventFromPool(false);
+    ImageWrapperModule = &FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+    for (int32 i = 0; i < WorkersCount; i ++)
+    {
+        FNexusJobExecutorThread* Worker = new FNexusJobExecutorThread(*this);
+        Workers.Add(Worker);
+        WorkerThreads.Add(FRunnableThread::Create(Worker, *FString::Printf(TEXT("Nexus Node Loader %d"), i), 0, TPri_BelowNormal));
+    }
+}
+
+FNexusJobExecutor::~FNexusJobExecutor()
+{
+    for (FNexusJobExecutorThread* Worker : Workers)
+    {
+        Worker->Stop();
+    }
+    for (FRunnableThread* Thread : WorkerThreads)
+    {
+        Thread->WaitForCompletion();
+        delete Thread;
+    }
+    for (FNexusJobExecutorThread* Worker : Workers)
+    {
+        delete Worker;
+    }
+    FGenericPlatformProcess::ReturnSynchEventToPool(JobsCancelledEvent);
+}
+
+FNexusJobExecutor* FNexusJobExecutor::Get()
+{
+    if (!GNexusJobExecutor && !GNexusJobExecutorShutDown)
+    {
+        int32 WorkersCount = CVarNexusDecodeWorkers.GetValueOnAnyThread();
+        if (WorkersCount <= 0)
+        {
+            WorkersCount = FMath::Max(1, FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 2);
+        }
+        UE_LOG(NexusInfo, Log, TEXT("Starting %d nexus decoding workers"), WorkersCount);
+        GNexusJobExecutor = new FNexusJobExecutor(WorkersCount);
+    }
+    return GNexusJobExecutor;
+}
+
+void FNexusJobExecutor::Shutdown()
+{
+    delete GNexusJobExecutor;
+    GNexusJobExecutor = nullptr;
+    GNexusJobExecutorShutDown = true;
 }
 
-void FNexusJobExecutorThread::AddNewJobs(TArray<FNexusJob> Jobs) noexcept
+void FNexusJobExecutor::AddNewJobs(TArray<FNexusJob> Jobs) noexcept
 {
     if (Jobs.Num() == 0) return;
+
+    TArray<FNexusJobExecutorThread*, TInlineAllocator<8>> WorkersToWake;
+    {
+        FScopeLock Lock(&QueueMutex);
+        for (FNexusJob& Job : Jobs)
+        {
+            QueuedJobs.HeapPush(MoveTemp(Job), FJobPriorityComparator());
+        }
+        while (IdleWorkers.Num() > 0 && WorkersToWake.Num() < Jobs.Num())
+        {
+            WorkersToWake.Add(IdleWorkers.Pop(false));
+        }
+    }
     
-    for (auto Job : Jobs)
+    for (FNexusJobExecutorThread* Worker : WorkersToWake)
     {
-        QueuedJobs.Enqueue(Job);
+        Worker->WakeUp();
     }
-    QueueJobInsertedEvent->Trigger();
 }
+
+void FNexusJobExecutor::CancelJobs(const TSharedPtr<FNexusJobsDoneQueue, ESPMode::ThreadSafe>& JobsDone)
+{
+    check(IsInGameThread());
+    {
+        FScopeLock Lock(&QueueMutex);
+        QueuedJobs.RemoveAll([&JobsDone](const FNexusJob& Job)
+        {
+            return Job.JobsDone == JobsDone;
+        });
+        QueuedJobs.Heapify(FJobPriorityComparator());
+        if (!RunningJobsQueues.Contains(JobsDone.Get())) return;
+        CancellingQueue = JobsDone.Get();
+    }
+
+    // A running job still references its component data, the worker finishing the last one wakes us up
+    JobsCancelledEvent->Wait();
+}
+
+bool FNexusJobExecutor::DequeueJob(FNexusJobExecutorThread* Worker, FNexusJob& OutJob)
+{
+    FScopeLock Lock(&QueueMutex);
+    if (QueuedJobs.Num() == 0)
+    {
+        IdleWorkers.AddUnique(Worker);
+        return false;
+    }
+    QueuedJobs.HeapPop(OutJob, FJobPriorityComparator(), false);
+    RunningJobsQueues.Add(OutJob.JobsDone.Get());
+    return true;
+}
+
+void FNexusJobExecutor::OnJobDone(FNexusJob& Job)
+{
+    const FNexusJobsDoneQueue* JobsDone = Job.JobsDone.Get();
+    if (Job.JobsDone)
+    {
+        // Moved, the decoded textures can be big
+        Job.JobsDone->Enqueue(MoveTemp(Job));
+    }
+    bool bWasLastCancelledJob = false;
+    {
+        FScopeLock Lock(&QueueMutex);
+        RunningJobsQueues.RemoveSingleSwap(JobsDone, false);
+        if (JobsDone == CancellingQueue && !RunningJobsQueues.Contains(JobsDone))
+        {
+            // Cleared right away, so that the event is triggered once per CancelJobs
+            CancellingQueue = nullptr;
+            bWasLastCancelledJob = true;
+        }
+    }
+    if (bWasLastCancelledJob)
+    {
+        JobsCancelledEvent->Trigger();
+    }
+}
+
+// Box filters every mip from the previous one, the last row and column are repeated on odd sides
+static void GenerateMips(FNexusDecodedTexture& Decoded)
+{
+    int32 Width = Decoded.Width;
+    int32 Height = Decoded.Height;
+    while (Width > 1 || Height > 1)
+    {
+        const int32 MipWidth = FMath::Max(Width / 2, 1);
+        const int32 MipHeight = FMath::Max(Height / 2, 1);
+        TArray64<uint8> Mip;
+        Mip.SetNumUninitialized(static_cast<int64>(MipWidth) * MipHeight * 4);
+        const uint8* Source = Decoded.Mips.Last().GetData();
+        for (int32 Y = 0; Y < MipHeight; Y ++)
+        {
+            const int64 Row0 = static_cast<int64>(FMath::Min(2 * Y, Height - 1)) * Width;
+            const int64 Row1 = static_cast<int64>(FMath::Min(2 * Y + 1, Height - 1)) * Width;
+            for (int32 X = 0; X < MipWidth; X ++)
+            {
+                const int32 Column0 = FMath::Min(2 * X, Width - 1);
+                const int32 Column1 = FMath::Min(2 * X + 1, Width - 1);
+                for (int32 Channel = 0; Channel < 4; Channel ++)
+                {
+                    const uint32 Sum = Source[(Row0 + Column0) * 4 + Channel] + Source[(Row0 + Column1) * 4 + Channel]
+                        + Source[(Row1 + Column0) * 4 + Channel] + Source[(Row1 + Column1) * 4 + Channel];
+                    Mip[(static_cast<int64>(Y) * MipWidth + X) * 4 + Channel] = static_cast<uint8>((Sum + 2) / 4);
+                }
+            }
+        }
+        Decoded.Mips.Add(MoveTemp(Mip));
+        Width = MipWidth;
+        Height = MipHeight;
+    }
+}
+
+void FNexusJobExecutor::DecodeTextureImages(FNexusJob& Job) const
+{
+    if (Job.TextureImages.Num() == 0) return;
+    SCOPE_CYCLE_COUNTER(STATID_NexusTextureImageDecoding);
+    for (const FNexusTextureImage& Image : Job.TextureImages)
+    {
+        TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule->CreateImageWrapper(EImageFormat::JPEG);
+        FNexusDecodedTexture Decoded;
+        TArray64<uint8>& Pixels = Decoded.Mips.AddDefaulted_GetRef();
+        if (!ImageWrapper.IsValid() || !ImageWrapper->SetCompressed(Image.Bytes.GetData(), Image.Bytes.Num())
+            || !ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, Pixels))
+        {
+            UE_LOG(NexusErrors, Error, TEXT("Could not decode the image of texture %d"), Image.TextureID);
+            continue;
+        }
+        Decoded.TextureID = Image.TextureID;
+        Decoded.Width = ImageWrapper->GetWidth();
+        Decoded.Height = ImageWrapper->GetHeight();
+        if (Pixels.Num() < static_cast<int64>(Decoded.Width) * Decoded.Height * 4)
+        {
+            UE_LOG(NexusErrors, Error, TEXT("The image of texture %d is smaller than its size"), Image.TextureID);
+            continue;
+        }
+        // The decoded textures can't be streamed, so without a mip chain they'd alias wherever they're minified
+        GenerateMips(Decoded);
+        Job.DecodedTextures.Add(MoveTemp(Decoded));
+    }
+    Job.TextureImages.Empty();
+}
+
+#ifdef NEXUS_RUNNING_QUEUE_TESTS
+#include "Async/ParallelFor.h"
+
+// Floods the pool with empty jobs coming from several producers and reports the throughput
+static FAutoConsoleCommand GNexusQueueStressTestCommand(
+    TEXT("nexus.QueueStressTest"),
+    TEXT("nexus.QueueStressTest [JobsCount] [ProducersCount]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        const int32 JobsCount = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100000;
+        const int32 ProducersCount = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 4;
+        const int32 JobsPerProducer = JobsCount / ProducersCount;
+        FNexusJobExecutor* Executor = FNexusJobExecutor::Get();
+        if (!Executor) return;
+        const TSharedPtr<FNexusJobsDoneQueue, ESPMode::ThreadSafe> JobsDone = MakeShared<FNexusJobsDoneQueue, ESPMode::ThreadSafe>();
+        
+        const double StartTime = FPlatformTime::Seconds();
+        ParallelFor(ProducersCount, [&](const int32 Producer)
+        {
+            TArray<FNexusJob> Jobs;
+            for (int32 i = 0; i < JobsPerProducer; i ++)
+            {
+                FNexusJob Job { static_cast<uint32>(Producer * JobsPerProducer + i), nullptr, nullptr, nullptr };
+                Job.Priority = FMath::FRand();
+                Job.JobsDone = JobsDone;
+                Jobs.Add(Job);
+            }
+            Executor->AddNewJobs(Jobs);
+        });
+
+        int32 Completed = 0;
+        FNexusJob DoneJob;
+        while (Completed < JobsPerProducer * ProducersCount)
+        {
+            while (JobsDone->Dequeue(DoneJob)) Completed ++;
+            FPlatformProcess::Sleep(0.0f);
+        }
+        const double Elapsed = FPlatformTime::Seconds() - StartTime;
+        UE_LOG(NexusInfo, Display, TEXT("Nexus queue stress test: %d jobs on %d workers in %.3fs (%.0f jobs/s)"),
+            Completed, Executor->GetWorkersCount(), Elapsed, Completed / Elapsed);
+    }));
+#endif
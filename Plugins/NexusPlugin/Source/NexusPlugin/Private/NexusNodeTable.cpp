@@ -0,0 +1,251 @@
+﻿#include "NexusNodeTable.h"
+#include "NexusCommons.h"
+#include "UnrealNexusData.h"
+
+#include "Math/VectorRegister.h"
+
+void FNexusNodeTable::Build(const TArray<FUnrealNexusNode>& Nodes)
+{
+    const int32 NodesCount = Nodes.Num();
+    CenterX.SetNumUninitialized(NodesCount);
+    CenterY.SetNumUninitialized(NodesCount);
+    CenterZ.SetNumUninitialized(NodesCount);
+    Radius.SetNumUninitialized(NodesCount);
+    TightRadius.SetNumUninitialized(NodesCount);
+    Error.SetNumUninitialized(NodesCount);
+    ConeX.SetNumUninitialized(NodesCount);
+    ConeY.SetNumUninitialized(NodesCount);
+    ConeZ.SetNumUninitialized(NodesCount);
+    ConeSin.SetNumUninitialized(NodesCount);
+    ParentError.Init(0.0f, NodesCount);
+    ParentsCount.Init(0, NodesCount);
+    for (int32 i = 0; i < NodesCount; i ++)
+    {
+        const nx::Node& TheNode = Nodes[i].NexusNode;
+        const FVector Center = NexusCommons::VcgPoint3FToVector(TheNode.sphere.Center());
+        CenterX[i] = Center.X;
+        CenterY[i] = Center.Y;
+        CenterZ[i] = Center.Z;
+        Radius[i] = TheNode.sphere.Radius();
+        TightRadius[i] = TheNode.tight_radius;
+        Error[i] = TheNode.error;
+
+        // The cone is quantized to shorts, swizzled like the centers
+        const short* Cone = TheNode.cone.n;
+        const FVector Axis = FVector(Cone[0], Cone[2], Cone[1]) / 32766.0f;
+        const bool bHasCone = !Axis.IsNearlyZero() && Cone[3] < 32766;
+        ConeX[i] = Axis.X;
+        ConeY[i] = Axis.Y;
+        ConeZ[i] = Axis.Z;
+        ConeSin[i] = bHasCone ? Cone[3] / 32766.0f : 2.0f;
+
+        // A child can be referenced by more than one patch
+        TArray<uint32, TInlineAllocator<32>> Children;
+        for (const nx::Patch& NodePatch : Nodes[i].NodePatches)
+        {
+            if (NodePatch.node < static_cast<uint32>(NodesCount))
+            {
+                Children.AddUnique(NodePatch.node);
+            }
+        }
+        for (const uint32 Child : Children)
+        {
+            ParentError[Child] = FMath::Max(ParentError[Child], TheNode.error);
+            ParentsCount[Child] ++;
+        }
+    }
+}
+
+bool FNexusErrorView::Equals(const FNexusErrorView& Other) const
+{
+    if (Resolution != Other.Resolution || !Viewpoint.Equals(Other.Viewpoint) || Planes.Num() != Other.Planes.Num())
+    {
+        return false;
+    }
+    for (int32 i = 0; i < Planes.Num(); i ++)
+    {
+        if (!Planes[i].Equals(Other.Planes[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+float NexusErrorKernel::CalculateDistanceFromViewFrustum(const FNexusErrorView& View, const FVector& Point)
+{
+    float MinDistance = 1e20f;
+    for (const FPlane& Plane : View.Planes)
+    {
+        // The planes point outwards, so the distance is positive on the inner side
+        MinDistance = FMath::Min(MinDistance, -Plane.PlaneDot(Point));
+    }
+    return MinDistance;
+}
+
+bool NexusErrorKernel::IsBackfacing(const FNexusNodeTable& Table, const FVector& Viewpoint, const uint32 NodeID)
+{
+    // Same test as nx::Cone3s::Backface: the apex sits on the sphere, opposite to the axis
+    const FVector Axis(Table.ConeX[NodeID], Table.ConeY[NodeID], Table.ConeZ[NodeID]);
+    const FVector Center(Table.CenterX[NodeID], Table.CenterY[NodeID], Table.CenterZ[NodeID]);
+    const FVector Delta = Center - Axis * Table.Radius[NodeID] - Viewpoint;
+    const float Dot = Delta | Axis;
+    const float Sin = Table.ConeSin[NodeID];
+    return Dot > 0.0f && Dot * Dot > Delta.SizeSquared() * Sin * Sin;
+}
+
+float NexusErrorKernel::CalculateError(const FNexusNodeTable& Table, const FNexusErrorParams& Params, const uint32 NodeID, const bool bUseTight)
+{
+    const FVector Center(Table.CenterX[NodeID], Table.CenterY[NodeID], Table.CenterZ[NodeID]);
+    const float SphereRadius = bUseTight ? Table.TightRadius[NodeID] : Table.Radius[NodeID];
+    float MaxError = 0.0f;
+    for (const FNexusErrorView& View : Params.Views)
+    {
+        const float ViewpointDistance = FMath::Max(FVector::Distance(View.Viewpoint, Center) - SphereRadius, 0.1f);
+        float CalculatedError = Table.Error[NodeID] / (View.Resolution * ViewpointDistance);
+
+        const float DistanceFromViewFrustum = CalculateDistanceFromViewFrustum(View, Center);
+        if (DistanceFromViewFrustum < -SphereRadius)
+        {
+            CalculatedError /= Params.OuterNodeFactor + 1.0f;
+        } else if (DistanceFromViewFrustum < 0)
+        {
+            CalculatedError /= 1.0f - (DistanceFromViewFrustum / SphereRadius) * Params.OuterNodeFactor;
+        }
+        if (Params.BackfaceFactor > 0.0f && IsBackfacing(Table, View.Viewpoint, NodeID))
+        {
+            CalculatedError /= Params.BackfaceFactor + 1.0f;
+        }
+        MaxError = FMath::Max(MaxError, CalculatedError);
+    }
+    return MaxError * Params.ScaleConversion;
+}
+
+void NexusErrorKernel::CalculateErrors(const FNexusNodeTable& Table, const FNexusErrorParams& Params, const uint32* NodeIDs, const int32 Count, const bool bUseTight, float* OutErrors)
+{
+    if (Count <= 0) return;
+    
+    const float* Radii = bUseTight ? Table.TightRadius.GetData() : Table.Radius.GetData();
+    const VectorRegister MinViewpointDistance = VectorSetFloat1(0.1f);
+    const VectorRegister MinSquaredLength = VectorSetFloat1(1e-12f);
+    const VectorRegister OuterNodeFactor = VectorSetFloat1(Params.OuterNodeFactor);
+    const VectorRegister OutsideDivisor = VectorSetFloat1(Params.OuterNodeFactor + 1.0f);
+    const VectorRegister ScaleConversion = VectorSetFloat1(Params.ScaleConversion);
+    const bool bTestCones = Params.BackfaceFactor > 0.0f;
+    const VectorRegister BackfaceDivisor = VectorSetFloat1(Params.BackfaceFactor + 1.0f);
+
+    // Every view component splatted on its own register: the viewpoint, the resolution and then the planes
+    struct FViewRegisters
+    {
+        VectorRegister ViewpointX, ViewpointY, ViewpointZ, Resolution;
+        int32 FirstPlane, PlanesCount;
+    };
+    TArray<FViewRegisters, TInlineAllocator<2>> ViewRegisters;
+    TArray<VectorRegister, TInlineAllocator<2 * 6 * 4>> PlaneRegisters;
+    for (const FNexusErrorView& View : Params.Views)
+    {
+        FViewRegisters& Registers = ViewRegisters.AddDefaulted_GetRef();
+        Registers.ViewpointX = VectorSetFloat1(View.Viewpoint.X);
+        Registers.ViewpointY = VectorSetFloat1(View.Viewpoint.Y);
+        Registers.ViewpointZ = VectorSetFloat1(View.Viewpoint.Z);
+        Registers.Resolution = VectorSetFloat1(View.Resolution);
+        Registers.FirstPlane = PlaneRegisters.Num();
+        Registers.PlanesCount = View.Planes.Num();
+        for (const FPlane& Plane : View.Planes)
+        {
+            PlaneRegisters.Add(VectorSetFloat1(Plane.X));
+            PlaneRegisters.Add(VectorSetFloat1(Plane.Y));
+            PlaneRegisters.Add(VectorSetFloat1(Plane.Z));
+            PlaneRegisters.Add(VectorSetFloat1(Plane.W));
+        }
+    }
+
+    for (int32 Base = 0; Base < Count; Base += 4)
+    {
+        // The last batch repeats its last node on the missing lanes
+        uint32 IDs[4];
+        for (int32 Lane = 0; Lane < 4; Lane ++)
+        {
+            IDs[Lane] = NodeIDs[FMath::Min(Base + Lane, Count - 1)];
+        }
+        auto Gather = [&IDs](const float* Values)
+        {
+            return MakeVectorRegister(Values[IDs[0]], Values[IDs[1]], Values[IDs[2]], Values[IDs[3]]);
+        };
+        const VectorRegister CenterX = Gather(Table.CenterX.GetData());
+        const VectorRegister CenterY = Gather(Table.CenterY.GetData());
+        const VectorRegister CenterZ = Gather(Table.CenterZ.GetData());
+        const VectorRegister SphereRadius = Gather(Radii);
+        const VectorRegister NodeError = Gather(Table.Error.GetData());
+        VectorRegister ConeAxisX = VectorZero(), ConeAxisY = VectorZero(), ConeAxisZ = VectorZero();
+        VectorRegister ConeSin = VectorZero(), ConeRadius = VectorZero();
+        if (bTestCones)
+        {
+            ConeAxisX = Gather(Table.ConeX.GetData());
+            ConeAxisY = Gather(Table.ConeY.GetData());
+            ConeAxisZ = Gather(Table.ConeZ.GetData());
+            ConeSin = Gather(Table.ConeSin.GetData());
+            ConeRadius = Gather(Table.Radius.GetData());
+        }
+
+        VectorRegister MaxError = VectorZero();
+        for (const FViewRegisters& View : ViewRegisters)
+        {
+            const VectorRegister DeltaX = VectorSubtract(View.ViewpointX, CenterX);
+            const VectorRegister DeltaY = VectorSubtract(View.ViewpointY, CenterY);
+            const VectorRegister DeltaZ = VectorSubtract(View.ViewpointZ, CenterZ);
+            VectorRegister SquaredLength = VectorMultiply(DeltaX, DeltaX);
+            SquaredLength = VectorMultiplyAdd(DeltaY, DeltaY, SquaredLength);
+            SquaredLength = VectorMultiplyAdd(DeltaZ, DeltaZ, SquaredLength);
+            // Sqrt(x) = x / Sqrt(x), clamped so that a viewpoint on the center gives 0 instead of NaN
+            const VectorRegister Length = VectorMultiply(SquaredLength, VectorReciprocalSqrtAccurate(VectorMax(SquaredLength, MinSquaredLength)));
+            const VectorRegister ViewpointDistance = VectorMax(VectorSubtract(Length, SphereRadius), MinViewpointDistance);
+            const VectorRegister Error = VectorDivide(NodeError, VectorMultiply(View.Resolution, ViewpointDistance));
+
+            VectorRegister FrustumDistance = VectorSetFloat1(1e20f);
+            for (int32 i = View.FirstPlane; i < View.FirstPlane + View.PlanesCount * 4; i += 4)
+            {
+                VectorRegister Dot = VectorMultiply(CenterX, PlaneRegisters[i + 0]);
+                Dot = VectorMultiplyAdd(CenterY, PlaneRegisters[i + 1], Dot);
+                Dot = VectorMultiplyAdd(CenterZ, PlaneRegisters[i + 2], Dot);
+                FrustumDistance = VectorMin(FrustumDistance, VectorSubtract(PlaneRegisters[i + 3], Dot));
+            }
+
+            // Lanes that don't take a branch may hold garbage (e.g. a zero radius), the selects drop them
+            const VectorRegister PartialDivisor = VectorSubtract(VectorOne(), VectorMultiply(VectorDivide(FrustumDistance, SphereRadius), OuterNodeFactor));
+            VectorRegister Divisor = VectorSelect(VectorCompareGT(VectorZero(), FrustumDistance), PartialDivisor, VectorOne());
+            Divisor = VectorSelect(VectorCompareGT(VectorNegate(SphereRadius), FrustumDistance), OutsideDivisor, Divisor);
+
+            if (bTestCones)
+            {
+                // Apex - Viewpoint, with Apex = Center - Axis * Radius
+                const VectorRegister ApexX = VectorNegate(VectorMultiplyAdd(ConeAxisX, ConeRadius, DeltaX));
+                const VectorRegister ApexY = VectorNegate(VectorMultiplyAdd(ConeAxisY, ConeRadius, DeltaY));
+                const VectorRegister ApexZ = VectorNegate(VectorMultiplyAdd(ConeAxisZ, ConeRadius, DeltaZ));
+                VectorRegister Dot = VectorMultiply(ApexX, ConeAxisX);
+                Dot = VectorMultiplyAdd(ApexY, ConeAxisY, Dot);
+                Dot = VectorMultiplyAdd(ApexZ, ConeAxisZ, Dot);
+                VectorRegister ApexSquaredLength = VectorMultiply(ApexX, ApexX);
+                ApexSquaredLength = VectorMultiplyAdd(ApexY, ApexY, ApexSquaredLength);
+                ApexSquaredLength = VectorMultiplyAdd(ApexZ, ApexZ, ApexSquaredLength);
+                const VectorRegister Backfacing = VectorBitwiseAnd(
+                    VectorCompareGT(Dot, VectorZero()),
+                    VectorCompareGT(VectorMultiply(Dot, Dot), VectorMultiply(ApexSquaredLength, VectorMultiply(ConeSin, ConeSin))));
+                Divisor = VectorSelect(Backfacing, VectorMultiply(Divisor, BackfaceDivisor), Divisor);
+            }
+            MaxError = VectorMax(MaxError, VectorDivide(Error, Divisor));
+        }
+        const VectorRegister Result = VectorMultiply(MaxError, ScaleConversion);
+
+        if (Base + 4 <= Count)
+        {
+            VectorStore(Result, OutErrors + Base);
+        }
+        else
+        {
+            float Tail[4];
+            VectorStore(Result, Tail);
+            FMemory::Memcpy(OutErrors + Base, Tail, (Count - Base) * sizeof(float));
+        }
+    }
+}
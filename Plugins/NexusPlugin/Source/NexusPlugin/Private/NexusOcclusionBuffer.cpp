@@ -0,0 +1,167 @@
+﻿#include "NexusOcclusionBuffer.h"
+
+#include "Math/VectorRegister.h"
+#include "dag.h"
+#include "nexusdata.h"
+
+// Closer vertices make the triangle cross the near plane, such triangles aren't rasterized
+constexpr float GMinOccluderDepth = 1.0f;
+
+void FNexusOcclusionBuffer::Clear(const FMatrix& InModelToClip)
+{
+    ModelToClip = InModelToClip;
+    InvDepth.SetNumUninitialized(Width * Height);
+    FMemory::Memzero(InvDepth.GetData(), InvDepth.Num() * sizeof(float));
+    bIsEmpty = true;
+}
+
+int32 FNexusOcclusionBuffer::Rasterize(const FNexusOccluder& Occluder)
+{
+    const FNexusOccluderMesh& Mesh = *Occluder.Mesh;
+    ScreenVertices.SetNumUninitialized(Mesh.Positions.Num());
+    for (int32 i = 0; i < Mesh.Positions.Num(); i ++)
+    {
+        const FVector4 Clip = ModelToClip.TransformFVector4(FVector4(Mesh.Positions[i], 1.0f));
+        if (Clip.W < GMinOccluderDepth)
+        {
+            ScreenVertices[i] = FVector4(0.0f, 0.0f, 0.0f, -1.0f);
+            continue;
+        }
+        const float InvW = 1.0f / Clip.W;
+        ScreenVertices[i] = FVector4((Clip.X * InvW * 0.5f + 0.5f) * Width, (0.5f - Clip.Y * InvW * 0.5f) * Height, 0.0f, InvW);
+    }
+
+    int32 TrianglesCount = 0;
+    for (const TPair<uint32, uint32>& Range : Occluder.TriangleRanges)
+    {
+        for (uint32 Triangle = Range.Key; Triangle < Range.Value; Triangle ++)
+        {
+            const uint16* Indices = &Mesh.Indices[Triangle * 3];
+            RasterizeTriangle(ScreenVertices[Indices[0]], ScreenVertices[Indices[1]], ScreenVertices[Indices[2]]);
+        }
+        TrianglesCount += Range.Value - Range.Key;
+    }
+    bIsEmpty = bIsEmpty && TrianglesCount == 0;
+    return TrianglesCount;
+}
+
+void FNexusOcclusionBuffer::RasterizeTriangle(const FVector4& A, FVector4 B, FVector4 C)
+{
+    if (A.W <= 0.0f || B.W <= 0.0f || C.W <= 0.0f) return;
+
+    // Twice the signed area, both windings occlude
+    float Area = (B.X - A.X) * (C.Y - A.Y) - (B.Y - A.Y) * (C.X - A.X);
+    if (FMath::Abs(Area) < KINDA_SMALL_NUMBER) return;
+    if (Area < 0.0f)
+    {
+        Swap(B, C);
+        Area = -Area;
+    }
+
+    // The pixels are sampled at their centers, the columns start at a multiple of 4
+    const int32 MinX = FMath::Max(FMath::FloorToInt(FMath::Min3(A.X, B.X, C.X)), 0) & ~3;
+    const int32 MaxX = FMath::Min(FMath::CeilToInt(FMath::Max3(A.X, B.X, C.X)), Width);
+    const int32 MinY = FMath::Max(FMath::FloorToInt(FMath::Min3(A.Y, B.Y, C.Y)), 0);
+    const int32 MaxY = FMath::Min(FMath::CeilToInt(FMath::Max3(A.Y, B.Y, C.Y)), Height);
+    if (MinX >= MaxX || MinY >= MaxY) return;
+
+    // Edge functions as StepX * X + StepY * Y + Constant, positive inside the triangle.
+    // The edge opposite to a vertex over the area is the barycentric coordinate of that vertex
+    const float InvArea = 1.0f / Area;
+    const auto MakeEdge = [](const FVector4& From, const FVector4& To)
+    {
+        const float StepX = From.Y - To.Y;
+        const float StepY = To.X - From.X;
+        return FVector(StepX, StepY, -(StepX * From.X + StepY * From.Y));
+    };
+    const FVector EdgeBC = MakeEdge(B, C);
+    const FVector EdgeCA = MakeEdge(C, A);
+    const FVector EdgeAB = MakeEdge(A, B);
+    // 1 / W is linear in screen space
+    const FVector Depth = (EdgeBC * A.W + EdgeCA * B.W + EdgeAB * C.W) * InvArea;
+
+    const VectorRegister LaneOffsets = MakeVectorRegister(0.5f, 1.5f, 2.5f, 3.5f);
+    const VectorRegister EdgeBCStepX = VectorSetFloat1(EdgeBC.X);
+    const VectorRegister EdgeCAStepX = VectorSetFloat1(EdgeCA.X);
+    const VectorRegister EdgeABStepX = VectorSetFloat1(EdgeAB.X);
+    const VectorRegister DepthStepX = VectorSetFloat1(Depth.X);
+    for (int32 Y = MinY; Y < MaxY; Y ++)
+    {
+        const float PixelY = Y + 0.5f;
+        const VectorRegister EdgeBCRow = VectorSetFloat1(EdgeBC.Y * PixelY + EdgeBC.Z);
+        const VectorRegister EdgeCARow = VectorSetFloat1(EdgeCA.Y * PixelY + EdgeCA.Z);
+        const VectorRegister EdgeABRow = VectorSetFloat1(EdgeAB.Y * PixelY + EdgeAB.Z);
+        const VectorRegister DepthRow = VectorSetFloat1(Depth.Y * PixelY + Depth.Z);
+        float* Row = InvDepth.GetData() + Y * Width;
+        for (int32 X = MinX; X < MaxX; X += 4)
+        {
+            const VectorRegister PixelX = VectorAdd(VectorSetFloat1(static_cast<float>(X)), LaneOffsets);
+            const VectorRegister Inside = VectorBitwiseAnd(
+                VectorBitwiseAnd(
+                    VectorCompareGE(VectorMultiplyAdd(PixelX, EdgeBCStepX, EdgeBCRow), VectorZero()),
+                    VectorCompareGE(VectorMultiplyAdd(PixelX, EdgeCAStepX, EdgeCARow), VectorZero())),
+                VectorCompareGE(VectorMultiplyAdd(PixelX, EdgeABStepX, EdgeABRow), VectorZero()));
+            if (!VectorMaskBits(Inside)) continue;
+
+            const VectorRegister PixelDepth = VectorMultiplyAdd(PixelX, DepthStepX, DepthRow);
+            const VectorRegister Previous = VectorLoad(Row + X);
+            VectorStore(VectorSelect(Inside, VectorMax(Previous, PixelDepth), Previous), Row + X);
+        }
+    }
+}
+
+bool FNexusOcclusionBuffer::IsSphereOccluded(const FVector& Center, const float Radius) const
+{
+    if (bIsEmpty) return false;
+
+    // Screen bounds of the bounding box of the sphere, which is behind its nearest corner
+    float MinX = MAX_flt, MinY = MAX_flt, MaxX = -MAX_flt, MaxY = -MAX_flt;
+    float NearestInvW = 0.0f;
+    for (int32 Corner = 0; Corner < 8; Corner ++)
+    {
+        const FVector Offset((Corner & 1) ? Radius : -Radius, (Corner & 2) ? Radius : -Radius, (Corner & 4) ? Radius : -Radius);
+        const FVector4 Clip = ModelToClip.TransformFVector4(FVector4(Center + Offset, 1.0f));
+        if (Clip.W < GMinOccluderDepth) return false;
+        const float InvW = 1.0f / Clip.W;
+        const float ScreenX = (Clip.X * InvW * 0.5f + 0.5f) * Width;
+        const float ScreenY = (0.5f - Clip.Y * InvW * 0.5f) * Height;
+        MinX = FMath::Min(MinX, ScreenX);
+        MaxX = FMath::Max(MaxX, ScreenX);
+        MinY = FMath::Min(MinY, ScreenY);
+        MaxY = FMath::Max(MaxY, ScreenY);
+        NearestInvW = FMath::Max(NearestInvW, InvW);
+    }
+
+    // The pixels outside of the screen are outside of the frustum too
+    const int32 FirstX = FMath::Max(FMath::FloorToInt(MinX), 0) & ~3;
+    const int32 EndX = FMath::Min(FMath::CeilToInt(MaxX), Width);
+    const int32 FirstY = FMath::Max(FMath::FloorToInt(MinY), 0);
+    const int32 EndY = FMath::Min(FMath::CeilToInt(MaxY), Height);
+    if (FirstX >= EndX || FirstY >= EndY) return false;
+
+    const VectorRegister Nearest = VectorSetFloat1(NearestInvW);
+    for (int32 Y = FirstY; Y < EndY; Y ++)
+    {
+        const float* Row = InvDepth.GetData() + Y * Width;
+        for (int32 X = FirstX; X < EndX; X += 4)
+        {
+            if (VectorAnyGreaterThan(Nearest, VectorLoad(Row + X)))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void FNexusOcclusionBuffer::WriteOccluderMesh(FNexusOccluderMesh& OutMesh, nx::Signature& Sig, nx::NodeData& Data, const nx::Node& Node)
+{
+    const uint32 VertexCount = Node.nvert;
+    const vcg::Point3f* Coords = Data.coords();
+    OutMesh.Positions.SetNumUninitialized(VertexCount);
+    for (uint32 i = 0; i < VertexCount; i ++)
+    {
+        OutMesh.Positions[i] = FVector{ Coords[i].X(), Coords[i].Z(), Coords[i].Y() };
+    }
+    OutMesh.Indices = TArray<uint16>(Data.faces(Sig, VertexCount), Node.nface * 3);
+}
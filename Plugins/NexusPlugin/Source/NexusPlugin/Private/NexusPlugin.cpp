@@ -1,9 +1,11 @@
-// Copyright Epic Games, Inc. All Rights Reserved.
+﻿// Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "NexusPlugin.h"
 #include "Core.h"
 #include "Modules/ModuleManager.h"
 #include "nexusfile.h"
+#include "NexusJobExecutorThread.h"
+#include "NexusBufferPool.h"
 
 #define LOCTEXT_NAMESPACE "FNexusPluginModule"
 
@@ -14,7 +16,8 @@ void FNexusPluginModule::StartupModule()
 
 void FNexusPluginModule::ShutdownModule()
 {
-
+	FNexusJobExecutor::Shutdown();
+	FNexusBufferPool::Get().Trim();
 }
 
 #undef LOCTEXT_NAMESPACE
@@ -0,0 +1,142 @@
+﻿#include "NexusPrefetchSchedule.h"
+
+#include "UnrealNexusData.h"
+#include "Algo/BinarySearch.h"
+#include "Components/SplineComponent.h"
+#include "SceneManagement.h"
+
+// Same weight UUnrealNexusComponent gives to the nodes out of view
+constexpr float GScheduleOuterNodeFactor = 100.0f;
+
+// The error view of a sample, see UUnrealNexusComponent::AddCamera
+static FNexusErrorView MakeSampleView(const FNexusCameraSample& Sample, const FMatrix& WorldToModel)
+{
+    const float HalfFOV = FMath::DegreesToRadians(Sample.FieldOfView) * 0.5f;
+    const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(HalfFOV, HalfFOV, 1.0f, Sample.AspectRatio, GNearClippingPlane, GNearClippingPlane);
+    const FMatrix ViewMatrix = FTranslationMatrix(-Sample.Location) * FInverseRotationMatrix(Sample.Rotation) *
+        FMatrix(FPlane(0, 0, 1, 0), FPlane(1, 0, 0, 0), FPlane(0, 1, 0, 0), FPlane(0, 0, 0, 1));
+
+    FNexusErrorView View;
+    View.Viewpoint = WorldToModel.TransformPosition(Sample.Location);
+    View.Resolution = 4.0f / (ProjectionMatrix.M[0][0] * FMath::Max(Sample.ViewWidth, 1));
+    FConvexVolume ViewFrustum;
+    GetViewFrustumBounds(ViewFrustum, ViewMatrix * ProjectionMatrix, true);
+    for (const FPlane& Plane : ViewFrustum.Planes)
+    {
+        const FPlane ModelPlane = Plane.TransformBy(WorldToModel);
+        View.Planes.Add(ModelPlane / ModelPlane.Size());
+    }
+    return View;
+}
+
+void UNexusPrefetchSchedule::Build(UUnrealNexusData* InNexusData, const FTransform& ModelToWorld, const TArray<FNexusCameraSample>& Samples, const float InTargetError)
+{
+    NexusData = InNexusData;
+    TargetError = InTargetError;
+    // The nodes are stamped with the time of the first sample needing them and the schedule is searched by time,
+    // samples gathered from several sections or shots may come in any order
+    TArray<FNexusCameraSample> SortedSamples = Samples;
+    SortedSamples.StableSort([](const FNexusCameraSample& A, const FNexusCameraSample& B) { return A.Time < B.Time; });
+    Duration = SortedSamples.Num() > 0 ? SortedSamples.Last().Time : 0.0f;
+    Nodes.Reset();
+    if (!NexusData || NexusData->Nodes.Num() == 0) return;
+
+    const FNexusNodeTable& Table = NexusData->GetNodeTable();
+    const int32 NodesCount = NexusData->Nodes.Num();
+    const uint32 SinkID = NodesCount - 1;
+    const FMatrix WorldToModel = ModelToWorld.ToInverseMatrixWithScale();
+    FNexusErrorParams Params;
+    Params.OuterNodeFactor = GScheduleOuterNodeFactor;
+    // The cones are left out, a node facing away now may turn towards the camera before it's loaded
+    Params.BackfaceFactor = 0.0f;
+
+    TBitArray<> Scheduled(false, NodesCount);
+    TArray<int32> ParentStamps, ExpandedParents;
+    ParentStamps.Init(INDEX_NONE, NodesCount);
+    ExpandedParents.Init(0, NodesCount);
+    TArray<uint32> Level, NextLevel;
+    TArray<float> LevelErrors;
+    for (int32 SampleIndex = 0; SampleIndex < SortedSamples.Num(); SampleIndex ++)
+    {
+        Params.Views.Reset();
+        Params.Views.Add(MakeSampleView(SortedSamples[SampleIndex], WorldToModel));
+
+        // Like the shadow cut of the component: a node is refined once all its parents are,
+        // and the roots are needed regardless of their error
+        Level.Reset();
+        for (int32 i = 0; i < NexusData->RootsCount; i ++)
+        {
+            Level.Add(i);
+        }
+        while (Level.Num() > 0)
+        {
+            LevelErrors.SetNumUninitialized(Level.Num(), false);
+            NexusErrorKernel::CalculateErrors(Table, Params, Level.GetData(), Level.Num(), false, LevelErrors.GetData());
+            NextLevel.Reset();
+            for (int32 i = 0; i < Level.Num(); i ++)
+            {
+                const uint32 ID = Level[i];
+                const bool bIsRoot = static_cast<int32>(ID) < NexusData->RootsCount;
+                if (!bIsRoot && LevelErrors[i] <= TargetError) continue;
+                if (!Scheduled[ID])
+                {
+                    Scheduled[ID] = true;
+                    FNexusScheduledNode& Node = Nodes.AddDefaulted_GetRef();
+                    Node.Time = SortedSamples[SampleIndex].Time;
+                    Node.NodeID = ID;
+                    Node.Error = LevelErrors[i];
+                }
+                if (LevelErrors[i] <= TargetError) continue;
+
+                TArray<uint32, TInlineAllocator<32>> Children;
+                for (const nx::Patch& NodePatch : NexusData->Nodes[ID].NodePatches)
+                {
+                    if (NodePatch.node != SinkID)
+                    {
+                        Children.AddUnique(NodePatch.node);
+                    }
+                }
+                for (const uint32 Child : Children)
+                {
+                    if (ParentStamps[Child] != SampleIndex)
+                    {
+                        ParentStamps[Child] = SampleIndex;
+                        ExpandedParents[Child] = 0;
+                    }
+                    if (++ ExpandedParents[Child] == Table.ParentsCount[Child])
+                    {
+                        NextLevel.Add(Child);
+                    }
+                }
+            }
+            Swap(Level, NextLevel);
+        }
+    }
+    MarkPackageDirty();
+}
+
+TArray<FNexusCameraSample> UNexusPrefetchSchedule::SampleSpline(const USplineComponent* Spline, const float InDuration, const float SampleRate, const float FieldOfView, const int32 ViewWidth)
+{
+    TArray<FNexusCameraSample> Samples;
+    if (!Spline || InDuration <= 0.0f || SampleRate <= 0.0f) return Samples;
+
+    const float Length = Spline->GetSplineLength();
+    const int32 SamplesCount = FMath::CeilToInt(InDuration * SampleRate) + 1;
+    Samples.Reserve(SamplesCount);
+    for (int32 i = 0; i < SamplesCount; i ++)
+    {
+        FNexusCameraSample& Sample = Samples.AddDefaulted_GetRef();
+        Sample.Time = FMath::Min(i / SampleRate, InDuration);
+        const float Distance = Length * Sample.Time / InDuration;
+        Sample.Location = Spline->GetLocationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+        Sample.Rotation = Spline->GetRotationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+        Sample.FieldOfView = FieldOfView;
+        Sample.ViewWidth = ViewWidth;
+    }
+    return Samples;
+}
+
+int32 UNexusPrefetchSchedule::FindFirstNode(const float Time) const
+{
+    return Algo::LowerBoundBy(Nodes, Time, &FNexusScheduledNode::Time);
+}
@@ -0,0 +1,174 @@
+﻿#include "NexusTextureResidency.h"
+#include "NexusBufferPool.h"
+#include "UnrealNexusData.h"
+#include "Engine/Texture2D.h"
+
+DECLARE_MEMORY_STAT(TEXT("Loaded Textures"), STATID_NexusLoadedTextures, STATGROUP_NexusMemory);
+DECLARE_MEMORY_STAT(TEXT("Unused Textures"), STATID_NexusUnusedTextures, STATGROUP_NexusMemory);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Loading Textures"), STATID_NexusLoadingTextures, STATGROUP_NexusMemory);
+// Memory of the mips the error of the nodes doesn't need, compared to keeping every mip of the loaded textures
+DECLARE_MEMORY_STAT(TEXT("Texture Mips Saved"), STATID_NexusTextureMipsSaved, STATGROUP_NexusMemory);
+
+void FNexusTextureResidency::Init(UUnrealNexusData* InData)
+{
+    Data = InData;
+    const int32 TexturesCount = Data ? Data->NodeTexturesPaths.Num() : 0;
+    const int32 NodesCount = Data ? Data->Nodes.Num() : 0;
+    Textures.SetNum(TexturesCount);
+    AcquiredNodes.Init(false, NodesCount);
+    UnusedTextures.Init(TexturesCount);
+}
+
+void FNexusTextureResidency::GetNodeTextures(const uint32 NodeID, TArray<uint32, TInlineAllocator<8>>& OutTextures) const
+{
+    for (const nx::Patch& NodePatch : Data->Nodes[NodeID].NodePatches)
+    {
+        const uint32 TextureID = NodePatch.texture;
+        if (!Textures.IsValidIndex(TextureID) || !Data->HasTexture(TextureID)) continue;
+        OutTextures.AddUnique(TextureID);
+    }
+}
+
+void FNexusTextureResidency::AcquireNode(const uint32 NodeID)
+{
+    if (Textures.Num() == 0 || AcquiredNodes[NodeID]) return;
+    AcquiredNodes[NodeID] = true;
+    
+    TArray<uint32, TInlineAllocator<8>> NodeTextures;
+    GetNodeTextures(NodeID, NodeTextures);
+    for (const uint32 TextureID : NodeTextures)
+    {
+        FTextureEntry& Texture = Textures[TextureID];
+        if (Texture.RefCount ++ > 0) continue;
+        
+        Texture.Error = 0.0f;
+        if (UnusedTextures.Contains(TextureID))
+        {
+            UnusedTextures.Remove(TextureID);
+            UnusedSize -= Texture.Size;
+        }
+        if (!Texture.bRequested)
+        {
+            Texture.bRequested = true;
+            LoadingTextures.Add(TextureID);
+            Data->LoadTextureForNode(TextureID, FStreamableDelegate());
+        }
+    }
+}
+
+void FNexusTextureResidency::ReleaseNode(const uint32 NodeID, const float Error)
+{
+    if (!AcquiredNodes.IsValidIndex(NodeID) || !AcquiredNodes[NodeID]) return;
+    AcquiredNodes[NodeID] = false;
+    
+    TArray<uint32, TInlineAllocator<8>> NodeTextures;
+    GetNodeTextures(NodeID, NodeTextures);
+    for (const uint32 TextureID : NodeTextures)
+    {
+        FTextureEntry& Texture = Textures[TextureID];
+        Texture.Error = FMath::Max(Texture.Error, Error);
+        if (-- Texture.RefCount > 0) continue;
+        
+        if (Texture.bLoaded)
+        {
+            UnusedTextures.Push(TextureID, Texture.Error);
+            UnusedSize += Texture.Size;
+        }
+        else
+        {
+            // No one is waiting for it anymore
+            LoadingTextures.RemoveSingleSwap(TextureID);
+            Unload(TextureID);
+        }
+    }
+    SET_MEMORY_STAT(STATID_NexusUnusedTextures, UnusedSize);
+}
+
+void FNexusTextureResidency::Update(TArray<uint32>& OutLoadedTextures)
+{
+    Data->UpdateDecodedTextures();
+    for (int32 i = LoadingTextures.Num() - 1; i >= 0; i --)
+    {
+        const uint32 TextureID = LoadingTextures[i];
+        if (!Data->IsTextureLoaded(TextureID)) continue;
+        
+        LoadingTextures.RemoveAtSwap(i);
+        FTextureEntry& Texture = Textures[TextureID];
+        UTexture* LoadedTexture = Data->GetTexture(TextureID);
+        Texture.bLoaded = true;
+        Texture.Size = LoadedTexture ? LoadedTexture->CalcTextureMemorySizeEnum(TMC_AllMips) : 0;
+        LoadedSize += Texture.Size;
+        OutLoadedTextures.Add(TextureID);
+    }
+    SET_MEMORY_STAT(STATID_NexusLoadedTextures, LoadedSize);
+    SET_DWORD_STAT(STATID_NexusLoadingTextures, LoadingTextures.Num());
+}
+
+void FNexusTextureResidency::EnforceBudget(const uint64 Budget, TArray<uint32>& OutUnloadedTextures)
+{
+    while (LoadedSize > Budget && UnusedTextures.Num() > 0)
+    {
+        const uint32 TextureID = UnusedTextures.Pop();
+        UnusedSize -= Textures[TextureID].Size;
+        Unload(TextureID);
+        OutUnloadedTextures.Add(TextureID);
+    }
+    SET_MEMORY_STAT(STATID_NexusLoadedTextures, LoadedSize);
+    SET_MEMORY_STAT(STATID_NexusUnusedTextures, UnusedSize);
+}
+
+bool FNexusTextureResidency::UpdateWantedResolutions(TFunctionRef<float(uint32)> GetNodeProjectedSize)
+{
+    for (FTextureEntry& Texture : Textures)
+    {
+        Texture.ProjectedSize = 0.0f;
+    }
+    TArray<uint32, TInlineAllocator<8>> NodeTextures;
+    for (TConstSetBitIterator<> It(AcquiredNodes); It; ++ It)
+    {
+        const float ProjectedSize = GetNodeProjectedSize(It.GetIndex());
+        if (ProjectedSize <= 0.0f) continue;
+        NodeTextures.Reset();
+        GetNodeTextures(It.GetIndex(), NodeTextures);
+        for (const uint32 TextureID : NodeTextures)
+        {
+            Textures[TextureID].ProjectedSize = FMath::Max(Textures[TextureID].ProjectedSize, ProjectedSize);
+        }
+    }
+
+    bool bChanged = false;
+    uint64 SavedSize = 0;
+    for (int32 TextureID = 0; TextureID < Textures.Num(); TextureID ++)
+    {
+        FTextureEntry& Texture = Textures[TextureID];
+        if (!Texture.bLoaded) continue;
+        UTexture2D* LoadedTexture = Cast<UTexture2D>(Data->GetTexture(TextureID));
+        // The textures decoded at runtime have their whole mip chain resident, the streamer can't drop any of it
+        if (LoadedTexture == nullptr || LoadedTexture->NeverStream) continue;
+
+        // Unused by the last traversal, keep the smallest mip the streamer allows
+        const int32 MipsCount = LoadedTexture->GetNumMips();
+        const int32 FullResolution = FMath::Max(LoadedTexture->GetSizeX(), LoadedTexture->GetSizeY());
+        int32 DroppedMips = MipsCount - 1;
+        if (Texture.ProjectedSize > 0.0f)
+        {
+            // The texture covers the node, every mip whose side is still above the pixels the node spans can go
+            DroppedMips = FMath::Clamp(FMath::FloorToInt(FMath::Log2(FullResolution / Texture.ProjectedSize)), 0, MipsCount - 1);
+        }
+        const int32 WantedResolution = FMath::Max(FullResolution >> DroppedMips, 1);
+        bChanged |= WantedResolution != Texture.WantedResolution;
+        Texture.WantedResolution = WantedResolution;
+        SavedSize += Texture.Size - FMath::Min<uint64>(Texture.Size, LoadedTexture->CalcTextureMemorySize(MipsCount - DroppedMips));
+    }
+    SET_MEMORY_STAT(STATID_NexusTextureMipsSaved, SavedSize);
+    return bChanged;
+}
+
+void FNexusTextureResidency::Unload(const uint32 TextureID)
+{
+    FTextureEntry& Texture = Textures[TextureID];
+    check(Texture.RefCount == 0);
+    LoadedSize -= Texture.Size;
+    Texture = FTextureEntry();
+    Data->UnloadTexture(TextureID);
+}
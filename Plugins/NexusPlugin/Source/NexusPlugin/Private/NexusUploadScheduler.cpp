@@ -0,0 +1,166 @@
+﻿#include "NexusUploadScheduler.h"
+#include "NexusBufferPool.h"
+#include "UnrealNexusData.h"
+#include "UnrealNexusNodeData.h"
+#include "UnrealNexusProxy.h"
+
+DECLARE_CYCLE_STAT(TEXT("Upload Staging"), STATID_NexusUploadStaging, STATGROUP_NexusMemory);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Uploaded MB/frame"), STATID_NexusUploadedMB, STATGROUP_NexusMemory);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Upload Queue Depth"), STATID_NexusUploadQueueDepth, STATGROUP_NexusMemory);
+DECLARE_MEMORY_STAT(TEXT("Staging Ring Used"), STATID_NexusStagingRingUsed, STATGROUP_NexusMemory);
+// Worst quantization error of the compact vertices uploaded this frame, as a fraction of the node error
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Quantization Error / Node Error"), STATID_NexusQuantizationError, STATGROUP_NexusMemory);
+
+static TAutoConsoleVariable<int32> CVarNexusUploadBudgetKB(
+    TEXT("nexus.UploadBudgetKB"),
+    4096,
+    TEXT("Kilobytes of node geometry uploaded every frame, at least one node is always uploaded"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNexusUploadBudgetMs(
+    TEXT("nexus.UploadBudgetMs"),
+    1.0f,
+    TEXT("Milliseconds spent every frame staging the node geometry to upload"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusUploadStagingMB(
+    TEXT("nexus.UploadStagingMB"),
+    32,
+    TEXT("Size of the staging ring the node geometry is converted into before the upload"),
+    ECVF_ReadOnly);
+
+void FNexusStagingRing::Init(const uint32 InCapacity)
+{
+    Memory.SetNumUninitialized(Align(InCapacity, 16));
+    WriteCursor = 0;
+    ReleaseCursor = 0;
+}
+
+uint8* FNexusStagingRing::Allocate(uint32 Size)
+{
+    const uint32 Capacity = GetCapacity();
+    Size = Align(Size, 16);
+    if (Size > Capacity) return nullptr;
+
+    // The memory has to be contiguous, skip the tail of the ring if the allocation doesn't fit in it
+    const uint32 Offset = WriteCursor % Capacity;
+    const uint32 Padding = Offset + Size > Capacity ? Capacity - Offset : 0;
+    if (WriteCursor + Padding + Size - ReleaseCursor > Capacity) return nullptr;
+    WriteCursor += Padding + Size;
+    return Memory.GetData() + (Padding > 0 ? 0 : Offset);
+}
+
+bool FNexusStagingRing::Reserve(const uint32 Size)
+{
+    if (Size <= GetCapacity()) return true;
+    if (GetUsed() > 0) return false;
+    Init(Size);
+    return true;
+}
+
+FNexusUploadScheduler::FNexusUploadScheduler(FUnrealNexusProxy* InProxy)
+    : Proxy(InProxy)
+{
+}
+
+void FNexusUploadScheduler::Enqueue(const FNexusPendingUpload& Upload)
+{
+    check(!QueuedNodes.Contains(Upload.NodeID));
+    Queue.Add(Upload);
+    QueuedNodes.Add(Upload.NodeID);
+}
+
+bool FNexusUploadScheduler::Cancel(const uint32 NodeID, FNexusPendingUpload& OutUpload)
+{
+    if (!QueuedNodes.Contains(NodeID)) return false;
+    const int32 Index = Queue.IndexOfByPredicate([NodeID](const FNexusPendingUpload& Upload) { return Upload.NodeID == NodeID; });
+    check(Index != INDEX_NONE);
+    OutUpload = Queue[Index];
+    Queue.RemoveAt(Index);
+    QueuedNodes.Remove(NodeID);
+    return true;
+}
+
+void FNexusUploadScheduler::Flush()
+{
+    SCOPE_CYCLE_COUNTER(STATID_NexusUploadStaging);
+    SET_FLOAT_STAT(STATID_NexusUploadedMB, 0.0f);
+    SET_DWORD_STAT(STATID_NexusUploadQueueDepth, Queue.Num());
+    if (Queue.Num() == 0) return;
+
+    if (StagingRing.GetCapacity() == 0)
+    {
+        StagingRing.Init(CVarNexusUploadStagingMB.GetValueOnGameThread() * 1024 * 1024);
+    }
+    
+    const uint64 ByteBudget = static_cast<uint64>(FMath::Max(CVarNexusUploadBudgetKB.GetValueOnGameThread(), 0)) * 1024;
+    const double TimeBudget = CVarNexusUploadBudgetMs.GetValueOnGameThread() / 1000.0;
+    const double StartTime = FPlatformTime::Seconds();
+
+    UUnrealNexusData* ComponentData = Proxy->ComponentData;
+    Signature& TheSig = ComponentData->Header.signature;
+    TArray<FStagedNode> Batch;
+    float MaxQuantizationErrorRatio = 0.0f;
+    uint64 StagedBytes = 0;
+    int32 StagedCount = 0;
+    for (; StagedCount < Queue.Num(); StagedCount ++)
+    {
+        // The first node always goes, so that a node bigger than the budget doesn't stall the queue
+        if (StagedCount > 0 && (StagedBytes >= ByteBudget || FPlatformTime::Seconds() - StartTime >= TimeBudget))
+        {
+            break;
+        }
+        
+        const FNexusPendingUpload& Upload = Queue[StagedCount];
+        Node& TheNode = ComponentData->Nodes[Upload.NodeID].NexusNode;
+        const uint32 Size = NexusGeometryPool::GetStreamsSize(TheSig, TheNode, Proxy->bCompactVertices);
+        if (!StagingRing.Reserve(Size)) break;
+        uint8* Memory = StagingRing.Allocate(Size);
+        if (Memory == nullptr) break; // Wait for the render thread to consume the ring
+
+        FNexusNodeStreams Streams;
+        if (Upload.Prepared && Upload.Prepared->Memory.IsValid() && Upload.Prepared->bCompactVertices == Proxy->bCompactVertices)
+        {
+            // Already in the page layout, a single copy
+            FMemory::Memcpy(Memory, Upload.Prepared->Memory.GetData(), Size);
+            Streams = NexusGeometryPool::MapNodeStreams(TheSig, TheNode, Memory, Proxy->bCompactVertices);
+            Streams.Dequantization = Upload.Prepared->Streams.Dequantization;
+        }
+        else
+        {
+            INexusNodeData* TheNodeData = ComponentData->GetNodeData(Upload.NodeID);
+            check(TheNodeData && TheNodeData->GetNodeData().memory);
+            Streams = NexusGeometryPool::WriteNodeStreams(TheSig, TheNodeData->GetNodeData(), TheNode, Memory, Proxy->bCompactVertices, TheNodeData->GetTangentFrames());
+        }
+        
+        // The render thread draws from the new place once this batch ran, the old one can be reused by later uploads
+        Proxy->GeometryAllocator.Free(Upload.PreviousAllocation);
+        Batch.Add({ Upload, Streams, TheNode.nface });
+        MaxQuantizationErrorRatio = FMath::Max(MaxQuantizationErrorRatio, NexusGeometryPool::GetQuantizationError(Streams) / FMath::Max(TheNode.error, SMALL_NUMBER));
+        Batch.Last().Upload.Prepared.Reset();
+        QueuedNodes.Remove(Upload.NodeID);
+        StagedBytes += Size;
+    }
+    Queue.RemoveAt(0, StagedCount, false);
+    
+    SET_FLOAT_STAT(STATID_NexusUploadedMB, StagedBytes / (1024.0f * 1024.0f));
+    SET_DWORD_STAT(STATID_NexusUploadQueueDepth, Queue.Num());
+    SET_MEMORY_STAT(STATID_NexusStagingRingUsed, StagingRing.GetUsed());
+    if (Proxy->bCompactVertices)
+    {
+        SET_FLOAT_STAT(STATID_NexusQuantizationError, MaxQuantizationErrorRatio);
+    }
+    if (Batch.Num() == 0) return;
+
+    FUnrealNexusProxy* TheProxy = Proxy;
+    FNexusStagingRing* Ring = &StagingRing;
+    const uint64 ReleaseCursor = StagingRing.GetWriteCursor();
+    ENQUEUE_RENDER_COMMAND(NexusUploadNodes)([TheProxy, Ring, ReleaseCursor, Batch = MoveTemp(Batch)](FRHICommandListImmediate& Commands)
+    {
+        for (const FStagedNode& Staged : Batch)
+        {
+            TheProxy->CommitUpload(Staged.Upload, Staged.Streams, Staged.NumPrimitives);
+        }
+        Ring->Release(ReleaseCursor);
+    });
+}
@@ -0,0 +1,217 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "NexusNodeTable.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusConeCullingTest
+{
+    // A closed sphere, split like a cube map: every face is a root and every node has the four quarters of its patch as children
+    constexpr float SphereRadius = 1000.0f;
+    constexpr int32 Depth = 7;
+    constexpr float ErrorOverRadius = 0.05f;
+    // Same as the component's Backface_Node_Factor
+    constexpr float BackfaceFactor = 100.0f;
+    constexpr float TargetError = 1.0f;
+
+    struct FSphereDAG
+    {
+        FNexusNodeTable Table;
+        TArray<TArray<uint32, TInlineAllocator<4>>> Children;
+        // The patches are added depth first, so the faces are spread over the table
+        TArray<uint32, TInlineAllocator<6>> Roots;
+    };
+
+    FVector GetCubeFacePoint(const int32 Face, const float U, const float V)
+    {
+        const float Sign = Face & 1 ? -1.0f : 1.0f;
+        switch (Face / 2)
+        {
+        case 0: return FVector(Sign, U, V);
+        case 1: return FVector(U, Sign, V);
+        default: return FVector(U, V, Sign);
+        }
+    }
+
+    uint32 AddPatch(FSphereDAG& DAG, const int32 Face, const float U0, const float V0, const float U1, const float V1, const int32 Level)
+    {
+        // Patch corners and edge midpoints on the sphere, which is also where their normals point
+        TArray<FVector, TInlineAllocator<9>> Points;
+        for (int32 i = 0; i < 3; i ++)
+        {
+            for (int32 j = 0; j < 3; j ++)
+            {
+                Points.Add(GetCubeFacePoint(Face, FMath::Lerp(U0, U1, i * 0.5f), FMath::Lerp(V0, V1, j * 0.5f)).GetSafeNormal());
+            }
+        }
+        const FVector Axis = Points[4];
+        const FVector Center = Axis * SphereRadius;
+        float Radius = 0.0f;
+        float MinCos = 1.0f;
+        for (const FVector& Point : Points)
+        {
+            Radius = FMath::Max(Radius, FVector::Distance(Point * SphereRadius, Center));
+            MinCos = FMath::Min(MinCos, Point | Axis);
+        }
+        // The edges bulge between the sampled points
+        Radius *= 1.1f;
+
+        FNexusNodeTable& Table = DAG.Table;
+        const uint32 NodeID = Table.Error.Num();
+        Table.CenterX.Add(Center.X);
+        Table.CenterY.Add(Center.Y);
+        Table.CenterZ.Add(Center.Z);
+        Table.Radius.Add(Radius);
+        Table.TightRadius.Add(Radius);
+        Table.Error.Add(Radius * ErrorOverRadius);
+        Table.ConeX.Add(Axis.X);
+        Table.ConeY.Add(Axis.Y);
+        Table.ConeZ.Add(Axis.Z);
+        // Widened a bit for the same reason as the radius
+        Table.ConeSin.Add(FMath::Min(FMath::Sqrt(1.0f - MinCos * MinCos) * 1.1f, 1.0f));
+        Table.ParentError.Add(0.0f);
+        Table.ParentsCount.Add(Level == 0 ? 0 : 1);
+        DAG.Children.AddDefaulted();
+
+        if (Level + 1 < Depth)
+        {
+            const float UM = (U0 + U1) * 0.5f;
+            const float VM = (V0 + V1) * 0.5f;
+            const uint32 Quarters[4] = {
+                AddPatch(DAG, Face, U0, V0, UM, VM, Level + 1),
+                AddPatch(DAG, Face, UM, V0, U1, VM, Level + 1),
+                AddPatch(DAG, Face, U0, VM, UM, V1, Level + 1),
+                AddPatch(DAG, Face, UM, VM, U1, V1, Level + 1)
+            };
+            for (const uint32 Child : Quarters)
+            {
+                DAG.Children[NodeID].Add(Child);
+                Table.ParentError[Child] = Table.Error[NodeID];
+            }
+        }
+        return NodeID;
+    }
+
+    void BuildSphereDAG(FSphereDAG& OutDAG)
+    {
+        for (int32 Face = 0; Face < 6; Face ++)
+        {
+            OutDAG.Roots.Add(AddPatch(OutDAG, Face, -1.0f, -1.0f, 1.0f, 1.0f, 0));
+        }
+    }
+
+    struct FTraversalStats
+    {
+        int32 Visited = 0;
+        int32 Culled = 0;
+        int32 Selected = 0;
+    };
+
+    // Refines the largest error first until every node left is below the target, like DoFullTraversal with everything loaded
+    FTraversalStats Traverse(const FSphereDAG& DAG, const FNexusErrorParams& Params)
+    {
+        FTraversalStats Stats;
+        TArray<TPair<float, uint32>> Queue;
+        const auto ByError = [](const TPair<float, uint32>& A, const TPair<float, uint32>& B) { return A.Key > B.Key; };
+        const auto Push = [&](const uint32 NodeID)
+        {
+            const float Error = NexusErrorKernel::CalculateError(DAG.Table, Params, NodeID, false);
+            Queue.HeapPush(TPair<float, uint32>(Error, NodeID), ByError);
+        };
+        for (const uint32 Root : DAG.Roots)
+        {
+            Push(Root);
+        }
+        while (Queue.Num() > 0)
+        {
+            TPair<float, uint32> Element;
+            Queue.HeapPop(Element, ByError);
+            Stats.Visited ++;
+            const uint32 NodeID = Element.Value;
+            const bool bCulled = Params.BackfaceFactor > 0.0f && NexusErrorKernel::IsBackfacing(DAG.Table, Params.Views[0].Viewpoint, NodeID);
+            if (bCulled)
+            {
+                Stats.Culled ++;
+            }
+            if (Element.Key <= TargetError) continue;
+            Stats.Selected ++;
+            for (const uint32 Child : DAG.Children[NodeID])
+            {
+                Push(Child);
+            }
+        }
+        return Stats;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusConeCullingTest, "Nexus.Traversal.ConeCulling",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNexusConeCullingTest::RunTest(const FString& Parameters)
+{
+    using namespace NexusConeCullingTest;
+    FSphereDAG DAG;
+    BuildSphereDAG(DAG);
+    const int32 NodesCount = DAG.Table.Num();
+
+    // Close enough for the near side to be refined deep down, no planes so that only the cones lower the errors
+    FNexusErrorParams ParamsOff;
+    FNexusErrorView& View = ParamsOff.Views.AddDefaulted_GetRef();
+    View.Viewpoint = FVector(3.0f * SphereRadius, 0.0f, 0.0f);
+    View.Resolution = 1e-3f;
+    ParamsOff.ScaleConversion = 1.0f;
+    FNexusErrorParams ParamsOn = ParamsOff;
+    ParamsOn.BackfaceFactor = BackfaceFactor;
+
+    TArray<uint32> NodeIDs;
+    for (int32 i = 0; i < NodesCount; i ++)
+    {
+        NodeIDs.Add(i);
+    }
+    TArray<float> ErrorsOff, ErrorsOn;
+    ErrorsOff.SetNumUninitialized(NodesCount);
+    ErrorsOn.SetNumUninitialized(NodesCount);
+    NexusErrorKernel::CalculateErrors(DAG.Table, ParamsOff, NodeIDs.GetData(), NodesCount, false, ErrorsOff.GetData());
+    NexusErrorKernel::CalculateErrors(DAG.Table, ParamsOn, NodeIDs.GetData(), NodesCount, false, ErrorsOn.GetData());
+
+    int32 Backfacing = 0;
+    int32 WrongSide = 0;
+    int32 NotLowered = 0;
+    int32 Changed = 0;
+    for (int32 i = 0; i < NodesCount; i ++)
+    {
+        const FVector Center(DAG.Table.CenterX[i], DAG.Table.CenterY[i], DAG.Table.CenterZ[i]);
+        if (NexusErrorKernel::IsBackfacing(DAG.Table, View.Viewpoint, i))
+        {
+            Backfacing ++;
+            // A node facing away can only be on the far side of the sphere, beyond its horizon
+            if ((Center | View.Viewpoint) > SphereRadius * SphereRadius)
+            {
+                WrongSide ++;
+            }
+            if (!FMath::IsNearlyEqual(ErrorsOn[i], ErrorsOff[i] / (BackfaceFactor + 1.0f), ErrorsOff[i] * 1e-4f))
+            {
+                NotLowered ++;
+            }
+        }
+        else if (!FMath::IsNearlyEqual(ErrorsOn[i], ErrorsOff[i], ErrorsOff[i] * 1e-4f))
+        {
+            Changed ++;
+        }
+    }
+    TestTrue(TEXT("Some nodes of the far side face away from the viewpoint"), Backfacing > 0);
+    TestEqual(TEXT("Only the far side faces away from the viewpoint"), WrongSide, 0);
+    TestEqual(TEXT("The cone test lowers the errors of the far side nodes"), NotLowered, 0);
+    TestEqual(TEXT("The cone test leaves the other nodes alone"), Changed, 0);
+
+    const FTraversalStats StatsOff = Traverse(DAG, ParamsOff);
+    const FTraversalStats StatsOn = Traverse(DAG, ParamsOn);
+    TestTrue(TEXT("The traversal visits fewer nodes with the cone test"), StatsOn.Visited < StatsOff.Visited);
+    TestTrue(TEXT("The traversal culls nodes with the cone test"), StatsOn.Culled > 0);
+
+    AddInfo(FString::Printf(TEXT("Sphere of %d nodes, %d of them facing away: cone test off %d visited, %d refined; on %d visited, %d refined, %d culled"),
+        NodesCount, Backfacing, StatsOff.Visited, StatsOff.Selected, StatsOn.Visited, StatsOn.Selected, StatsOn.Culled));
+    return true;
+}
+
+#endif
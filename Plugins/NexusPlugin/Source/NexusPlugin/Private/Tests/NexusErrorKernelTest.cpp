@@ -0,0 +1,110 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "NexusNodeTable.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusErrorKernelTest
+{
+    void BuildRandomTable(FRandomStream& Random, const int32 NodesCount, FNexusNodeTable& OutTable)
+    {
+        for (int32 i = 0; i < NodesCount; i ++)
+        {
+            OutTable.CenterX.Add(Random.FRandRange(-1000.0f, 1000.0f));
+            OutTable.CenterY.Add(Random.FRandRange(-1000.0f, 1000.0f));
+            OutTable.CenterZ.Add(Random.FRandRange(-1000.0f, 1000.0f));
+            const float Radius = Random.FRandRange(1.0f, 200.0f);
+            OutTable.Radius.Add(Radius);
+            OutTable.TightRadius.Add(Radius * Random.FRandRange(0.3f, 1.0f));
+            OutTable.Error.Add(Random.FRandRange(0.1f, 50.0f));
+
+            // A fourth of the nodes have no cone, like the ones the importer couldn't bound
+            const FVector Axis = Random.GetUnitVector();
+            const bool bHasCone = Random.FRand() < 0.75f;
+            OutTable.ConeX.Add(Axis.X);
+            OutTable.ConeY.Add(Axis.Y);
+            OutTable.ConeZ.Add(Axis.Z);
+            OutTable.ConeSin.Add(bHasCone ? Random.FRand() : 2.0f);
+        }
+    }
+
+    FNexusErrorView MakeRandomView(FRandomStream& Random, const int32 PlanesCount)
+    {
+        FNexusErrorView View;
+        View.Viewpoint = FVector(Random.FRandRange(-1500.0f, 1500.0f), Random.FRandRange(-1500.0f, 1500.0f), Random.FRandRange(-1500.0f, 1500.0f));
+        View.Resolution = Random.FRandRange(1e-4f, 1e-2f);
+        for (int32 i = 0; i < PlanesCount; i ++)
+        {
+            View.Planes.Add(FPlane(Random.GetUnitVector(), Random.FRandRange(-500.0f, 500.0f)));
+        }
+        return View;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusErrorKernelTest, "Nexus.Traversal.ErrorKernel",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNexusErrorKernelTest::RunTest(const FString& Parameters)
+{
+    using namespace NexusErrorKernelTest;
+    FRandomStream Random(0x4e58);
+    FNexusNodeTable Table;
+    BuildRandomTable(Random, 257, Table);
+
+    // Batch sizes covering the tails of fewer than 4 nodes, whole batches and both together
+    const int32 BatchSizes[] = { 1, 2, 3, 4, 5, 7, 8, 64, 257 };
+    const int32 ViewCounts[] = { 1, 2, 3 };
+    const float BackfaceFactors[] = { 0.0f, 3.0f };
+    int32 Mismatches = 0;
+    int32 Evaluated = 0;
+    for (int32 Round = 0; Round < 16; Round ++)
+    {
+        for (const int32 ViewsCount : ViewCounts)
+        {
+            for (const float BackfaceFactor : BackfaceFactors)
+            {
+                FNexusErrorParams Params;
+                for (int32 i = 0; i < ViewsCount; i ++)
+                {
+                    // Views without planes stand for the cameras whose frustum isn't tested
+                    Params.Views.Add(MakeRandomView(Random, i == 2 ? 0 : 6));
+                }
+                Params.OuterNodeFactor = Random.FRandRange(0.0f, 10.0f);
+                Params.BackfaceFactor = BackfaceFactor;
+                Params.ScaleConversion = Random.FRandRange(0.5f, 2.0f);
+
+                for (const int32 BatchSize : BatchSizes)
+                {
+                    // Random IDs, repeated ones included, in the order the traversal would ask for them
+                    TArray<uint32> NodeIDs;
+                    for (int32 i = 0; i < BatchSize; i ++)
+                    {
+                        NodeIDs.Add(Random.RandRange(0, Table.Num() - 1));
+                    }
+                    for (const bool bUseTight : { false, true })
+                    {
+                        TArray<float> Errors;
+                        Errors.SetNumZeroed(BatchSize);
+                        NexusErrorKernel::CalculateErrors(Table, Params, NodeIDs.GetData(), NodeIDs.Num(), bUseTight, Errors.GetData());
+                        for (int32 i = 0; i < BatchSize; i ++)
+                        {
+                            const float ReferenceError = NexusErrorKernel::CalculateError(Table, Params, NodeIDs[i], bUseTight);
+                            Evaluated ++;
+                            if (FMath::IsNearlyEqual(Errors[i], ReferenceError, FMath::Abs(ReferenceError) * 1e-4f + KINDA_SMALL_NUMBER)) continue;
+                            if (Mismatches ++ < 8)
+                            {
+                                AddError(FString::Printf(TEXT("Node %d of a batch of %d, %d views, backface factor %.1f, tight %d: %f, expected %f"),
+                                    NodeIDs[i], BatchSize, ViewsCount, BackfaceFactor, bUseTight, Errors[i], ReferenceError));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    TestEqual(TEXT("Kernel errors that differ from the scalar reference"), Mismatches, 0);
+    AddInfo(FString::Printf(TEXT("Compared %d node errors"), Evaluated));
+    return true;
+}
+
+#endif
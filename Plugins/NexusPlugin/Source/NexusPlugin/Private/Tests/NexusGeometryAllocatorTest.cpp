@@ -0,0 +1,98 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "NexusGeometryPool.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusRangeAllocatorTest, "Nexus.GeometryPool.RangeAllocator",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNexusRangeAllocatorTest::RunTest(const FString& Parameters)
+{
+    FNexusRangeAllocator Allocator;
+    Allocator.Init(100);
+    uint32 A = 0, B = 0, C = 0, D = 0;
+    TestTrue(TEXT("Allocates from an empty range"), Allocator.Allocate(30, A));
+    TestTrue(TEXT("Allocates the second range"), Allocator.Allocate(20, B));
+    TestTrue(TEXT("Allocates the third range"), Allocator.Allocate(40, C));
+    TestEqual(TEXT("Ranges are handed out in order"), A, 0u);
+    TestEqual(TEXT("Ranges are handed out in order"), B, 30u);
+    TestEqual(TEXT("Ranges are handed out in order"), C, 50u);
+    TestEqual(TEXT("Used size"), Allocator.GetUsed(), 90u);
+    TestFalse(TEXT("Doesn't allocate past the capacity"), Allocator.Allocate(11, D));
+
+    // Free ranges of 20 at 30 and of 10 at 90, the best fit for 10 is the tail
+    Allocator.Free(B, 20);
+    TestTrue(TEXT("Allocates in a hole"), Allocator.Allocate(10, D));
+    TestEqual(TEXT("Best fit picks the smallest hole"), D, 90u);
+    Allocator.Free(D, 10);
+
+    // Freeing A merges it with the hole at 30, the merged range fits 50
+    Allocator.Free(A, 30);
+    TestTrue(TEXT("Neighbouring free ranges are merged"), Allocator.Allocate(50, D));
+    TestEqual(TEXT("The merged range starts at the first one"), D, 0u);
+    Allocator.Free(D, 50);
+
+    // Freeing the range in between merges with both neighbours
+    Allocator.Free(C, 40);
+    TestTrue(TEXT("Empty once everything is freed"), Allocator.IsEmpty());
+    TestTrue(TEXT("The whole capacity is one range again"), Allocator.Allocate(100, D));
+    TestEqual(TEXT("The whole capacity starts at 0"), D, 0u);
+
+    uint32 Zero = 123;
+    TestTrue(TEXT("Empty ranges always succeed"), Allocator.Allocate(0, Zero));
+    TestEqual(TEXT("Empty ranges don't take space"), Allocator.GetUsed(), 100u);
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusGeometryAllocatorTest, "Nexus.GeometryPool.GeometryAllocator",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNexusGeometryAllocatorTest::RunTest(const FString& Parameters)
+{
+    // Nodes of a third of a page, so that three of them fill it
+    const uint32 PageVertices = NexusGeometryPool::GetPageVertexCapacity(1);
+    const uint32 NodeVertices = PageVertices / 3;
+    const uint32 NodeIndices = NodeVertices * 2;
+
+    FNexusGeometryAllocator Allocator;
+    FNexusGeometryAllocation Nodes[4];
+    bool bCreatedPage = false;
+    TestTrue(TEXT("The first node opens a page"), Allocator.Allocate(NodeVertices, NodeIndices, Nodes[0], bCreatedPage) && bCreatedPage);
+    TestTrue(TEXT("The second node fits the first page"), Allocator.Allocate(NodeVertices, NodeIndices, Nodes[1], bCreatedPage) && !bCreatedPage);
+    TestTrue(TEXT("The third node fits the first page"), Allocator.Allocate(NodeVertices, NodeIndices, Nodes[2], bCreatedPage) && !bCreatedPage);
+    TestTrue(TEXT("The fourth node opens a page"), Allocator.Allocate(NodeVertices, NodeIndices, Nodes[3], bCreatedPage) && bCreatedPage);
+    TestEqual(TEXT("The fourth node is on the second page"), Nodes[3].Page, 1);
+    TestEqual(TEXT("Two pages are open"), Allocator.GetPagesCount(), 2);
+
+    // The second page holds a third of its capacity, the first one is full
+    TestEqual(TEXT("The second page is the sparse one"), Allocator.FindSparsePage(0.5f), 1);
+    TestEqual(TEXT("No page is below 25%"), Allocator.FindSparsePage(0.25f), INDEX_NONE);
+
+    // The compaction never opens a page nor fills the excluded one
+    FNexusGeometryAllocation Moved;
+    TestFalse(TEXT("Nothing fits the full page"), Allocator.AllocateInUsedPages(NodeVertices, NodeIndices, Moved, 1));
+    TestEqual(TEXT("No page was opened by the compaction"), Allocator.GetPagesCount(), 2);
+
+    Allocator.Free(Nodes[0]);
+    TestTrue(TEXT("A freed range in a used page is reused"), Allocator.AllocateInUsedPages(NodeVertices, NodeIndices, Moved, 1));
+    TestEqual(TEXT("The node moves to the first page"), Moved.Page, 0);
+    Allocator.Free(Nodes[3]);
+    TestTrue(TEXT("The second page is empty"), Allocator.GetPage(1).Vertices.IsEmpty());
+
+    // The empty page is kept open, but the compaction must not move nodes into it
+    TestEqual(TEXT("The kept empty page isn't closed"), Allocator.CloseEmptyPages(1).Num(), 0);
+    Allocator.Free(Moved);
+    TestFalse(TEXT("Empty pages aren't compaction targets"), Allocator.AllocateInUsedPages(NodeVertices * 2, NodeIndices * 2, Moved, 0));
+    TestTrue(TEXT("Loads still use the empty page"), Allocator.Allocate(NodeVertices * 2, NodeIndices * 2, Moved, bCreatedPage) && !bCreatedPage);
+    TestEqual(TEXT("The load went to the empty page"), Moved.Page, 1);
+    Allocator.Free(Moved);
+
+    const TArray<int32> ClosedPages = Allocator.CloseEmptyPages(0);
+    TestEqual(TEXT("Empty pages are closed"), ClosedPages.Num(), 1);
+    TestFalse(TEXT("The closed page isn't in use"), Allocator.GetPage(1).bInUse);
+    TestTrue(TEXT("A new page reuses the closed slot"), Allocator.Allocate(PageVertices, PageVertices, Moved, bCreatedPage) && bCreatedPage && Moved.Page == 1);
+    return true;
+}
+
+#endif
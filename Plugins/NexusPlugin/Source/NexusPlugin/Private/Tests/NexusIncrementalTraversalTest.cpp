@@ -0,0 +1,198 @@
+﻿#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+#include "UnrealNexusComponent.h"
+#include "UnrealNexusData.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusIncrementalTraversalTest
+{
+    // Binary DAG over a strip along X, node N has 2N + 1 and 2N + 2 as children and halves the span of its parent
+    constexpr int32 Depth = 16;
+    constexpr int32 NodesCount = (1 << Depth) - 1;
+    constexpr float StripLength = 100000.0f;
+    // Geometric error over the radius, the same at every level like a regularly simplified surface
+    constexpr float ErrorOverRadius = 0.05f;
+
+    constexpr float CameraHeight = 1000.0f;
+    constexpr float CameraResolution = 1e-2f;
+    // Fly, hover, creep and hover again, so that the path has frames of every kind
+    constexpr int32 SegmentFrames = 60;
+    constexpr int32 FramesCount = 4 * SegmentFrames;
+    constexpr float FlySpeed = 50.0f;
+    constexpr float CreepSpeed = 0.5f;
+
+    void BuildStripDAG(UUnrealNexusData* Data)
+    {
+        Data->Nodes.SetNum(NodesCount + 1);
+        for (int32 i = 0; i < NodesCount; i ++)
+        {
+            const int32 Level = FMath::FloorLog2(i + 1);
+            const int32 IndexInLevel = i + 1 - (1 << Level);
+            const float Span = StripLength / (1 << Level);
+            const float Radius = Span * 0.5f;
+
+            FUnrealNexusNode& TheNode = Data->Nodes[i];
+            FMemory::Memzero(TheNode.NexusNode);
+            // Nexus space, Y is up
+            TheNode.NexusNode.sphere = vcg::Sphere3f(vcg::Point3f(Span * IndexInLevel + Radius, 0.0f, 0.0f), Radius);
+            TheNode.NexusNode.tight_radius = Radius;
+            TheNode.NexusNode.error = Radius * ErrorOverRadius;
+            TheNode.NexusNode.nface = 128;
+            if (Level < Depth - 1)
+            {
+                TheNode.NodePatches.Add({ static_cast<uint32>(2 * i + 1), 64, 0 });
+                TheNode.NodePatches.Add({ static_cast<uint32>(2 * i + 2), 128, 0 });
+            }
+            else
+            {
+                TheNode.NodePatches.Add({ static_cast<uint32>(NodesCount), 128, 0 });
+            }
+        }
+        FMemory::Memzero(Data->Nodes[NodesCount].NexusNode);
+        Data->Header.n_nodes = NodesCount + 1;
+        Data->RootsCount = 1;
+        Data->GetNodeTable();
+    }
+
+    float GetCameraX(const int32 Frame)
+    {
+        const float Flown = FlySpeed * FMath::Min(Frame, SegmentFrames);
+        const float Crept = CreepSpeed * FMath::Clamp(Frame - 2 * SegmentFrames, 0, SegmentFrames);
+        return StripLength * 0.25f + Flown + Crept;
+    }
+
+    FNexusErrorParams MakeErrorParams(const int32 Frame)
+    {
+        FNexusErrorParams Params;
+        FNexusErrorView& View = Params.Views.AddDefaulted_GetRef();
+        // Unreal space, Z is up
+        View.Viewpoint = FVector(GetCameraX(Frame), 0.0f, CameraHeight);
+        View.Resolution = CameraResolution;
+        Params.ScaleConversion = 1.0f;
+        return Params;
+    }
+
+    bool HaveSameViews(const FNexusErrorParams& A, const FNexusErrorParams& B)
+    {
+        if (A.Views.Num() != B.Views.Num()) return false;
+        for (int32 i = 0; i < A.Views.Num(); i ++)
+        {
+            if (!A.Views[i].Equals(B.Views[i])) return false;
+        }
+        return true;
+    }
+
+    struct FReplayResult
+    {
+        int32 FullTraversals = 0;
+        int32 ReusedCuts = 0;
+        int32 SkippedTraversals = 0;
+        double Seconds = 0.0;
+        TArray<uint32> LastCut;
+    };
+
+    // Mirrors what TickComponent does with the cut published every frame, without the proxy and the worker:
+    // skip while nothing changed, otherwise hand the previous decisions over when the cut can be reused
+    FReplayResult ReplayCameraPath(const UUnrealNexusComponent* Component, const IConsoleVariable* IncrementalTraversal)
+    {
+        FReplayResult Result;
+        FTraversalData TraversalBuffers[2];
+        for (FTraversalData& TraversalData : TraversalBuffers)
+        {
+            TraversalData.Init(NodesCount + 1);
+        }
+        int32 FrontTraversal = 0;
+        bool bHasPublishedTraversal = false;
+
+        const double Start = FPlatformTime::Seconds();
+        for (int32 Frame = 0; Frame < FramesCount; Frame ++)
+        {
+            const bool bIncremental = IncrementalTraversal->GetInt() != 0;
+            const FNexusErrorParams ErrorParams = MakeErrorParams(Frame);
+            const FTraversalData& Published = TraversalBuffers[FrontTraversal];
+            if (bIncremental && bHasPublishedTraversal && HaveSameViews(Published.Inputs.ErrorParams, ErrorParams))
+            {
+                Result.SkippedTraversals ++;
+                continue;
+            }
+
+            FTraversalData& TraversalData = TraversalBuffers[1 - FrontTraversal];
+            FTraversalInputs& Inputs = TraversalData.Inputs;
+            Inputs.ErrorParams = ErrorParams;
+            Inputs.TargetError = Component->TargetError;
+            Inputs.MaxBlockedNodes = Component->MaxBlockedNodes;
+            // Everything resident, so that the cut only depends on the camera
+            Inputs.NodeStatuses.Init(ENodeStatus::Loaded, NodesCount + 1);
+            if (bIncremental && bHasPublishedTraversal)
+            {
+                Inputs.PreviousDecisions = Published.Decisions;
+            }
+            else
+            {
+                Inputs.PreviousDecisions.Reset();
+            }
+
+            Component->DoTraversal(TraversalData);
+            if (TraversalData.bReusedPreviousCut)
+            {
+                Result.ReusedCuts ++;
+            }
+            else
+            {
+                Result.FullTraversals ++;
+            }
+            FrontTraversal = 1 - FrontTraversal;
+            bHasPublishedTraversal = true;
+        }
+        Result.Seconds = FPlatformTime::Seconds() - Start;
+
+        Result.LastCut = TraversalBuffers[FrontTraversal].SelectedNodes;
+        Result.LastCut.Sort();
+        return Result;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusIncrementalTraversalBenchmark, "Nexus.Traversal.IncrementalTraversalBenchmark",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+
+bool FNexusIncrementalTraversalBenchmark::RunTest(const FString& Parameters)
+{
+    using namespace NexusIncrementalTraversalTest;
+    IConsoleVariable* IncrementalTraversal = IConsoleManager::Get().FindConsoleVariable(TEXT("nexus.IncrementalTraversal"));
+    if (!TestNotNull(TEXT("nexus.IncrementalTraversal exists"), IncrementalTraversal)) return false;
+    const int32 PreviousValue = IncrementalTraversal->GetInt();
+
+    UUnrealNexusData* Data = NewObject<UUnrealNexusData>();
+    BuildStripDAG(Data);
+    UUnrealNexusComponent* Component = NewObject<UUnrealNexusComponent>();
+    Component->NexusLoadedAsset = Data;
+
+    FReplayResult Results[2];
+    for (int32 Incremental = 0; Incremental < 2; Incremental ++)
+    {
+        IncrementalTraversal->Set(Incremental, ECVF_SetByCode);
+        Results[Incremental] = ReplayCameraPath(Component, IncrementalTraversal);
+    }
+    IncrementalTraversal->Set(PreviousValue, ECVF_SetByCode);
+    Component->NexusLoadedAsset = nullptr;
+
+    const FReplayResult& Full = Results[0];
+    const FReplayResult& Incremental = Results[1];
+    TestEqual(TEXT("Without the incremental traversal every frame is traversed from scratch"), Full.FullTraversals, FramesCount);
+    TestEqual(TEXT("Every frame is either traversed, reused or skipped"), Incremental.FullTraversals + Incremental.ReusedCuts + Incremental.SkippedTraversals, FramesCount);
+    TestTrue(TEXT("The hovering frames are skipped"), Incremental.SkippedTraversals >= 2 * (SegmentFrames - 1));
+    TestTrue(TEXT("Some of the creeping frames reuse the previous cut"), Incremental.ReusedCuts > 0);
+    TestTrue(TEXT("Both variants end up with the same cut"), Incremental.LastCut == Full.LastCut);
+
+    for (int32 Mode = 0; Mode < 2; Mode ++)
+    {
+        const FReplayResult& Result = Results[Mode];
+        AddInfo(FString::Printf(TEXT("nexus.IncrementalTraversal %d: %d frames over %d nodes, %d full traversals, %d reused cuts, %d skipped, %.3f ms/frame, %d nodes in the last cut"),
+            Mode, FramesCount, NodesCount, Result.FullTraversals, Result.ReusedCuts, Result.SkippedTraversals, Result.Seconds * 1000.0 / FramesCount, Result.LastCut.Num()));
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,132 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "NexusCustomVersion.h"
+#include "UnrealNexusNodeData.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusNodeSerializationTest
+{
+    // An uncompressed node about as big as the importer makes them: float positions and 16 bit indices
+    constexpr int32 VertsCount = 16384;
+    constexpr int32 FacesCount = 2 * VertsCount;
+    constexpr int32 PayloadSize = VertsCount * 3 * sizeof(float) + FacesCount * 3 * sizeof(uint16);
+    constexpr int32 RoundsCount = 32;
+
+    void MakePayload(TArray<uint8>& OutPayload)
+    {
+        FRandomStream Random(0x4e58);
+        OutPayload.SetNumUninitialized(PayloadSize);
+        float* Positions = reinterpret_cast<float*>(OutPayload.GetData());
+        for (int32 i = 0; i < VertsCount * 3; i ++)
+        {
+            Positions[i] = Random.FRandRange(-1000.0f, 1000.0f);
+        }
+        uint16* Indices = reinterpret_cast<uint16*>(Positions + VertsCount * 3);
+        for (int32 i = 0; i < FacesCount * 3; i ++)
+        {
+            Indices[i] = static_cast<uint16>(Random.RandHelper(VertsCount));
+        }
+    }
+
+    // What the importer wrote before FNexusCustomVersion::NodeDataAsBulkData, the reader is still in SerializeNodeData
+    void WriteLegacyNodeData(FArchive& Archive, const TArray<uint8>& Payload)
+    {
+        uint32 NodeSize = Payload.Num();
+        Archive << NodeSize;
+        for (const uint8 Byte : Payload)
+        {
+            uint16 Wide = Byte;
+            Archive << Wide;
+        }
+    }
+
+    struct FFormatTimes
+    {
+        double WriteSeconds = 0.0;
+        double ReadSeconds = 0.0;
+        double DecodeSeconds = 0.0;
+        int32 BytesOnDisk = 0;
+        int32 Mismatches = 0;
+    };
+
+    // Reads the node back from Bytes as an asset saved at Version would be, then decodes it
+    void LoadAndDecode(const TArray<uint8>& Bytes, const int32 Version, const TArray<uint8>& Payload, FFormatTimes& Times)
+    {
+        // Bulk data is skipped by the archives that aren't persistent
+        FMemoryReader Reader(Bytes, true);
+        Reader.SetCustomVersion(FNexusCustomVersion::GUID, Version, TEXT("NexusVer"));
+        UUnrealNexusNodeData* NodeData = NewObject<UUnrealNexusNodeData>();
+        const double ReadStart = FPlatformTime::Seconds();
+        NodeData->SerializeNodeData(Reader);
+        Times.ReadSeconds += FPlatformTime::Seconds() - ReadStart;
+
+        nx::Header Header;
+        const double DecodeStart = FPlatformTime::Seconds();
+        NodeData->DecodeData(Header, VertsCount, FacesCount);
+        Times.DecodeSeconds += FPlatformTime::Seconds() - DecodeStart;
+
+        const bool bSamePayload = NodeData->NodeSize == static_cast<uint32>(Payload.Num()) &&
+            FMemory::Memcmp(NodeData->GetNodeData().memory, Payload.GetData(), Payload.Num()) == 0;
+        if (!bSamePayload)
+        {
+            Times.Mismatches ++;
+        }
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusNodeSerializationBenchmark, "Nexus.Loading.NodeSerializationBenchmark",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+
+bool FNexusNodeSerializationBenchmark::RunTest(const FString& Parameters)
+{
+    using namespace NexusNodeSerializationTest;
+    TArray<uint8> Payload;
+    MakePayload(Payload);
+
+    FFormatTimes Legacy;
+    for (int32 Round = 0; Round < RoundsCount; Round ++)
+    {
+        TArray<uint8> Bytes;
+        FMemoryWriter Writer(Bytes, true);
+        const double WriteStart = FPlatformTime::Seconds();
+        WriteLegacyNodeData(Writer, Payload);
+        Legacy.WriteSeconds += FPlatformTime::Seconds() - WriteStart;
+        Legacy.BytesOnDisk = Bytes.Num();
+        LoadAndDecode(Bytes, FNexusCustomVersion::BeforeCustomVersionWasAdded, Payload, Legacy);
+    }
+
+    FFormatTimes BulkData;
+    UUnrealNexusNodeData* Source = NewObject<UUnrealNexusNodeData>();
+    Source->SetNodePayload(Payload.GetData(), Payload.Num());
+    for (int32 Round = 0; Round < RoundsCount; Round ++)
+    {
+        TArray<uint8> Bytes;
+        FMemoryWriter Writer(Bytes, true);
+        Writer.SetCustomVersion(FNexusCustomVersion::GUID, FNexusCustomVersion::LatestVersion, TEXT("NexusVer"));
+        const double WriteStart = FPlatformTime::Seconds();
+        Source->SerializeNodeData(Writer);
+        BulkData.WriteSeconds += FPlatformTime::Seconds() - WriteStart;
+        BulkData.BytesOnDisk = Bytes.Num();
+        LoadAndDecode(Bytes, FNexusCustomVersion::LatestVersion, Payload, BulkData);
+    }
+
+    TestEqual(TEXT("Legacy payloads decode to the original bytes"), Legacy.Mismatches, 0);
+    TestEqual(TEXT("Bulk data payloads decode to the original bytes"), BulkData.Mismatches, 0);
+    TestTrue(TEXT("Bulk data payloads are smaller"), BulkData.BytesOnDisk < Legacy.BytesOnDisk);
+
+    const auto Report = [this](const TCHAR* Format, const FFormatTimes& Times)
+    {
+        AddInfo(FString::Printf(TEXT("%s: %d bytes, write %.3f ms, read %.3f ms, round trip %.3f ms, decode %.3f ms per node"),
+            Format, Times.BytesOnDisk, Times.WriteSeconds * 1000.0 / RoundsCount, Times.ReadSeconds * 1000.0 / RoundsCount,
+            (Times.WriteSeconds + Times.ReadSeconds) * 1000.0 / RoundsCount, Times.DecodeSeconds * 1000.0 / RoundsCount));
+    };
+    AddInfo(FString::Printf(TEXT("%d rounds of a %d bytes payload"), RoundsCount, PayloadSize));
+    Report(TEXT("Legacy uint16 per byte"), Legacy);
+    Report(TEXT("FByteBulkData"), BulkData);
+    return true;
+}
+
+#endif
@@ -0,0 +1,186 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "NexusOcclusionBuffer.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusOcclusionBufferTest
+{
+    // Camera at the origin looking down +X with a 90 degrees field of view, W is the distance along X
+    FMatrix MakeModelToClip()
+    {
+        return FMatrix(
+            FPlane(0.0f, 0.0f, 0.0f, 1.0f),
+            FPlane(1.0f, 0.0f, 0.0f, 0.0f),
+            FPlane(0.0f, 1.0f, 0.0f, 0.0f),
+            FPlane(0.0f, 0.0f, 0.0f, 0.0f));
+    }
+
+    // Quad facing the camera at Depth, covering [MinY, MaxY] x [MinZ, MaxZ]
+    FNexusOccluder MakeQuad(const float Depth, const float MinY, const float MaxY, const float MinZ, const float MaxZ)
+    {
+        const TSharedRef<FNexusOccluderMesh, ESPMode::ThreadSafe> Mesh = MakeShared<FNexusOccluderMesh, ESPMode::ThreadSafe>();
+        Mesh->Positions = { FVector(Depth, MinY, MinZ), FVector(Depth, MaxY, MinZ), FVector(Depth, MaxY, MaxZ), FVector(Depth, MinY, MaxZ) };
+        Mesh->Indices = { 0, 1, 2, 0, 2, 3 };
+        FNexusOccluder Occluder;
+        Occluder.Mesh = Mesh;
+        Occluder.TriangleRanges.Add({ 0, 2 });
+        return Occluder;
+    }
+
+    // Same projection as the buffer
+    FVector4 ProjectReference(const FVector& Position)
+    {
+        const double InvW = 1.0 / Position.X;
+        return FVector4((Position.Y * InvW * 0.5 + 0.5) * FNexusOcclusionBuffer::Width,
+            (0.5 - Position.Z * InvW * 0.5) * FNexusOcclusionBuffer::Height, 0.0f, InvW);
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusOcclusionQueriesTest, "Nexus.OcclusionBuffer.Queries",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNexusOcclusionQueriesTest::RunTest(const FString& Parameters)
+{
+    using namespace NexusOcclusionBufferTest;
+    FNexusOcclusionBuffer Buffer;
+
+    Buffer.Clear(MakeModelToClip());
+    TestTrue(TEXT("A cleared buffer is empty"), Buffer.IsEmpty());
+    TestFalse(TEXT("An empty buffer occludes nothing"), Buffer.IsSphereOccluded(FVector(1000.0f, 0.0f, 0.0f), 10.0f));
+    Buffer.Rasterize(MakeQuad(-100.0f, -1000.0f, 1000.0f, -1000.0f, 1000.0f));
+    TestFalse(TEXT("An occluder behind the camera occludes nothing"), Buffer.IsSphereOccluded(FVector(1000.0f, 0.0f, 0.0f), 10.0f));
+
+    // Covers the middle of the screen, from 64 to 192 horizontally and from 32 to 96 vertically
+    Buffer.Clear(MakeModelToClip());
+    TestEqual(TEXT("Both triangles of the quad are rasterized"), Buffer.Rasterize(MakeQuad(100.0f, -50.0f, 50.0f, -50.0f, 50.0f)), 2);
+    TestFalse(TEXT("The buffer isn't empty once something is rasterized"), Buffer.IsEmpty());
+    TestTrue(TEXT("A quad hides the sphere behind it"), Buffer.IsSphereOccluded(FVector(1000.0f, 0.0f, 0.0f), 50.0f));
+    TestFalse(TEXT("A sphere in front of the quad is visible"), Buffer.IsSphereOccluded(FVector(50.0f, 0.0f, 0.0f), 5.0f));
+    TestFalse(TEXT("A sphere wider than the quad is visible"), Buffer.IsSphereOccluded(FVector(1000.0f, 0.0f, 0.0f), 400.0f));
+    TestFalse(TEXT("A sphere beside the quad is visible"), Buffer.IsSphereOccluded(FVector(1000.0f, 700.0f, 0.0f), 50.0f));
+    TestFalse(TEXT("A sphere intersecting the quad is visible"), Buffer.IsSphereOccluded(FVector(100.0f, 0.0f, 0.0f), 10.0f));
+
+    // Whatever is in front, a sphere crossing the near plane can't be projected
+    Buffer.Clear(MakeModelToClip());
+    Buffer.Rasterize(MakeQuad(100.0f, -1000.0f, 1000.0f, -1000.0f, 1000.0f));
+    TestTrue(TEXT("The full screen quad hides what's behind it"), Buffer.IsSphereOccluded(FVector(1000.0f, 0.0f, 0.0f), 10.0f));
+    TestFalse(TEXT("A sphere crossing the near plane is never occluded"), Buffer.IsSphereOccluded(FVector(0.5f, 0.0f, 0.0f), 2.0f));
+    TestFalse(TEXT("A sphere around the camera is never occluded"), Buffer.IsSphereOccluded(FVector::ZeroVector, 1000.0f));
+    TestFalse(TEXT("A sphere behind the camera is never occluded"), Buffer.IsSphereOccluded(FVector(-1000.0f, 0.0f, 0.0f), 10.0f));
+
+    // The quad covers the right half of the screen and goes well past its right edge
+    Buffer.Clear(MakeModelToClip());
+    Buffer.Rasterize(MakeQuad(100.0f, 0.0f, 1000.0f, -1000.0f, 1000.0f));
+    TestTrue(TEXT("The part of the quad on screen is rasterized"), Buffer.GetInvDepth(FNexusOcclusionBuffer::Width - 1, FNexusOcclusionBuffer::Height / 2) > 0.0f);
+    TestEqual(TEXT("The left half is left untouched"), Buffer.GetInvDepth(0, FNexusOcclusionBuffer::Height / 2), 0.0f);
+    TestTrue(TEXT("A sphere in the right half is occluded"), Buffer.IsSphereOccluded(FVector(500.0f, 300.0f, 0.0f), 10.0f));
+    TestTrue(TEXT("Only the part of a sphere on screen is tested"), Buffer.IsSphereOccluded(FVector(500.0f, 500.0f, 0.0f), 20.0f));
+    TestFalse(TEXT("A sphere out of the screen isn't occluded"), Buffer.IsSphereOccluded(FVector(500.0f, 800.0f, 0.0f), 10.0f));
+    TestFalse(TEXT("A sphere in the left half is visible"), Buffer.IsSphereOccluded(FVector(500.0f, -300.0f, 0.0f), 10.0f));
+    TestFalse(TEXT("A sphere across the left edge is visible"), Buffer.IsSphereOccluded(FVector(500.0f, -500.0f, 0.0f), 20.0f));
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusOcclusionRasterizerTest, "Nexus.OcclusionBuffer.Rasterizer",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FNexusOcclusionRasterizerTest::RunTest(const FString& Parameters)
+{
+    using namespace NexusOcclusionBufferTest;
+    constexpr int32 Width = FNexusOcclusionBuffer::Width;
+    constexpr int32 Height = FNexusOcclusionBuffer::Height;
+    constexpr int32 TrianglesCount = 64;
+    // Pixel centers closer than this to an edge, in pixels, may land on either side of it
+    constexpr double EdgeTolerance = 1e-2;
+
+    FRandomStream Random(0x4f43);
+    const TSharedRef<FNexusOccluderMesh, ESPMode::ThreadSafe> Mesh = MakeShared<FNexusOccluderMesh, ESPMode::ThreadSafe>();
+    for (int32 Triangle = 0; Triangle < TrianglesCount; Triangle ++)
+    {
+        // Roughly equilateral on screen, slivers would test the float precision rather than the rasterizer.
+        // Some are partly off the screen, so that the clamped bounds are covered too
+        const float Depth = Random.FRandRange(50.0f, 500.0f);
+        const FVector2D Center(Random.FRandRange(-1.2f, 1.2f), Random.FRandRange(-1.2f, 1.2f));
+        const float Radius = Random.FRandRange(0.05f, 0.6f);
+        const float Angle = Random.FRandRange(0.0f, 2.0f * PI);
+        for (int32 Vertex = 0; Vertex < 3; Vertex ++)
+        {
+            const float VertexAngle = Angle + Vertex * 2.0f * PI / 3.0f + Random.FRandRange(-0.3f, 0.3f);
+            const float VertexDepth = Depth * Random.FRandRange(0.8f, 1.25f);
+            const FVector2D Screen = Center + Radius * FVector2D(FMath::Cos(VertexAngle), FMath::Sin(VertexAngle));
+            Mesh->Indices.Add(static_cast<uint16>(Mesh->Positions.Add(FVector(VertexDepth, Screen.X * VertexDepth, Screen.Y * VertexDepth))));
+        }
+    }
+    FNexusOccluder Occluder;
+    Occluder.Mesh = Mesh;
+    Occluder.TriangleRanges.Add({ 0, TrianglesCount });
+
+    FNexusOcclusionBuffer Buffer;
+    Buffer.Clear(MakeModelToClip());
+    Buffer.Rasterize(Occluder);
+
+    // One pixel at a time, every triangle over the whole screen
+    TArray<double> Reference;
+    TArray<bool> Ambiguous;
+    Reference.SetNumZeroed(Width * Height);
+    Ambiguous.SetNumZeroed(Width * Height);
+    for (int32 Triangle = 0; Triangle < TrianglesCount; Triangle ++)
+    {
+        const FVector4 A = ProjectReference(Mesh->Positions[Triangle * 3]);
+        const FVector4 B = ProjectReference(Mesh->Positions[Triangle * 3 + 1]);
+        const FVector4 C = ProjectReference(Mesh->Positions[Triangle * 3 + 2]);
+        const double Area = (static_cast<double>(B.X) - A.X) * (static_cast<double>(C.Y) - A.Y) - (static_cast<double>(B.Y) - A.Y) * (static_cast<double>(C.X) - A.X);
+        if (FMath::Abs(Area) < KINDA_SMALL_NUMBER) continue;
+        const auto Edge = [Area](const FVector4& From, const FVector4& To, const double X, const double Y)
+        {
+            // Positive inside whatever the winding
+            return ((static_cast<double>(To.X) - From.X) * (Y - From.Y) - (static_cast<double>(To.Y) - From.Y) * (X - From.X)) * FMath::Sign(Area);
+        };
+        const auto Distance = [](const double Weight, const FVector4& From, const FVector4& To)
+        {
+            return FMath::Abs(Weight) / FMath::Sqrt(FMath::Square(static_cast<double>(To.X) - From.X) + FMath::Square(static_cast<double>(To.Y) - From.Y));
+        };
+        for (int32 Y = 0; Y < Height; Y ++)
+        {
+            for (int32 X = 0; X < Width; X ++)
+            {
+                const double PixelX = X + 0.5;
+                const double PixelY = Y + 0.5;
+                const double WeightA = Edge(B, C, PixelX, PixelY);
+                const double WeightB = Edge(C, A, PixelX, PixelY);
+                const double WeightC = Edge(A, B, PixelX, PixelY);
+                if (FMath::Min3(Distance(WeightA, B, C), Distance(WeightB, C, A), Distance(WeightC, A, B)) < EdgeTolerance)
+                {
+                    Ambiguous[Y * Width + X] = true;
+                }
+                if (WeightA < 0.0 || WeightB < 0.0 || WeightC < 0.0) continue;
+                const double InvDepth = (WeightA * A.W + WeightB * B.W + WeightC * C.W) / FMath::Abs(Area);
+                Reference[Y * Width + X] = FMath::Max(Reference[Y * Width + X], InvDepth);
+            }
+        }
+    }
+
+    int32 Mismatches = 0;
+    int32 Compared = 0;
+    for (int32 Y = 0; Y < Height; Y ++)
+    {
+        for (int32 X = 0; X < Width; X ++)
+        {
+            if (Ambiguous[Y * Width + X]) continue;
+            Compared ++;
+            const double Expected = Reference[Y * Width + X];
+            const float InvDepth = Buffer.GetInvDepth(X, Y);
+            if (FMath::Abs(InvDepth - Expected) <= Expected * 1e-3 + 1e-7) continue;
+            if (Mismatches ++ < 8)
+            {
+                AddError(FString::Printf(TEXT("Pixel %d, %d: %g, expected %g"), X, Y, InvDepth, Expected));
+            }
+        }
+    }
+    TestEqual(TEXT("Pixels that differ from the scalar reference"), Mismatches, 0);
+    AddInfo(FString::Printf(TEXT("Compared %d pixels"), Compared));
+    return true;
+}
+
+#endif
@@ -0,0 +1,118 @@
+﻿#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+#include "NexusGeometryPool.h"
+#include "dag.h"
+#include "nexusdata.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusTangentFramesTest
+{
+    // A wavy grid with positions, UVs and normals, about as many vertices as the importer puts in a node
+    constexpr int32 GridSize = 128;
+    constexpr int32 VertsCount = GridSize * GridSize;
+    constexpr int32 FacesCount = 2 * (GridSize - 1) * (GridSize - 1);
+    constexpr int32 RoundsCount = 64;
+
+    void MakeSignature(nx::Signature& OutSignature)
+    {
+        OutSignature.vertex.setComponent(nx::VertexElement::COORD, nx::Attribute(nx::Attribute::FLOAT, 3));
+        OutSignature.vertex.setComponent(nx::VertexElement::TEX, nx::Attribute(nx::Attribute::FLOAT, 2));
+        OutSignature.vertex.setComponent(nx::VertexElement::NORM, nx::Attribute(nx::Attribute::SHORT, 3));
+        OutSignature.face.setComponent(nx::FaceElement::INDEX, nx::Attribute(nx::Attribute::UNSIGNED_SHORT, 3));
+    }
+
+    // Lays the grid out like a decoded nexus node: positions, UVs, normals and then the indices
+    void MakeNodeData(nx::Signature& Signature, TArray<uint8>& OutMemory, nx::NodeData& OutData, nx::Node& OutNode)
+    {
+        FMemory::Memzero(OutNode);
+        OutNode.nvert = VertsCount;
+        OutNode.nface = FacesCount;
+        OutMemory.SetNumZeroed(VertsCount * Signature.vertex.size() + FacesCount * Signature.face.size());
+        OutData.memory = reinterpret_cast<char*>(OutMemory.GetData());
+
+        vcg::Point3f* Coords = OutData.coords();
+        vcg::Point2f* TexCoords = OutData.texCoords(Signature, VertsCount);
+        vcg::Point3s* Normals = OutData.normals(Signature, VertsCount);
+        for (int32 Y = 0; Y < GridSize; Y ++)
+        {
+            for (int32 X = 0; X < GridSize; X ++)
+            {
+                const int32 Index = Y * GridSize + X;
+                // Nexus space, Y is up
+                const float Height = 10.0f * FMath::Sin(X * 0.2f) * FMath::Cos(Y * 0.15f);
+                Coords[Index] = vcg::Point3f(X * 10.0f, Height, Y * 10.0f);
+                TexCoords[Index] = vcg::Point2f(static_cast<float>(X) / (GridSize - 1), static_cast<float>(Y) / (GridSize - 1));
+                const FVector Normal = FVector(-FMath::Cos(X * 0.2f) * FMath::Cos(Y * 0.15f) * 0.2f, 1.0f, FMath::Sin(X * 0.2f) * FMath::Sin(Y * 0.15f) * 0.15f).GetSafeNormal();
+                Normals[Index] = vcg::Point3s(static_cast<short>(Normal.X * 32767.0f), static_cast<short>(Normal.Y * 32767.0f), static_cast<short>(Normal.Z * 32767.0f));
+            }
+        }
+
+        uint16* Indices = OutData.faces(Signature, VertsCount);
+        for (int32 Y = 0; Y < GridSize - 1; Y ++)
+        {
+            for (int32 X = 0; X < GridSize - 1; X ++)
+            {
+                const uint16 Corner = static_cast<uint16>(Y * GridSize + X);
+                const uint16 Quad[6] = { Corner, static_cast<uint16>(Corner + GridSize), static_cast<uint16>(Corner + 1),
+                    static_cast<uint16>(Corner + 1), static_cast<uint16>(Corner + GridSize), static_cast<uint16>(Corner + GridSize + 1) };
+                FMemory::Memcpy(Indices, Quad, sizeof(Quad));
+                Indices += 6;
+            }
+        }
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusTangentFramesBenchmark, "Nexus.GeometryPool.TangentFramesBenchmark",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+
+bool FNexusTangentFramesBenchmark::RunTest(const FString& Parameters)
+{
+    using namespace NexusTangentFramesTest;
+    IConsoleVariable* UsePrecomputedTangents = IConsoleManager::Get().FindConsoleVariable(TEXT("nexus.UsePrecomputedTangents"));
+    if (!TestNotNull(TEXT("nexus.UsePrecomputedTangents exists"), UsePrecomputedTangents)) return false;
+    const int32 PreviousValue = UsePrecomputedTangents->GetInt();
+    UsePrecomputedTangents->Set(1, ECVF_SetByCode);
+
+    nx::Signature Signature;
+    MakeSignature(Signature);
+    TArray<uint8> NodeMemory;
+    nx::NodeData Data;
+    nx::Node Node;
+    MakeNodeData(Signature, NodeMemory, Data, Node);
+
+    const uint32 StreamsSize = NexusGeometryPool::GetStreamsSize(Signature, Node, false);
+    TArray<uint8, TAlignedHeapAllocator<16>> GeneratedMemory, CopiedMemory;
+    GeneratedMemory.SetNumZeroed(StreamsSize);
+    CopiedMemory.SetNumZeroed(StreamsSize);
+
+    // Without frames, like the nodes streamed from the container file and the assets imported before them
+    FNexusNodeStreams Generated;
+    const double GenerateStart = FPlatformTime::Seconds();
+    for (int32 Round = 0; Round < RoundsCount; Round ++)
+    {
+        Generated = NexusGeometryPool::WriteNodeStreams(Signature, Data, Node, GeneratedMemory.GetData(), false);
+    }
+    const double GenerateSeconds = FPlatformTime::Seconds() - GenerateStart;
+
+    // The generated frames stand for the ones computed at import, only the time to get them in place matters
+    TArray<FPackedNormal> TangentFrames(Generated.Tangents, VertsCount * 2);
+    FNexusNodeStreams Copied;
+    const double CopyStart = FPlatformTime::Seconds();
+    for (int32 Round = 0; Round < RoundsCount; Round ++)
+    {
+        Copied = NexusGeometryPool::WriteNodeStreams(Signature, Data, Node, CopiedMemory.GetData(), false, TangentFrames);
+    }
+    const double CopySeconds = FPlatformTime::Seconds() - CopyStart;
+    UsePrecomputedTangents->Set(PreviousValue, ECVF_SetByCode);
+
+    TestEqual(TEXT("Both variants write the same vertices"), Copied.VertexCount, Generated.VertexCount);
+    TestTrue(TEXT("Both variants write the same streams"), FMemory::Memcmp(CopiedMemory.GetData(), GeneratedMemory.GetData(), StreamsSize) == 0);
+
+    AddInfo(FString::Printf(TEXT("%d rounds of a node with %d vertices and %d faces: CalculateTangents %.3f ms/node, tangent frames copy %.3f ms/node"),
+        RoundsCount, VertsCount, FacesCount, GenerateSeconds * 1000.0 / RoundsCount, CopySeconds * 1000.0 / RoundsCount));
+    return true;
+}
+
+#endif
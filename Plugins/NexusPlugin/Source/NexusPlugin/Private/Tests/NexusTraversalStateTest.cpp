@@ -0,0 +1,99 @@
+﻿#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "UnrealNexusComponent.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace NexusTraversalStateTest
+{
+    // Binary DAG, node N has 2N + 1 and 2N + 2 as children, like a coarse to fine nexus
+    constexpr int32 NodesCount = 1 << 20;
+    constexpr int32 FramesCount = 64;
+    // Roughly what a traversal visits on a large model
+    constexpr int32 VisitedPerFrame = 8192;
+
+    // Every frame a different fifth of the children isn't refined, so that the cut moves
+    constexpr uint32 SkipPeriod = 5;
+    // Refined on the frame before the last one, skipped on the last one
+    constexpr uint32 DroppedNode = 2;
+    static_assert((DroppedNode + FramesCount - 1) % SkipPeriod == 0, "The last frame has to skip DroppedNode");
+
+    // Visits nodes breadth first until the budget is spent
+    template <typename FOnVisit>
+    void Traverse(const int32 Frame, TArray<uint32>& Queue, FOnVisit OnVisit)
+    {
+        Queue.Reset();
+        Queue.Add(0);
+        for (int32 Head = 0; Head < Queue.Num() && Head < VisitedPerFrame; Head ++)
+        {
+            const uint32 NodeID = Queue[Head];
+            OnVisit(NodeID);
+            for (uint32 Child = 2 * NodeID + 1; Child <= 2 * NodeID + 2 && Child < static_cast<uint32>(NodesCount); Child ++)
+            {
+                if ((Child + Frame) % SkipPeriod == 0) continue;
+                Queue.Add(Child);
+            }
+        }
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FNexusTraversalStateBenchmark, "Nexus.Traversal.GenerationStampsBenchmark",
+    EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+
+bool FNexusTraversalStateBenchmark::RunTest(const FString& Parameters)
+{
+    using namespace NexusTraversalStateTest;
+    TArray<uint32> Queue;
+    Queue.Reserve(2 * VisitedPerFrame + 1);
+
+    // What every traversal used to do: fresh sets and an error per node of the DAG
+    uint64 HashedSelected = 0;
+    const double HashStart = FPlatformTime::Seconds();
+    for (int32 Frame = 0; Frame < FramesCount; Frame ++)
+    {
+        TSet<uint32> Visited, Blocked, Selected;
+        TArray<float> Errors;
+        Errors.SetNum(NodesCount);
+        FMemory::Memzero(Errors.GetData(), Errors.Num() * sizeof(float));
+        Traverse(Frame, Queue, [&](const uint32 NodeID)
+        {
+            Visited.Add(NodeID);
+            Errors[NodeID] = static_cast<float>(NodeID);
+            if (NodeID & 1) Selected.Add(NodeID);
+        });
+        HashedSelected += Selected.Num() + Blocked.Num();
+    }
+    const double HashSeconds = FPlatformTime::Seconds() - HashStart;
+
+    FTraversalData Traversal;
+    Traversal.Init(NodesCount);
+    uint64 StampedSelected = 0;
+    uint32 LastVisited = 0;
+    const double StampStart = FPlatformTime::Seconds();
+    for (int32 Frame = 0; Frame < FramesCount; Frame ++)
+    {
+        Traversal.BeginTraversal();
+        Traverse(Frame, Queue, [&](const uint32 NodeID)
+        {
+            Traversal.MarkVisited(NodeID);
+            LastVisited = NodeID;
+            Traversal.SetError(NodeID, static_cast<float>(NodeID));
+            if (NodeID & 1) Traversal.MarkSelected(NodeID);
+        });
+        StampedSelected += Traversal.SelectedNodes.Num();
+    }
+    const double StampSeconds = FPlatformTime::Seconds() - StampStart;
+
+    TestEqual(TEXT("Both variants select the same nodes"), StampedSelected, HashedSelected);
+    // Whatever the last frame didn't reach must look untouched, without anything having been cleared
+    TestTrue(TEXT("Visited nodes are stamped"), Traversal.IsVisited(LastVisited));
+    TestFalse(TEXT("Nodes of earlier frames are not visited"), Traversal.IsVisited(DroppedNode));
+    TestFalse(TEXT("Nodes of earlier frames are not selected"), Traversal.IsSelected(DroppedNode * 2 + 1));
+    TestEqual(TEXT("Nodes of earlier frames have no error"), Traversal.GetError(DroppedNode), 0.0f);
+
+    AddInfo(FString::Printf(TEXT("%d frames over %d nodes, %d visited per frame: sets %.3f ms/frame, generation stamps %.3f ms/frame"),
+        FramesCount, NodesCount, VisitedPerFrame, HashSeconds * 1000.0 / FramesCount, StampSeconds * 1000.0 / FramesCount));
+    return true;
+}
+
+#endif
@@ -5,9 +5,16 @@
 #include "UnrealNexusProxy.h"
 #include "Kismet/GameplayStatics.h"
 #include "Engine/LocalPlayer.h"
+#include "Engine/Engine.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Components/DirectionalLightComponent.h"
 #include "DrawDebugHelpers.h"
+#include "Engine/TextureStreamingTypes.h"
+#include "RHI.h"
 #include "NexusCommons.h"
 #include "NexusJobExecutorThread.h"
+#include "NexusPrefetchSchedule.h"
 using namespace NexusCommons;
 
 constexpr bool GBCheckInvariants = false;
@@ -16,6 +23,57 @@ using namespace nx;
 
 DECLARE_STATS_GROUP(TEXT("Unreal Nexus Traversal"), STATGROUP_NexusTraversal, STATCAT_Advanced);
 DECLARE_CYCLE_STAT(TEXT("Unreal Nexus Traversal Statistics"), STATID_NexusTraversal, STATGROUP_NexusTraversal)
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Traversal Latency (ms)"), STATID_NexusTraversalLatency, STATGROUP_NexusTraversal);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Consumed Cut Age (frames)"), STATID_NexusTraversalCutAge, STATGROUP_NexusTraversal);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Full Traversals"), STATID_NexusFullTraversals, STATGROUP_NexusTraversal);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Reused Cuts"), STATID_NexusReusedCuts, STATGROUP_NexusTraversal);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Skipped Traversals"), STATID_NexusSkippedTraversals, STATGROUP_NexusTraversal);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Occluder Triangles"), STATID_NexusOccluderTriangles, STATGROUP_NexusTraversal);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Occluded Nodes"), STATID_NexusOccludedNodes, STATGROUP_NexusTraversal);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shadow Cut Nodes"), STATID_NexusShadowCutNodes, STATGROUP_NexusTraversal);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Prefetch Candidates"), STATID_NexusPrefetchCandidates, STATGROUP_NexusTraversal);
+// Never reset, compare it before and after a camera path to get what the path streamed
+DECLARE_MEMORY_STAT(TEXT("Streamed Node Bytes"), STATID_NexusStreamedNodeBytes, STATGROUP_NexusLoading);
+
+static TAutoConsoleVariable<int32> CVarNexusIncrementalTraversal(
+    TEXT("nexus.IncrementalTraversal"),
+    1,
+    TEXT("0: traverse the whole DAG every time\n")
+    TEXT("1: skip the traversal while nothing changes and reuse the previous cut while it holds"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusConeCulling(
+    TEXT("nexus.ConeCulling"),
+    1,
+    TEXT("0: ignore the normal cones of the nodes\n")
+    TEXT("1: lower the error of the nodes facing away from the camera and skip drawing them"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusOcclusionCulling(
+    TEXT("nexus.OcclusionCulling"),
+    1,
+    TEXT("0: refine the nodes hidden behind other parts of the model\n")
+    TEXT("1: rasterize the coarse part of the cut on the CPU and don't refine or request the nodes it hides"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusOccluderTriangles(
+    TEXT("nexus.OccluderTriangles"),
+    256 * 1024,
+    TEXT("Triangles of the coarsest nodes kept on the CPU for the occlusion buffer, read when the component is registered"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNexusShadowCut(
+    TEXT("nexus.ShadowCut"),
+    1,
+    TEXT("0: draw the camera cut into the shadow maps\n")
+    TEXT("1: draw a coarser cut made of the loaded nodes into the shadow maps"),
+    ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNexusShadowErrorScale(
+    TEXT("nexus.ShadowErrorScale"),
+    2.0f,
+    TEXT("Target error of the shadow cut over the target error of the camera cut, on top of the shadow cascades texel size"),
+    ECVF_Default);
 
 // One unit in Unreal is 100cms
 constexpr float GUnrealScaleConversion = 1.0f;
@@ -39,96 +97,114 @@ UUnrealNexusComponent::UUnrealNexusComponent(const FObjectInitializer& Initializ
 
 UUnrealNexusComponent::~UUnrealNexusComponent()
 {
+    WaitForTraversal();
     if(!NexusLoadedAsset) return;
-    TArray<uint32> LoadedIDs;
-    NodeStatuses.GetKeys(LoadedIDs);
-    for (const int N : LoadedIDs)
+    for (int N = 0; N < NodeStatuses.Num(); N ++)
     {
-        NexusLoadedAsset->UnloadNode(N);
+        if (NodeStatuses[N] != ENodeStatus::Dropped)
+        {
+            NexusLoadedAsset->UnloadNode(N);
+        }
     }
 }
 
 void UUnrealNexusComponent::BeginPlay()
 {
     Super::BeginPlay();
-    CreateThreads();
+    CreateJobsQueue();
 }
 
 
 void UUnrealNexusComponent::BeginDestroy()
 {
     Super::BeginDestroy();
-    DeleteThreads();
+    WaitForTraversal();
+    DeleteJobsQueue();
 }
 
-void UUnrealNexusComponent::DeleteThreads()
+void UUnrealNexusComponent::DeleteJobsQueue()
 {
-    if (!JobThread) return;
-    JobThread->Kill();
-    JobExecutor->Stop();
-    JobExecutor->Exit();
-    delete JobThread;
-    delete JobExecutor;
-
-    JobThread = nullptr;
-    JobExecutor = nullptr;
+    if (!JobsDone) return;
+    // After the module shutdown there are no workers left to wait for
+    if (FNexusJobExecutor* Executor = FNexusJobExecutor::Get())
+    {
+        Executor->CancelJobs(JobsDone);
+    }
+    JobsDone.Reset();
 }
-void UUnrealNexusComponent::CreateThreads()
+
+void UUnrealNexusComponent::CreateJobsQueue()
 {
-    JobExecutor = new FNexusJobExecutorThread(nullptr);
-    JobThread = FRunnableThread::Create(JobExecutor, TEXT("Nexus Node Loader"));
+    JobsDone = MakeShared<FNexusJobsDoneQueue, ESPMode::ThreadSafe>();
 }
 
-void UUnrealNexusComponent::SetErrorForNode(uint32 NodeID, float Error)
+void FTraversalData::Init(const int32 NodesCount)
 {
-    CalculatedErrors[NodeID] = Error;
+    VisitedStamps.Init(0, NodesCount);
+    BlockedStamps.Init(0, NodesCount);
+    SelectedStamps.Init(0, NodesCount);
+    ErrorStamps.Init(0, NodesCount);
+    Errors.Init(0.0f, NodesCount);
+    ShadowParentStamps.Init(0, NodesCount);
+    ShadowExpandedParents.Init(0, NodesCount);
+    PrefetchStamps.Init(0, NodesCount);
+    TraversalQueue.Reset();
+    SelectedNodes.Reset();
+    Candidates.Reset();
+    Decisions.Reset();
+    ShadowSelectedNodes.Reset();
+    PrefetchCandidates.Reset();
+    Generation = 1;
 }
 
-float UUnrealNexusComponent::GetErrorForNode(const uint32 NodeID) const
+void FTraversalData::BeginTraversal()
 {
-    return CalculatedErrors[NodeID];
+    Generation ++;
+    if (Generation == 0)
+    {
+        // Wrapped around, stamps from 4 billion traversals ago would look current again
+        Init(Errors.Num());
+    }
+    TraversalQueue.Reset();
+    SelectedNodes.Reset();
+    Candidates.Reset();
+    Decisions.Reset();
+    ShadowSelectedNodes.Reset();
+    PrefetchCandidates.Reset();
+    bReusedPreviousCut = false;
 }
 
-float UUnrealNexusComponent::CalculateErrorForNode(const uint32 NodeID, const bool UseTight) const
+float UUnrealNexusComponent::GetErrorForNode(const uint32 NodeID) const
 {
-    Node* SelectedNode = &NexusLoadedAsset->Nodes[NodeID].NexusNode;
-    vcg::Sphere3f& NodeBoundingSphere = SelectedNode->sphere;
-    const FVector Viewpoint = CameraInfo.ViewpointLocation;
-
-    const float SphereRadius = UseTight ? SelectedNode->tight_radius : NodeBoundingSphere.Radius();
-    const FVector BoundingSphereCenter = VcgPoint3FToVector(NodeBoundingSphere.Center());
-    const FVector ViewpointToBoundingSphere = Viewpoint - BoundingSphereCenter;
-    const float ViewpointDistanceToBoundingSphere = FMath::Max(ViewpointToBoundingSphere.Size() - SphereRadius, 0.1f);
-    float CalculatedError = SelectedNode->error / (CameraInfo.CurrentResolution * ViewpointDistanceToBoundingSphere);
-    
-    const float BoundingSphereDistanceFromViewFrustum =  CalculateDistanceFromSphereToViewFrustum(NodeBoundingSphere, SphereRadius);
-    if (BoundingSphereDistanceFromViewFrustum < -SphereRadius)
+    const FTraversalData& Traversal = GetFrontTraversal();
+    if (Traversal.HasError(NodeID))
     {
-        CalculatedError /= Outer_Node_Factor + 1.0f;
-    } else if (BoundingSphereDistanceFromViewFrustum < 0)
-    {
-        CalculatedError /= 1.0f - (BoundingSphereDistanceFromViewFrustum / SphereRadius) * Outer_Node_Factor;
+        return Traversal.GetError(NodeID);
     }
+    // Loaded after the published traversal was launched
+    return CalculateErrorForNode(Traversal.Inputs.ErrorParams, NodeID, false);
+}
 
-    return CalculatedError * GUnrealScaleConversion;
+float UUnrealNexusComponent::CalculateErrorForNode(const FNexusErrorParams& Params, const uint32 NodeID, const bool UseTight) const
+{
+    // The table is built on the game thread by AllocateMemory, so workers only ever read it
+    return NexusErrorKernel::CalculateError(NexusLoadedAsset->NodeTable, Params, NodeID, UseTight);
 }
 
-float UUnrealNexusComponent::CalculateDistanceFromSphereToViewFrustum(const vcg::Sphere3f& Sphere, const float SphereTightRadius) const 
+void UUnrealNexusComponent::CalculateErrorsForNodes(const FNexusErrorParams& Params, const TArrayView<const uint32> NodeIDs, const TArrayView<float> OutErrors) const
 {
-    float MinDistance = 1e20;
-    const FConvexVolume& ViewFrustum = CameraInfo.ViewFrustum;
-    const FConvexVolume::FPlaneArray& ViewPlanes = ViewFrustum.Planes;
-    const FVector SphereCenter = VcgPoint3FToVector(Sphere.Center());
-    for (uint32 i = 0; i < 5; i ++)
+    check(NodeIDs.Num() == OutErrors.Num());
+    const FNexusNodeTable& NodeTable = NexusLoadedAsset->NodeTable;
+    NexusErrorKernel::CalculateErrors(NodeTable, Params, NodeIDs.GetData(), NodeIDs.Num(), false, OutErrors.GetData());
+    if (GBCheckInvariants)
     {
-        const FPlane CurrentPlane = ViewPlanes[i];
-        const float DistanceFromPlane = FVector::Distance(SphereCenter, CurrentPlane);
-        if (DistanceFromPlane < MinDistance)
+        for (int32 i = 0; i < NodeIDs.Num(); i ++)
         {
-            MinDistance = DistanceFromPlane;
+            const float ReferenceError = CalculateErrorForNode(Params, NodeIDs[i], false);
+            checkf(FMath::IsNearlyEqual(OutErrors[i], ReferenceError, FMath::Abs(ReferenceError) * 1e-4f + KINDA_SMALL_NUMBER),
+                TEXT("Error kernel mismatch for node %d: %f, expected %f"), NodeIDs[i], OutErrors[i], ReferenceError);
         }
     }
-    return MinDistance;
 }
 
 void UUnrealNexusComponent::ToggleTraversal(const bool NewTraversalState)
@@ -136,6 +212,60 @@ void UUnrealNexusComponent::ToggleTraversal(const bool NewTraversalState)
     bIsTraversalEnabled = NewTraversalState;
 }
 
+void UUnrealNexusComponent::PlayPrefetchSchedule(const float StartTime)
+{
+    if (Proxy)
+    {
+        Proxy->ClearScheduledNodes();
+    }
+    bIsPlayingSchedule = PrefetchSchedule != nullptr;
+    ScheduleTime = StartTime;
+    NextScheduledNode = PrefetchSchedule ? PrefetchSchedule->FindFirstNode(StartTime) : 0;
+}
+
+void UUnrealNexusComponent::StopPrefetchSchedule()
+{
+    if (Proxy)
+    {
+        Proxy->ClearScheduledNodes();
+    }
+    bIsPlayingSchedule = false;
+}
+
+void UUnrealNexusComponent::SetPrefetchScheduleTime(const float Time)
+{
+    if (!PrefetchSchedule) return;
+    const int32 FirstNode = PrefetchSchedule->FindFirstNode(Time);
+    // Going forward the nodes already fed stay fed, going back they're fed again
+    NextScheduledNode = Time < ScheduleTime ? FirstNode : FMath::Max(NextScheduledNode, FirstNode);
+    ScheduleTime = Time;
+}
+
+void UUnrealNexusComponent::FeedPrefetchSchedule(const float DeltaTime)
+{
+    if (!bIsPlayingSchedule) return;
+    if (!PrefetchSchedule || PrefetchSchedule->NexusData != NexusLoadedAsset)
+    {
+        UE_LOG(NexusErrors, Warning, TEXT("The prefetch schedule of %s wasn't built for its nexus asset"), *GetName());
+        StopPrefetchSchedule();
+        return;
+    }
+    ScheduleTime += DeltaTime;
+    const TArray<FNexusScheduledNode>& ScheduledNodes = PrefetchSchedule->Nodes;
+    while (NextScheduledNode < ScheduledNodes.Num() && ScheduledNodes[NextScheduledNode].Time <= ScheduleTime + PrefetchScheduleLead)
+    {
+        const FNexusScheduledNode& Scheduled = ScheduledNodes[NextScheduledNode ++];
+        if (NodeStatuses.IsValidIndex(Scheduled.NodeID))
+        {
+            Proxy->AddScheduledNode(Scheduled);
+        }
+    }
+    if (NextScheduledNode == ScheduledNodes.Num() && ScheduleTime > PrefetchSchedule->Duration)
+    {
+        bIsPlayingSchedule = false;
+    }
+}
+
 void UUnrealNexusComponent::ToggleFrustumCulling(bool NewFrustumCullingState)
 {
     bIsFrustumCullingEnabled = NewFrustumCullingState;
@@ -154,6 +284,26 @@ void UUnrealNexusComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMat
 
 }
 
+void UUnrealNexusComponent::GetStreamingRenderAssetInfo(FStreamingTextureLevelContext& LevelContext, TArray<FStreamingRenderAssetPrimitiveInfo>& OutStreamingRenderAssets) const
+{
+    if (!Proxy || !NexusLoadedAsset) return;
+    const FNexusTextureResidency& TextureResidency = Proxy->TextureResidency;
+    for (int32 TextureID = 0; TextureID < TextureResidency.Num(); TextureID ++)
+    {
+        const int32 WantedResolution = TextureResidency.GetWantedResolution(TextureID);
+        if (WantedResolution == 0) continue;
+        UTexture* Texture = NexusLoadedAsset->GetTexture(TextureID);
+        if (Texture == nullptr) continue;
+        
+        // Negative texel factors ask for a fixed resolution, the projected sizes of the nodes already account for the view
+        FStreamingRenderAssetPrimitiveInfo& Info = OutStreamingRenderAssets.AddDefaulted_GetRef();
+        Info.RenderAsset = Texture;
+        Info.Bounds = Bounds;
+        Info.TexelFactor = -static_cast<float>(WantedResolution);
+        Info.PackedRelativeBox = PackedRelativeBox_Identity;
+    }
+}
+
 FPrimitiveSceneProxy* UUnrealNexusComponent::CreateSceneProxy()
 {
     Proxy = new FUnrealNexusProxy(this);
@@ -162,83 +312,300 @@ FPrimitiveSceneProxy* UUnrealNexusComponent::CreateSceneProxy()
 
 void UUnrealNexusComponent::UpdateCameraView()
 {
-    // TODO: Remove hardcoded player index
-    // TODO: Check for Viewport, ViewportClient and Player
-    ULocalPlayer* Player = GetWorld()->GetFirstLocalPlayerFromController();
-    APlayerController* FirstController = GetWorld()->GetFirstPlayerController();
+    Cameras.Reset();
+    for (ULocalPlayer* Player : GEngine->GetGamePlayers(GetWorld()))
+    {
+        AddPlayerCamera(Player);
+    }
+    for (const USceneCaptureComponent2D* Capture : SceneCaptures)
+    {
+        AddSceneCaptureCamera(Capture);
+    }
+    UpdateCameraMotions();
+
+    if (bShowDebugStuff)
+    {
+        FlushPersistentDebugLines(GetWorld());
+        const FTransform& ModelToWorld = GetComponentTransform();
+        for (const FCameraInfo& Camera : Cameras)
+        {
+            DrawDebugBox(GetWorld(), ModelToWorld.TransformPosition(Camera.ViewpointLocation), FVector(10.0f), FQuat::Identity, FColor::Purple);
+            for (int i = 0; i < Camera.ViewFrustum.Planes.Num(); i ++)
+            {
+                const FVector PlanePoint = ModelToWorld.TransformPosition(Camera.ViewFrustum.Planes[i] * Camera.ViewFrustum.Planes[i].W);
+                const int Percent = (static_cast<float>(i) / 4.0f) * 255;
+                DrawDebugPoint(GetWorld(), PlanePoint, 10.0f, FColor(Percent, Percent, Percent), true);
+            }
+        }
+    }
+
+    ErrorParams.Views.Reset();
+    ShadowErrorParams.Views.Reset();
+    for (const FCameraInfo& Camera : Cameras)
+    {
+        FNexusErrorView& View = ErrorParams.Views.AddDefaulted_GetRef();
+        View.Viewpoint = Camera.ViewpointLocation;
+        View.Resolution = Camera.CurrentResolution;
+        View.Planes = Camera.ViewFrustum.Planes;
+
+        FNexusErrorView& ShadowView = ShadowErrorParams.Views.AddDefaulted_GetRef();
+        ShadowView.Viewpoint = Camera.ViewpointLocation;
+        ShadowView.Resolution = Camera.ShadowResolution;
+    }
+    ErrorParams.OuterNodeFactor = Outer_Node_Factor;
+    ErrorParams.BackfaceFactor = CVarNexusConeCulling.GetValueOnGameThread() != 0 ? Backface_Node_Factor : 0.0f;
+    ErrorParams.ScaleConversion = GUnrealScaleConversion;
+    // The back faces cast shadows as well
+    ShadowErrorParams.OuterNodeFactor = 0.0f;
+    ShadowErrorParams.BackfaceFactor = 0.0f;
+    ShadowErrorParams.ScaleConversion = GUnrealScaleConversion;
+    UpdatePrefetchViews();
+}
+
+void UUnrealNexusComponent::UpdateCameraMotions()
+{
+    if (CameraMotions.Num() != Cameras.Num())
+    {
+        // Players or captures came and went, the cameras can't be matched with their last poses
+        CameraMotions.Reset();
+        CameraMotions.SetNum(Cameras.Num());
+    }
+    const float Now = GetWorld()->GetTimeSeconds();
+    for (int32 i = 0; i < Cameras.Num(); i ++)
+    {
+        const FCameraInfo& Camera = Cameras[i];
+        FCameraMotion& Motion = CameraMotions[i];
+        const float Elapsed = Now - Motion.LastTime;
+        if (Motion.bHasLastPose && Elapsed > 0.0f)
+        {
+            const bool bMoved = !Camera.ViewpointLocation.Equals(Motion.LastLocation) || !Camera.ViewRotation.Equals(Motion.LastRotation);
+            if (bMoved)
+            {
+                FQuat Turn = Camera.ViewRotation * Motion.LastRotation.Inverse();
+                if (Turn.W < 0.0f)
+                {
+                    // The shortest way around
+                    Turn = Turn * -1.0f;
+                }
+                FVector Axis;
+                float Angle;
+                Turn.ToAxisAndAngle(Axis, Angle);
+                // Smoothed over the last updates, so that a single jittery frame doesn't throw the prediction off
+                const FVector Velocity = (Camera.ViewpointLocation - Motion.LastLocation) / Elapsed;
+                Motion.Velocity = FMath::Lerp(Motion.Velocity, Velocity, 0.5f);
+                Motion.AngularVelocity = FMath::Lerp(Motion.AngularVelocity, Axis * (Angle / Elapsed), 0.5f);
+            }
+            else
+            {
+                // A camera that stopped stops predicting right away
+                Motion.Velocity = FVector::ZeroVector;
+                Motion.AngularVelocity = FVector::ZeroVector;
+            }
+        }
+        Motion.LastLocation = Camera.ViewpointLocation;
+        Motion.LastRotation = Camera.ViewRotation;
+        Motion.LastTime = Now;
+        Motion.bHasLastPose = true;
+    }
+}
+
+void UUnrealNexusComponent::UpdatePrefetchViews()
+{
+    PrefetchErrorParams = ErrorParams;
+    PrefetchErrorParams.Views.Reset();
+    if (PrefetchLookahead <= 0.0f) return;
+    for (int32 i = 0; i < Cameras.Num(); i ++)
+    {
+        const FCameraInfo& Camera = Cameras[i];
+        const FCameraMotion& Motion = CameraMotions[i];
+        if (!Motion.IsMoving()) continue;
+
+        // Past a quarter turn the extrapolation is mostly guesswork
+        const float Angle = FMath::Min(Motion.AngularVelocity.Size() * PrefetchLookahead, HALF_PI);
+        const FQuat Turn = Angle > 0.0f ? FQuat(Motion.AngularVelocity.GetSafeNormal(), Angle) : FQuat::Identity;
+        const FVector PredictedLocation = Camera.ViewpointLocation + Motion.Velocity * PrefetchLookahead;
+        const FMatrix CurrentToPredicted = FTranslationMatrix(-Camera.ViewpointLocation) * FQuatRotationMatrix(Turn) * FTranslationMatrix(PredictedLocation);
+
+        FNexusErrorView& View = PrefetchErrorParams.Views.AddDefaulted_GetRef();
+        View.Viewpoint = PredictedLocation;
+        View.Resolution = Camera.CurrentResolution;
+        for (const FPlane& Plane : Camera.ViewFrustum.Planes)
+        {
+            View.Planes.Add(Plane.TransformBy(CurrentToPredicted));
+        }
+    }
+}
 
+void UUnrealNexusComponent::AddPlayerCamera(ULocalPlayer* Player)
+{
+    if (!Player || !Player->PlayerController || !Player->ViewportClient || !Player->ViewportClient->Viewport) return;
     
-    const auto Viewport = Player->ViewportClient->Viewport;
+    FViewport* Viewport = Player->ViewportClient->Viewport;
     FSceneViewFamilyContext ViewFamily(FSceneViewFamily::ConstructionValues(
         Viewport,
         GetWorld()->Scene,
         Player->ViewportClient->EngineShowFlags)
         .SetRealtimeUpdate(true));
-    FSceneView* SceneView = Player->CalcSceneView(&ViewFamily, CameraInfo.ViewpointLocation, CameraInfo.ViewpointRotation, Viewport);
-
-    CameraInfo.ViewportSize = Viewport->GetSizeXY();
-    CameraInfo.WorldToModelMatrix = GetComponentTransform().ToInverseMatrixWithScale();
-    // TODO: Check(SceneView)
-
-    CameraInfo.ViewFrustum = SceneView->ViewFrustum;
-    CameraInfo.ViewpointLocation = CameraInfo.WorldToModelMatrix.TransformPosition(SceneView->ViewLocation);
+    FVector ViewLocation;
+    FRotator ViewRotation;
+    if (!GEngine->IsStereoscopic3D(Viewport))
+    {
+        const FSceneView* SceneView = Player->CalcSceneView(&ViewFamily, ViewLocation, ViewRotation, Viewport);
+        if (SceneView && SceneView->IsPerspectiveProjection())
+        {
+            AddCamera(SceneView->ViewLocation, SceneView->ViewRotation, SceneView->ViewMatrices.GetViewProjectionMatrix(),
+                SceneView->ViewMatrices.GetProjectionMatrix(), SceneView->UnscaledViewRect.Width());
+        }
+        return;
+    }
 
-    FVector ScreenMiddle, ScreenLeft, ScreenRight;
-    FVector ScreenMiddleDir, ScreenLeftDir, ScreenRightDir;
-    FirstController->DeprojectScreenPositionToWorld(CameraInfo.ViewportSize.X / 2, CameraInfo.ViewportSize.Y / 2, ScreenMiddle, ScreenMiddleDir);
-    FirstController->DeprojectScreenPositionToWorld(0, CameraInfo.ViewportSize.Y / 2, ScreenLeft, ScreenLeftDir);
-    FirstController->DeprojectScreenPositionToWorld(CameraInfo.ViewportSize.X, CameraInfo.ViewportSize.Y / 2, ScreenRight, ScreenRightDir);
+    // The eyes see almost the same nodes, so they're refined as a single view that covers both
+    const FSceneView* LeftEye = Player->CalcSceneView(&ViewFamily, ViewLocation, ViewRotation, Viewport, nullptr, eSSP_LEFT_EYE);
+    const FSceneView* RightEye = Player->CalcSceneView(&ViewFamily, ViewLocation, ViewRotation, Viewport, nullptr, eSSP_RIGHT_EYE);
+    if (!LeftEye || !RightEye) return;
+    const int32 FirstEye = Cameras.Num();
+    AddCamera(LeftEye->ViewLocation, LeftEye->ViewRotation, LeftEye->ViewMatrices.GetViewProjectionMatrix(), LeftEye->ViewMatrices.GetProjectionMatrix(), LeftEye->UnscaledViewRect.Width());
+    AddCamera(RightEye->ViewLocation, RightEye->ViewRotation, RightEye->ViewMatrices.GetViewProjectionMatrix(), RightEye->ViewMatrices.GetProjectionMatrix(), RightEye->UnscaledViewRect.Width());
+    if (Cameras.Num() != FirstEye + 2)
+    {
+        Cameras.SetNum(FirstEye);
+        return;
+    }
+    const FCameraInfo Right = Cameras.Pop(false);
+    FCameraInfo& Merged = Cameras.Last();
+    const FVector Middle = (Merged.ViewpointLocation + Right.ViewpointLocation) * 0.5f;
+    // The eyes have their planes in the same order, the outermost one of every pair bounds both
+    for (int32 i = 0; i < FMath::Min(Merged.ViewFrustum.Planes.Num(), Right.ViewFrustum.Planes.Num()); i ++)
+    {
+        if (Right.ViewFrustum.Planes[i].PlaneDot(Middle) < Merged.ViewFrustum.Planes[i].PlaneDot(Middle))
+        {
+            Merged.ViewFrustum.Planes[i] = Right.ViewFrustum.Planes[i];
+        }
+    }
+    Merged.ViewFrustum.Init();
+    Merged.ViewpointLocation = Middle;
+    Merged.CurrentResolution = FMath::Min(Merged.CurrentResolution, Right.CurrentResolution);
+    Merged.ShadowResolution = FMath::Min(Merged.ShadowResolution, Right.ShadowResolution);
+    Merged.ModelToClipMatrices.Append(Right.ModelToClipMatrices);
+}
 
-    ScreenLeft = CameraInfo.WorldToModelMatrix.TransformPosition(ScreenLeft);
-    ScreenMiddle = CameraInfo.WorldToModelMatrix.TransformPosition(ScreenMiddle);
-    ScreenRight = CameraInfo.WorldToModelMatrix.TransformPosition(ScreenRight);
+void UUnrealNexusComponent::AddSceneCaptureCamera(const USceneCaptureComponent2D* Capture)
+{
+    if (!Capture || !Capture->TextureTarget || Capture->ProjectionType != ECameraProjectionMode::Perspective) return;
+    
+    // The matrices the capture is rendered with, see BuildProjectionMatrix in SceneCaptureRendering.cpp
+    const int32 Width = Capture->TextureTarget->SizeX;
+    const int32 Height = FMath::Max(Capture->TextureTarget->SizeY, 1);
+    const float HalfFOV = FMath::DegreesToRadians(Capture->FOVAngle) * 0.5f;
+    const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(HalfFOV, HalfFOV, 1.0f, static_cast<float>(Width) / Height, GNearClippingPlane, GNearClippingPlane);
+    const FVector ViewLocation = Capture->GetComponentLocation();
+    const FMatrix ViewMatrix = FTranslationMatrix(-ViewLocation) * FInverseRotationMatrix(Capture->GetComponentRotation()) *
+        FMatrix(FPlane(0, 0, 1, 0), FPlane(1, 0, 0, 0), FPlane(0, 1, 0, 0), FPlane(0, 0, 0, 1));
+    AddCamera(ViewLocation, Capture->GetComponentRotation(), ViewMatrix * ProjectionMatrix, ProjectionMatrix, Width);
+}
 
-    GetViewFrustumBounds(CameraInfo.ViewFrustum, SceneView->ViewMatrices.GetViewProjectionMatrix(), true);
-    // Transforming everything into model space
+void UUnrealNexusComponent::AddCamera(const FVector& ViewLocation, const FRotator& ViewRotation, const FMatrix& ViewProjectionMatrix, const FMatrix& ProjectionMatrix, const int32 ViewWidth)
+{
+    if (ViewWidth <= 0) return;
+    const FMatrix WorldToModelMatrix = GetComponentTransform().ToInverseMatrixWithScale();
+    
+    FCameraInfo& Camera = Cameras.AddDefaulted_GetRef();
+    Camera.ViewpointLocation = WorldToModelMatrix.TransformPosition(ViewLocation);
+    Camera.ViewRotation = GetComponentQuat().Inverse() * ViewRotation.Quaternion();
+    Camera.ModelToClipMatrices.Add(GetComponentTransform().ToMatrixWithScale() * ViewProjectionMatrix);
     
-    for (uint32 i = 0; i < 5; i ++)
+    // Transforming everything into model space
+    GetViewFrustumBounds(Camera.ViewFrustum, ViewProjectionMatrix, true);
+    for (FPlane& Current : Camera.ViewFrustum.Planes)
     {
-        FPlane& Current = CameraInfo.ViewFrustum.Planes[i];
-        Current = Current.TransformBy(CameraInfo.WorldToModelMatrix);
+        // Normalized again, so that PlaneDot stays a distance with a scaled component
+        Current = Current.TransformBy(WorldToModelMatrix);
+        Current /= Current.Size();
     }
-    
+    Camera.ViewFrustum.Init();
 
-    CameraInfo.ViewFrustum.Init();
-
-    // Draw frustum
-    // After extract, check non-selected i -> non-selected childs(i)
-    
-    const float SideLengthWorldSpace = (ScreenRight - ScreenLeft).Size();
-   
-    const float DistanceToCenter = (CameraInfo.ViewpointLocation - ScreenMiddle).Size();
-    const int ViewportWidth = CameraInfo.ViewportSize.X;
-    const float ResolutionThisFrame = (2 * SideLengthWorldSpace / DistanceToCenter) / ViewportWidth;
+    // Twice the width of the view one unit away from the viewpoint, over its pixels
+    Camera.CurrentResolution = 4.0f / (ProjectionMatrix.M[0][0] * ViewWidth);
+    Camera.ShadowResolution = FMath::Max(Camera.CurrentResolution, GetCascadeShadowResolution(ProjectionMatrix));
+}
 
-    if (bShowDebugStuff)
+float UUnrealNexusComponent::GetCascadeShadowResolution(const FMatrix& ProjectionMatrix)
+{
+    if (!CascadeLight.IsValid())
     {
-        DrawDebugBox(GetWorld(), CameraInfo.ViewpointLocation, FVector(10.0f), FQuat::Identity, FColor::Purple);
-        DrawDebugPoint(GetWorld(), ScreenLeft, 20.0f, FColor::Green);
-        DrawDebugPoint(GetWorld(), ScreenMiddle, 20.0f, FColor::White);
-        DrawDebugPoint(GetWorld(), ScreenRight, 20.0f, FColor::Red);
-
-        FlushPersistentDebugLines(GetWorld());
-        for (int i = 0; i < 5; i ++)
+        for (UDirectionalLightComponent* Light : TObjectRange<UDirectionalLightComponent>())
         {
-            const auto& Plane = CameraInfo.ViewFrustum.Planes[i];
-            const int Percent = (static_cast<float>(i) / 4.0f) * 255;
-            DrawDebugPoint(GetWorld(), Plane, 10.0f, FColor(Percent, Percent, Percent), true);
+            if (Light->GetWorld() == GetWorld() && Light->CastShadows && Light->CastDynamicShadows && Light->IsVisible())
+            {
+                CascadeLight = Light;
+                break;
+            }
         }
     }
-    CameraInfo.IsUsingSameResolutionAsBefore = CameraInfo.CurrentResolution == ResolutionThisFrame;
-    CameraInfo.CurrentResolution = ResolutionThisFrame;
+    const UDirectionalLightComponent* Light = CascadeLight.Get();
+    if (!Light || Light->Mobility == EComponentMobility::Static) return 0.0f;
+
+    // The splits of FDirectionalLightSceneProxy::GetSplitDistance
+    static const TConsoleVariableData<int32>* CVarMaxCSMResolution = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("r.Shadow.MaxCSMResolution"));
+    static const TConsoleVariableData<int32>* CVarMaxCascades = IConsoleManager::Get().FindTConsoleVariableDataInt(TEXT("r.Shadow.CSM.MaxCascades"));
+    static const TConsoleVariableData<float>* CVarDistanceScale = IConsoleManager::Get().FindTConsoleVariableDataFloat(TEXT("r.Shadow.DistanceScale"));
+    const int32 ShadowMapWidth = FMath::Max(CVarMaxCSMResolution ? CVarMaxCSMResolution->GetValueOnGameThread() : 2048, 1);
+    const int32 CascadesCount = FMath::Min(Light->DynamicShadowCascades, CVarMaxCascades ? CVarMaxCascades->GetValueOnGameThread() : 10);
+    if (CascadesCount <= 0) return 0.0f;
+    const float DistanceScale = FMath::Clamp(CVarDistanceScale ? CVarDistanceScale->GetValueOnGameThread() : 1.0f, 0.1f, 2.0f);
+    const float ShadowDistance = DistanceScale * (Light->Mobility == EComponentMobility::Stationary ?
+        Light->DynamicShadowDistanceStationaryLight : Light->DynamicShadowDistanceMovableLight);
+    if (ShadowDistance <= GNearClippingPlane) return 0.0f;
+    const float Exponent = FMath::Clamp(Light->CascadeDistributionExponent, 1.0f, 10.0f);
+    const auto GetSplitDistance = [&](const int32 Split)
+    {
+        const float Fraction = Exponent > 1.0f ? (FMath::Pow(Exponent, Split) - 1.0f) / (FMath::Pow(Exponent, CascadesCount) - 1.0f) : static_cast<float>(Split) / CascadesCount;
+        return GNearClippingPlane + (ShadowDistance - GNearClippingPlane) * Fraction;
+    };
+
+    // Every cascade maps the sphere bounding its slice of the view frustum onto the shadow map, so its texels
+    // have the same world size across the slice. Over the distance they're the finest at the far split
+    const float SquaredTangent = FMath::Square(1.0f / ProjectionMatrix.M[0][0]) + FMath::Square(1.0f / ProjectionMatrix.M[1][1]);
+    float Resolution = MAX_flt;
+    for (int32 Cascade = 0; Cascade < CascadesCount; Cascade ++)
+    {
+        const float Near = GetSplitDistance(Cascade);
+        const float Far = GetSplitDistance(Cascade + 1);
+        // Center on the view axis at the same distance from the near and the far corners, no further than the far plane
+        const float Center = FMath::Min((Near + Far) * (1.0f + SquaredTangent) * 0.5f, Far);
+        const float Radius = FMath::Sqrt(FMath::Square(Far - Center) + Far * Far * SquaredTangent);
+        const float TexelSize = 2.0f * Radius / ShadowMapWidth;
+        // Twice the size over the distance, like the view resolution
+        Resolution = FMath::Min(Resolution, 2.0f * TexelSize / Far);
+    }
+    return Resolution;
 }
 
 void UUnrealNexusComponent::AllocateMemory()
 {
+    WaitForTraversal();
+    bHasPublishedTraversal = false;
+    bNodeStatusesChanged = true;
     if(!NexusLoadedAsset) return;
-    CalculatedErrors.Reserve(NexusLoadedAsset->Nodes.Num());
-    CalculatedErrors.SetNum(NexusLoadedAsset->Nodes.Num());
-    NodeStatuses.Reserve(NexusLoadedAsset->Nodes.Num());
+    for (FTraversalData& TraversalData : TraversalBuffers)
+    {
+        TraversalData.Init(NexusLoadedAsset->Nodes.Num());
+    }
+    NexusLoadedAsset->GetNodeTable();
+    NodeStatuses.Init(ENodeStatus::Dropped, NexusLoadedAsset->Nodes.Num());
+
+    // The nodes are sorted coarse to fine, so the first ones cover the model with the fewest triangles
+    const int64 OccluderTrianglesBudget = CVarNexusOccluderTriangles.GetValueOnGameThread();
+    int64 OccluderTriangles = 0;
+    int32 OccluderNodesCount = 0;
+    while (OccluderNodesCount < NexusLoadedAsset->Nodes.Num() - 1)
+    {
+        OccluderTriangles += NexusLoadedAsset->Nodes[OccluderNodesCount].NexusNode.nface;
+        if (OccluderTriangles > OccluderTrianglesBudget) break;
+        OccluderNodesCount ++;
+    }
+    OccluderMeshes.Reset();
+    OccluderMeshes.SetNum(OccluderNodesCount);
     ComponentBoundsRadius = NexusLoadedAsset->BoundingSphere().Radius(); 
     Bounds = FBoxSphereBounds(FSphere(GetComponentLocation(), ComponentBoundsRadius * 10.0f));
 }
@@ -246,6 +613,11 @@ void UUnrealNexusComponent::AllocateMemory()
 void UUnrealNexusComponent::OnRegister()
 {
     Super::OnRegister();
+    if (bUseCompactVertices && !UsesCompactVertices())
+    {
+        UE_LOG(NexusErrors, Warning, TEXT("%s: bUseCompactVertices is ignored, compact vertices aren't supported with manual vertex fetch on %s"),
+            *GetName(), *LegacyShaderPlatformToShaderFormat(GMaxRHIShaderPlatform).ToString());
+    }
     AllocateMemory();
     PrimaryComponentTick.SetTickFunctionEnable(true);  
 }
@@ -253,51 +625,232 @@ void UUnrealNexusComponent::OnRegister()
 
 bool UUnrealNexusComponent::IsNodeLoaded(const uint32 NodeID) const
 {
-    return NodeStatuses.Contains(NodeID) && NodeStatuses[NodeID] == ENodeStatus::Loaded;
+    return NodeStatuses.IsValidIndex(NodeID) && NodeStatuses[NodeID] == ENodeStatus::Loaded;
 }
 
 void UUnrealNexusComponent::SetNodeStatus(const uint32 NodeID, const ENodeStatus Status)
 {
-    if (Status == ENodeStatus::Dropped)
-    {
-       NodeStatuses.Remove(NodeID); 
-    } else
+    if (NodeStatuses[NodeID] != Status)
     {
-        NodeStatuses.Add(TTuple<uint32, ENodeStatus> {NodeID, Status});
+        NodeStatuses[NodeID] = Status;
+        bNodeStatusesChanged = true;
     }
 }
 
-void UUnrealNexusComponent::ClearErrors()
+
+static bool HaveSameViews(const FNexusErrorParams& A, const FNexusErrorParams& B)
 {
-    for (int i = 0; i < CalculatedErrors.Num(); i ++)
+    if (A.Views.Num() != B.Views.Num() || A.BackfaceFactor != B.BackfaceFactor)
+    {
+        return false;
+    }
+    for (int32 i = 0; i < A.Views.Num(); i ++)
     {
-        CalculatedErrors[i] = 0.0f;
+        if (!A.Views[i].Equals(B.Views[i]))
+        {
+            return false;
+        }
     }
+    return true;
+}
+
+float UUnrealNexusComponent::GetShadowTargetError() const
+{
+    return TargetError * FMath::Max(CVarNexusShadowErrorScale.GetValueOnGameThread(), 1.0f);
 }
 
+bool UUnrealNexusComponent::IsPublishedTraversalCurrent() const
+{
+    if (!bHasPublishedTraversal || bNodeStatusesChanged || CVarNexusIncrementalTraversal.GetValueOnGameThread() == 0)
+    {
+        return false;
+    }
+    const FTraversalInputs& Published = GetFrontTraversal().Inputs;
+    return HaveSameViews(Published.ErrorParams, ErrorParams) &&
+        HaveSameViews(Published.ShadowErrorParams, ShadowErrorParams) &&
+        HaveSameViews(Published.PrefetchErrorParams, PrefetchErrorParams) &&
+        Published.bShadowCut == (CVarNexusShadowCut.GetValueOnGameThread() != 0) &&
+        Published.ShadowTargetError == GetShadowTargetError() &&
+        Published.CurrentError == CurrentError &&
+        Published.TargetError == TargetError &&
+        Published.MaxBlockedNodes == MaxBlockedNodes;
+}
 
-FTraversalData UUnrealNexusComponent::DoTraversal()
+void UUnrealNexusComponent::LaunchTraversal()
 {
     checkf(Proxy, TEXT("Tried to traverse the tree without a proxy (cache)"));
+    check(!TraversalTask.IsValid());
+    FTraversalData& TraversalData = TraversalBuffers[1 - FrontTraversal];
+    FTraversalInputs& Inputs = TraversalData.Inputs;
+    Inputs.Cameras = Cameras;
+    Inputs.ErrorParams = ErrorParams;
+    Inputs.ShadowErrorParams = ShadowErrorParams;
+    Inputs.bShadowCut = CVarNexusShadowCut.GetValueOnGameThread() != 0;
+    Inputs.ShadowTargetError = GetShadowTargetError();
+    Inputs.PrefetchErrorParams = PrefetchErrorParams;
+    Inputs.CurrentError = CurrentError;
+    Inputs.TargetError = TargetError;
+    Inputs.MaxBlockedNodes = MaxBlockedNodes;
+    Inputs.NodeStatuses = NodeStatuses;
+    bNodeStatusesChanged = false;
+
+    // The previous decisions only replay correctly if the thresholds didn't change
+    const FTraversalData& Published = GetFrontTraversal();
+    const bool bCanReuseCut = bHasPublishedTraversal &&
+        CVarNexusIncrementalTraversal.GetValueOnGameThread() != 0 &&
+        Published.Inputs.CurrentError == CurrentError &&
+        Published.Inputs.TargetError == TargetError &&
+        Published.Inputs.MaxBlockedNodes == MaxBlockedNodes;
+    if (bCanReuseCut)
+    {
+        Inputs.PreviousDecisions = Published.Decisions;
+    }
+    else
+    {
+        Inputs.PreviousDecisions.Reset();
+    }
+    Inputs.LoadedNodes = Proxy->GetLoadedNodes();
+    Inputs.Occluders.Reset();
+    if (bHasPublishedTraversal && CVarNexusOcclusionCulling.GetValueOnGameThread() != 0)
+    {
+        GatherOccluders(Inputs.Occluders);
+    }
+    Inputs.FrameNumber = GFrameCounter;
+    Inputs.LaunchCycles = FPlatformTime::Cycles();
+    
+    TraversalTask = FFunctionGraphTask::CreateAndDispatchWhenReady([this, &TraversalData]()
+    {
+        DoTraversal(TraversalData);
+        TraversalData.LatencyMs = FPlatformTime::ToMilliseconds(FPlatformTime::Cycles() - TraversalData.Inputs.LaunchCycles);
+    }, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+}
+
+void UUnrealNexusComponent::PublishTraversal()
+{
+    FrontTraversal = 1 - FrontTraversal;
+    bHasPublishedTraversal = true;
+    FTraversalData& TraversalData = GetFrontTraversal();
+    SET_FLOAT_STAT(STATID_NexusTraversalLatency, TraversalData.LatencyMs);
+    SET_DWORD_STAT(STATID_NexusOccluderTriangles, TraversalData.OccluderTriangles);
+    SET_DWORD_STAT(STATID_NexusOccludedNodes, TraversalData.OccludedNodes);
+    SET_DWORD_STAT(STATID_NexusShadowCutNodes, TraversalData.ShadowSelectedNodes.Num());
+    SET_DWORD_STAT(STATID_NexusPrefetchCandidates, TraversalData.PrefetchCandidates.Num());
+    if (TraversalData.bReusedPreviousCut)
+    {
+        INC_DWORD_STAT(STATID_NexusReusedCuts);
+    }
+    else
+    {
+        INC_DWORD_STAT(STATID_NexusFullTraversals);
+    }
+    
+    // The cache may have dropped some of the selected nodes while the traversal was running
+    for (const uint32 SelectedID : TraversalData.SelectedNodes)
+    {
+        if (!IsNodeLoaded(SelectedID))
+        {
+            TraversalData.Deselect(SelectedID);
+        }
+    }
+    Proxy->ConsumeTraversal(TraversalData);
+    DrawDebugNodes();
+}
+
+void UUnrealNexusComponent::WaitForTraversal()
+{
+    if (!TraversalTask.IsValid()) return;
+    FTaskGraphInterface::Get().WaitUntilTaskCompletes(TraversalTask);
+    TraversalTask = nullptr;
+}
+
+void UUnrealNexusComponent::DoTraversal(FTraversalData& TraversalData) const
+{
     DECLARE_SCOPE_CYCLE_COUNTER(TEXT("NexusTraversalCounter"), CYCLEID_NexusTraversal, STATGROUP_NexusTraversal);
-    FTraversalData TraversalData;
-    TArray<FTraversalElement>& VisitingNodes = TraversalData.TraversalQueue;
-    TSet<uint32>& BlockedNodes = TraversalData.BlockedNodes, &SelectedNodes = TraversalData.SelectedNodes;
-    TArray<float>& InstanceErrors = TraversalData.InstanceErrors;
-    InstanceErrors.SetNum(NexusLoadedAsset->Header.n_nodes);
+    TraversalData.BeginTraversal();
+    RasterizeOccluders(TraversalData);
+    if (!TryReusingPreviousCut(TraversalData))
+    {
+        DoFullTraversal(TraversalData);
+    }
+    UpdateRemainingErrors(TraversalData);
+    DoShadowTraversal(TraversalData);
+    DoPrefetchTraversal(TraversalData);
+}
+
+bool UUnrealNexusComponent::TryReusingPreviousCut(FTraversalData& TraversalData) const
+{
+    const TArray<FTraversalDecision>& PreviousDecisions = TraversalData.Inputs.PreviousDecisions;
+    if (PreviousDecisions.Num() == 0) return false;
+    DECLARE_SCOPE_CYCLE_COUNTER(TEXT("NexusIncrementalTraversalCounter"), CYCLEID_NexusIncrementalTraversal, STATGROUP_NexusTraversal);
 
-    ClearErrors();
+    TArray<uint32> PoppedNodes;
+    PoppedNodes.SetNumUninitialized(PreviousDecisions.Num());
+    for (int32 i = 0; i < PreviousDecisions.Num(); i ++)
+    {
+        PoppedNodes[i] = PreviousDecisions[i].ID;
+    }
+    TArray<float> PoppedErrors;
+    PoppedErrors.SetNumUninitialized(PoppedNodes.Num());
+    CalculateErrorsForNodes(TraversalData.Inputs.ErrorParams, PoppedNodes, PoppedErrors);
+
+    // A single node crossing the threshold changes what gets pushed and popped after it
+    const float CurrentProxyError = TraversalData.Inputs.CurrentError;
+    for (int32 i = 0; i < PreviousDecisions.Num(); i ++)
+    {
+        const FTraversalDecision& Decision = PreviousDecisions[i];
+        const bool bOccluded = IsNodeOccluded(TraversalData, Decision.ID);
+        if (bOccluded != Decision.bOccluded)
+        {
+            return false;
+        }
+        if (Decision.bBlocked || bOccluded) continue;
+        const bool bExpanded = CanNodeBeExpanded(TraversalData, &NexusLoadedAsset->Nodes[Decision.ID].NexusNode, Decision.ID, PoppedErrors[i], CurrentProxyError);
+        if (bExpanded != Decision.bExpanded)
+        {
+            return false;
+        }
+    }
+
+    for (int32 i = 0; i < PreviousDecisions.Num(); i ++)
+    {
+        const FTraversalDecision& Decision = PreviousDecisions[i];
+        TraversalData.MarkVisited(Decision.ID);
+        TraversalData.SetError(Decision.ID, PoppedErrors[i]);
+        if (Decision.bWithinBlockLimit && !Decision.bOccluded && !TraversalData.IsNodeLoaded(Decision.ID))
+        {
+            TraversalData.Candidates.Add({ Decision.ID, PoppedErrors[i] });
+        }
+        if (Decision.bExpanded)
+        {
+            TraversalData.MarkSelected(Decision.ID);
+        }
+        if (Decision.bOccluded)
+        {
+            TraversalData.OccludedNodes ++;
+        }
+    }
+    TraversalData.Decisions = PreviousDecisions;
+    TraversalData.bReusedPreviousCut = true;
+    return true;
+}
+
+void UUnrealNexusComponent::DoFullTraversal(FTraversalData& TraversalData) const
+{
+    TArray<FTraversalElement>& VisitingNodes = TraversalData.TraversalQueue;
     
     // Load roots
+    TArray<uint32, TInlineAllocator<16>> Roots;
     for (int i = 0; i < NexusLoadedAsset->RootsCount; i ++)
     {
-        AddNodeToTraversal(TraversalData, i);
+        Roots.Add(i);
     }
+    AddNodesToTraversal(TraversalData, Roots);
 
-    const float CurrentProxyError = CurrentError;
+    const float CurrentProxyError = TraversalData.Inputs.CurrentError;
     int RequestedCount = 0;
-    CurrentlyBlockedNodes = 0;
-    while(VisitingNodes.Num() > 0 && CurrentlyBlockedNodes < MaxBlockedNodes)
+    const int32 MaxBlocked = TraversalData.Inputs.MaxBlockedNodes;
+    int CurrentlyBlockedNodes = 0;
+    while(VisitingNodes.Num() > 0 && CurrentlyBlockedNodes < MaxBlocked)
     {
         
         FTraversalElement CurrentElement;
@@ -306,56 +859,249 @@ FTraversalData UUnrealNexusComponent::DoTraversal()
         const float NodeError = CurrentElement.CalculatedError;
 
         const int Id = CurrentElement.Id;
-        if(!IsNodeLoaded(Id) && CurrentlyBlockedNodes < MaxBlockedNodes)
+        const bool bWithinBlockLimit = CurrentlyBlockedNodes < MaxBlocked;
+        // Hidden nodes stay coarse: they aren't loaded, selected, nor do they push their children
+        const bool bOccluded = IsNodeOccluded(TraversalData, Id);
+        if(!TraversalData.IsNodeLoaded(Id) && bWithinBlockLimit && !bOccluded)
         {
-            Proxy->AddCandidate(Id, NodeError);
+            TraversalData.Candidates.Add({ static_cast<uint32>(Id), NodeError });
             RequestedCount ++;
         }
 
-        const bool IsBlocked = BlockedNodes.Contains(Id) || !CanNodeBeExpanded(CurrentElement.TheNode, CurrentElement.Id, NodeError, CurrentProxyError);
-        if (IsBlocked)
+        const bool IsBlockedByParent = TraversalData.IsBlocked(Id);
+        const bool IsBlocked = IsBlockedByParent || bOccluded || !CanNodeBeExpanded(TraversalData, CurrentElement.TheNode, CurrentElement.Id, NodeError, CurrentProxyError);
+        TraversalData.Decisions.Add({ static_cast<uint32>(Id), IsBlockedByParent, !IsBlocked, bWithinBlockLimit, bOccluded });
+        if (bOccluded)
+        {
+            // Not counted as blocked, the limit is there to bound the nodes requested ahead of time
+            TraversalData.OccludedNodes ++;
+        }
+        else if (IsBlocked)
         {
             CurrentlyBlockedNodes ++;
         }
         else
         {
-            SelectedNodes.Add(Id);
+            TraversalData.MarkSelected(Id);
+        }
+        AddNodeChildren(CurrentElement, TraversalData, IsBlocked, !bOccluded);
+    }
+}
+
+void UUnrealNexusComponent::DoShadowTraversal(FTraversalData& TraversalData) const
+{
+    if (!TraversalData.Inputs.bShadowCut) return;
+    DECLARE_SCOPE_CYCLE_COUNTER(TEXT("NexusShadowTraversal"), CYCLEID_NexusShadowTraversal, STATGROUP_NexusTraversal);
+    const FNexusNodeTable& Table = NexusLoadedAsset->NodeTable;
+    const uint32 SinkID = NexusLoadedAsset->Header.n_nodes - 1;
+    const float ShadowTargetError = TraversalData.Inputs.ShadowTargetError;
+
+    // Refined one level at a time, a node joins the next level once all its parents are expanded,
+    // so that the unloaded part of the DAG is never visited
+    TArray<uint32> Level, NextLevel;
+    TArray<float> LevelErrors;
+    for (int i = 0; i < NexusLoadedAsset->RootsCount; i ++)
+    {
+        if (TraversalData.IsNodeLoaded(i))
+        {
+            Level.Add(i);
+        }
+    }
+    while (Level.Num() > 0)
+    {
+        LevelErrors.SetNumUninitialized(Level.Num(), false);
+        CalculateErrorsForNodes(TraversalData.Inputs.ShadowErrorParams, Level, LevelErrors);
+        NextLevel.Reset();
+        for (int32 i = 0; i < Level.Num(); i ++)
+        {
+            const uint32 ID = Level[i];
+            // The roots are always drawn, so that the model never loses its shadow
+            const bool bIsRoot = static_cast<int32>(ID) < NexusLoadedAsset->RootsCount;
+            if (!bIsRoot && LevelErrors[i] <= ShadowTargetError) continue;
+            TraversalData.ShadowSelectedNodes.Add(ID);
+
+            TArray<uint32, TInlineAllocator<32>> Children;
+            for (const Patch& NodePatch : NexusLoadedAsset->Nodes[ID].NodePatches)
+            {
+                if (NodePatch.node != SinkID)
+                {
+                    Children.AddUnique(NodePatch.node);
+                }
+            }
+            for (const uint32 Child : Children)
+            {
+                if (TraversalData.AddShadowExpandedParent(Child) == Table.ParentsCount[Child] && TraversalData.IsNodeLoaded(Child))
+                {
+                    NextLevel.Add(Child);
+                }
+            }
         }
-        AddNodeChildren(CurrentElement, TraversalData, IsBlocked);
+        Swap(Level, NextLevel);
     }
-    UpdateRemainingErrors(InstanceErrors);
-    return TraversalData;
 }
 
-bool UUnrealNexusComponent::CanNodeBeExpanded(Node* Node, const int NodeID, const float NodeError, const float CurrentProxyError) const
+void UUnrealNexusComponent::DoPrefetchTraversal(FTraversalData& TraversalData) const
 {
-    return NodeError > TargetError &&
-        CurrentDrawBudget <= DrawBudget &&
-        IsNodeLoaded(NodeID);
+    const FNexusErrorParams& PrefetchParams = TraversalData.Inputs.PrefetchErrorParams;
+    if (PrefetchParams.Views.Num() == 0) return;
+    DECLARE_SCOPE_CYCLE_COUNTER(TEXT("NexusPrefetchTraversal"), CYCLEID_NexusPrefetchTraversal, STATGROUP_NexusTraversal);
+    const uint32 SinkID = NexusLoadedAsset->Header.n_nodes - 1;
+    const float PrefetchTargetError = TraversalData.Inputs.TargetError;
+
+    // Only the loaded nodes are expanded, the unloaded ones on the border are the ones worth prefetching,
+    // so the walk never goes deeper than the cache
+    TArray<uint32> Level, NextLevel;
+    TArray<float> LevelErrors;
+    for (int i = 0; i < NexusLoadedAsset->RootsCount; i ++)
+    {
+        TraversalData.MarkPrefetchVisited(i);
+        Level.Add(i);
+    }
+    while (Level.Num() > 0)
+    {
+        LevelErrors.SetNumUninitialized(Level.Num(), false);
+        CalculateErrorsForNodes(PrefetchParams, Level, LevelErrors);
+        NextLevel.Reset();
+        for (int32 i = 0; i < Level.Num(); i ++)
+        {
+            const uint32 ID = Level[i];
+            if (LevelErrors[i] <= PrefetchTargetError) continue;
+            if (!TraversalData.IsNodeLoaded(ID))
+            {
+                TraversalData.PrefetchCandidates.Add({ ID, LevelErrors[i] });
+                continue;
+            }
+            for (const Patch& NodePatch : NexusLoadedAsset->Nodes[ID].NodePatches)
+            {
+                if (NodePatch.node != SinkID && !TraversalData.IsPrefetchVisited(NodePatch.node))
+                {
+                    TraversalData.MarkPrefetchVisited(NodePatch.node);
+                    NextLevel.Add(NodePatch.node);
+                }
+            }
+        }
+        Swap(Level, NextLevel);
+    }
 }
 
+bool UUnrealNexusComponent::CanNodeBeExpanded(const FTraversalData& TraversalData, Node* Node, const int NodeID, const float NodeError, const float CurrentProxyError) const
+{
+    // Only loaded nodes are expanded, so the cut never holds more than the cache, which keeps itself within DrawBudget
+    return NodeError > TraversalData.Inputs.TargetError && TraversalData.IsNodeLoaded(NodeID);
+}
 
-void UUnrealNexusComponent::AddNodeChildren(const FTraversalElement& CurrentElement, FTraversalData& TraversalData, const bool ShouldMarkBlocked)
+bool UUnrealNexusComponent::IsNodeOccluded(const FTraversalData& TraversalData, const uint32 NodeID) const
+{
+    // Grown by the error of the parents, whose coarser triangles may be drawn in front of the node
+    const FNexusNodeTable& Table = NexusLoadedAsset->NodeTable;
+    const FVector Center(Table.CenterX[NodeID], Table.CenterY[NodeID], Table.CenterZ[NodeID]);
+    const float Radius = Table.Radius[NodeID] + Table.ParentError[NodeID];
+    // Hidden from every view
+    for (const FNexusOcclusionBuffer& Buffer : TraversalData.OcclusionBuffers)
+    {
+        if (!Buffer.IsSphereOccluded(Center, Radius))
+        {
+            return false;
+        }
+    }
+    return TraversalData.OcclusionBuffers.Num() > 0;
+}
+
+void UUnrealNexusComponent::GatherOccluders(TArray<FNexusOccluder>& OutOccluders) const
+{
+    // The coarse nodes of a cut are a cut themselves, since the parents of a selected node are selected too
+    const FTraversalData& Published = GetFrontTraversal();
+    const auto IsCoarseSelected = [this, &Published](const uint32 NodeID)
+    {
+        return static_cast<int32>(NodeID) < OccluderMeshes.Num() && Published.IsSelected(NodeID);
+    };
+    for (const uint32 NodeID : Published.SelectedNodes)
+    {
+        if (!IsCoarseSelected(NodeID) || !OccluderMeshes[NodeID].IsValid()) continue;
+
+        // Same patches DrawEdgeNodes draws, leaving out the fine part of the cut
+        FNexusOccluder Occluder;
+        Occluder.Mesh = OccluderMeshes[NodeID];
+        uint32 Offset = 0;
+        for (const Patch& NodePatch : NexusLoadedAsset->Nodes[NodeID].NodePatches)
+        {
+            if (!IsCoarseSelected(NodePatch.node))
+            {
+                if (Occluder.TriangleRanges.Num() > 0 && Occluder.TriangleRanges.Last().Value == Offset)
+                {
+                    Occluder.TriangleRanges.Last().Value = NodePatch.triangle_offset;
+                }
+                else
+                {
+                    Occluder.TriangleRanges.Add({ Offset, NodePatch.triangle_offset });
+                }
+            }
+            Offset = NodePatch.triangle_offset;
+        }
+        if (Occluder.TriangleRanges.Num() > 0)
+        {
+            OutOccluders.Add(MoveTemp(Occluder));
+        }
+    }
+}
+
+void UUnrealNexusComponent::RasterizeOccluders(FTraversalData& TraversalData) const
+{
+    DECLARE_SCOPE_CYCLE_COUNTER(TEXT("NexusOcclusionRasterization"), CYCLEID_NexusOcclusionRasterization, STATGROUP_NexusTraversal);
+    TraversalData.OccluderTriangles = 0;
+    TraversalData.OccludedNodes = 0;
+    int32 BuffersCount = 0;
+    if (TraversalData.Inputs.Occluders.Num() > 0)
+    {
+        for (const FCameraInfo& Camera : TraversalData.Inputs.Cameras)
+        {
+            BuffersCount += Camera.ModelToClipMatrices.Num();
+        }
+    }
+    // Kept across traversals, so that their memory is reused
+    TraversalData.OcclusionBuffers.SetNum(BuffersCount);
+    int32 BufferIndex = 0;
+    for (const FCameraInfo& Camera : TraversalData.Inputs.Cameras)
+    {
+        for (const FMatrix& ModelToClip : Camera.ModelToClipMatrices)
+        {
+            if (BufferIndex == BuffersCount) return;
+            FNexusOcclusionBuffer& Buffer = TraversalData.OcclusionBuffers[BufferIndex ++];
+            Buffer.Clear(ModelToClip);
+            for (const FNexusOccluder& Occluder : TraversalData.Inputs.Occluders)
+            {
+                TraversalData.OccluderTriangles += Buffer.Rasterize(Occluder);
+            }
+        }
+    }
+}
+
+
+void UUnrealNexusComponent::AddNodeChildren(const FTraversalElement& CurrentElement, FTraversalData& TraversalData, const bool ShouldMarkBlocked, const bool bPushChildren) const
 {
     auto& CurrentNode = NexusLoadedAsset->Nodes[CurrentElement.Id];
+    TArray<uint32, TInlineAllocator<32>> NewChildren;
     for (auto& CurrentPatch : CurrentNode.NodePatches)
     {
         const int PatchNodeId = CurrentPatch.node;
         if (PatchNodeId == NexusLoadedAsset->Header.n_nodes - 1)
         {
             // This node is the sink
-            return;
+            break;
         }
         if (ShouldMarkBlocked)
         {
-            TraversalData.BlockedNodes.Add(PatchNodeId);
+            TraversalData.MarkBlocked(PatchNodeId);
         }
 
-        if (!TraversalData.VisitedNodes.Contains(PatchNodeId))
+        if (bPushChildren && !TraversalData.IsVisited(PatchNodeId))
         {
-            AddNodeToTraversal(TraversalData, PatchNodeId);
+            // Marked right away, a child can be referenced by more than one patch
+            TraversalData.MarkVisited(PatchNodeId);
+            NewChildren.Add(PatchNodeId);
         }
     }
+    AddNodesToTraversal(TraversalData, NewChildren);
 }
 
 void UUnrealNexusComponent::NotifyNewMaterial(UMaterialInterface* DynamicMaterial)
@@ -368,36 +1114,49 @@ void UUnrealNexusComponent::NotifyMaterialDeleted(UMaterialInterface* DynamicMat
     DynamicMaterials.Remove(DynamicMaterial);
 }
 
-void UUnrealNexusComponent::AddNodeToTraversal(FTraversalData& TraversalData, const uint32 NewNodeId)
+void UUnrealNexusComponent::AddNodesToTraversal(FTraversalData& TraversalData, const TArrayView<const uint32> NewNodeIds) const
 {
-    TraversalData.VisitedNodes.Add(NewNodeId);
-    Node* NewNode = &NexusLoadedAsset->Nodes[NewNodeId].NexusNode;
-
-    const float NodeError = CalculateErrorForNode(NewNodeId, false);
-    TraversalData.InstanceErrors[NewNodeId] = NodeError;
-    SetErrorForNode(NewNodeId, FMath::Max(NodeError, GetErrorForNode(NewNodeId)));
+    TArray<float, TInlineAllocator<32>> NodeErrors;
+    NodeErrors.SetNumUninitialized(NewNodeIds.Num());
+    CalculateErrorsForNodes(TraversalData.Inputs.ErrorParams, NewNodeIds, NodeErrors);
     
-    TraversalData.TraversalQueue.HeapPush({NewNode, NewNodeId, NodeError}, FNodeComparator());
+    for (int32 i = 0; i < NewNodeIds.Num(); i ++)
+    {
+        const uint32 NewNodeId = NewNodeIds[i];
+        TraversalData.MarkVisited(NewNodeId);
+        TraversalData.SetError(NewNodeId, NodeErrors[i]);
+        Node* NewNode = &NexusLoadedAsset->Nodes[NewNodeId].NexusNode;
+        TraversalData.TraversalQueue.HeapPush({NewNode, NewNodeId, NodeErrors[i]}, FNodeComparator());
+    }
 }
 
 
-void UUnrealNexusComponent::UpdateRemainingErrors(TArray<float>& InstanceErrors)
+void UUnrealNexusComponent::UpdateRemainingErrors(FTraversalData& TraversalData) const
 {
-    TArray<uint32> LoadedNodes = Proxy->GetLoadedNodes();
-    for (auto& NodeID : LoadedNodes)
+    // Loaded nodes that the traversal didn't reach still need an error for the cache
+    TArray<uint32> UnreachedNodes;
+    for (auto& NodeID : TraversalData.Inputs.LoadedNodes)
     {
-        // const Node& TheNode = NexusLoadedAsset->nodes[NodeID];
-        const float NodeError = CalculateErrorForNode(NodeID, false);
-        if (InstanceErrors[NodeID] == 0.0f)
+        if (!TraversalData.HasError(NodeID))
         {
-            InstanceErrors[NodeID] = NodeError;
-            SetErrorForNode(NodeID, FMath::Max( GetErrorForNode(NodeID),  NodeError));
+            UnreachedNodes.Add(NodeID);
         }
+    }
+    TArray<float> UnreachedErrors;
+    UnreachedErrors.SetNumUninitialized(UnreachedNodes.Num());
+    CalculateErrorsForNodes(TraversalData.Inputs.ErrorParams, UnreachedNodes, UnreachedErrors);
+    for (int32 i = 0; i < UnreachedNodes.Num(); i ++)
+    {
+        TraversalData.SetError(UnreachedNodes[i], UnreachedErrors[i]);
+    }
+}
 
-        if (bShowDebugStuff)
-        {
-            DrawDebugSphere(GetWorld(), VcgPoint3FToVector(NexusLoadedAsset->Nodes[NodeID].NexusNode.sphere.Center()), NexusLoadedAsset->Nodes[NodeID].NexusNode.tight_radius, 8, FColor::Red);
-        }
+void UUnrealNexusComponent::DrawDebugNodes() const
+{
+    if (!bShowDebugStuff) return;
+    for (auto& NodeID : Proxy->GetLoadedNodes())
+    {
+        DrawDebugSphere(GetWorld(), VcgPoint3FToVector(NexusLoadedAsset->Nodes[NodeID].NexusNode.sphere.Center()), NexusLoadedAsset->Nodes[NodeID].NexusNode.tight_radius, 8, FColor::Red);
     }
 }
 
@@ -411,44 +1170,118 @@ void UUnrealNexusComponent::TickComponent(float DeltaTime, ELevelTick TickType,
         FActorComponentTickFunction* ThisTickFunction)
 {
     if (!Proxy || !bIsTraversalEnabled) return;
-    if(!NexusLoadedAsset) return;
-    UpdateCameraView();
-    const FTraversalData LastTraversalData = DoTraversal();
-    Proxy->Update(CameraInfo, LastTraversalData);
-    
+    if(!NexusLoadedAsset || !JobsDone) return;
+
+    // Never wait for the traversal, if it's still running the proxy keeps working on the last cut
+    if (TraversalTask.IsValid() && TraversalTask->IsComplete())
+    {
+        TraversalTask = nullptr;
+        PublishTraversal();
+    }
+    FeedPrefetchSchedule(DeltaTime);
+    if (bHasPublishedTraversal)
+    {
+        SET_DWORD_STAT(STATID_NexusTraversalCutAge, GFrameCounter - GetFrontTraversal().Inputs.FrameNumber);
+        Proxy->Update();
+    }
     
     FNexusJob DoneJob;
-    TQueue<FNexusJob>& FinishedJobs = JobExecutor->GetJobsDone();
-    while (FinishedJobs.Dequeue(DoneJob))
+    while (JobsDone->Dequeue(DoneJob))
     {
+        if (!DoneJob.NodeData || DoneJob.PinnedNodeData != NexusLoadedAsset->PinNodeData(DoneJob.NodeIndex))
+        {
+            // Nothing was read, or the node was unloaded while it was decoding, the traversal requests it again
+            if (NodeStatuses[DoneJob.NodeIndex] == ENodeStatus::Pending && !NexusLoadedAsset->PinNodeData(DoneJob.NodeIndex))
+            {
+                SetNodeStatus(DoneJob.NodeIndex, ENodeStatus::Dropped);
+            }
+            continue;
+        }
+        if (NodeStatuses[DoneJob.NodeIndex] != ENodeStatus::Pending) continue;
         SetNodeStatus(DoneJob.NodeIndex, ENodeStatus::Loaded);
-        Proxy->LoadGPUData(DoneJob.NodeIndex);
+        if (DoneJob.Occluder && OccluderMeshes.IsValidIndex(DoneJob.NodeIndex))
+        {
+            OccluderMeshes[DoneJob.NodeIndex] = DoneJob.Occluder;
+        }
+        Proxy->LoadGPUData(DoneJob.NodeIndex, DoneJob.Streams);
+    }
+    Proxy->UploadScheduler.Flush();
+
+    if (!TraversalTask.IsValid())
+    {
+        UpdateCameraView();
+        if (IsPublishedTraversalCurrent())
+        {
+            // Nothing the traversal depends on changed, it would select the same cut
+            INC_DWORD_STAT(STATID_NexusSkippedTraversals);
+        }
+        else
+        {
+            LaunchTraversal();
+        }
     }
 }
 
 uint64 UUnrealNexusComponent::GetNodeSize(const uint32 NodeID) const
 {
-    auto& Node = NexusLoadedAsset->Nodes[NodeID];
-    auto& NextNode = NexusLoadedAsset->Nodes[NodeID + 1];
-    return (NextNode.NexusNode.getBeginOffset() - Node.NexusNode.getBeginOffset());
+    const Node& TheNode = NexusLoadedAsset->Nodes[NodeID].NexusNode;
+    const uint64 FileSize = NexusLoadedAsset->Nodes[NodeID + 1].NexusNode.getBeginOffset() - TheNode.getBeginOffset();
+    if (!UsesCompactVertices()) return FileSize;
+
+    // DrawBudget keeps its units, the compact nodes just take less of it
+    Signature& TheSig = NexusLoadedAsset->Header.signature;
+    const uint64 FullGPUSize = FMath::Max<uint64>(NexusGeometryPool::GetNodeGPUSize(TheSig, TheNode, false), 1);
+    return FileSize * NexusGeometryPool::GetNodeGPUSize(TheSig, TheNode, true) / FullGPUSize;
+}
+
+bool UUnrealNexusComponent::UsesCompactVertices() const
+{
+    // With manual vertex fetch FLocalVertexFactory reads the positions from their SRV as three floats,
+    // only the vertex declaration path decodes the normalized int16 positions
+    return bUseCompactVertices && !RHISupportsManualVertexFetch(GMaxRHIShaderPlatform);
 }
 
 void UUnrealNexusComponent::UnloadNode(uint32 UnloadedNodeID)
 {
     NexusLoadedAsset->UnloadNode(UnloadedNodeID);
     SetNodeStatus(UnloadedNodeID, ENodeStatus::Dropped);
+    if (OccluderMeshes.IsValidIndex(UnloadedNodeID))
+    {
+        // The traversal may still be rasterizing it, it keeps its own reference
+        OccluderMeshes[UnloadedNodeID].Reset();
+    }
 }
 
 void UUnrealNexusComponent::RequestNode(const uint32 BestNodeID)
 {
-    NexusLoadedAsset->LoadNodeAsync(BestNodeID, FStreamableDelegate::CreateLambda([&, BestNodeID]()
+    const float Priority = GetErrorForNode(BestNodeID);
+    INC_MEMORY_STAT_BY(STATID_NexusStreamedNodeBytes, NexusLoadedAsset->Nodes[BestNodeID + 1].NexusNode.getBeginOffset() - NexusLoadedAsset->Nodes[BestNodeID].NexusNode.getBeginOffset());
+    NexusLoadedAsset->LoadNodeAsync(BestNodeID, FStreamableDelegate::CreateLambda([&, BestNodeID, Priority]()
     {
         // Two passes: 1) Load the Unreal node data
         if (IsNodeLoaded(BestNodeID)) return;
-        const auto UCurrentNodeData = NexusLoadedAsset->GetNode(BestNodeID);
+        const auto UCurrentNodeData = NexusLoadedAsset->GetNodeData(BestNodeID);
         auto* UCurrentNode = &NexusLoadedAsset->Nodes[BestNodeID];
 
-        // 2) Decode it in a separate thread
-        JobExecutor->AddNewJobs( {FNexusJob { BestNodeID, UCurrentNodeData, UCurrentNode, NexusLoadedAsset}});
+        // 2) Decode it on the shared decoding pool
+        FNexusJobExecutor* Executor = FNexusJobExecutor::Get();
+        if (!UCurrentNodeData || !JobsDone || !Executor)
+        {
+            // Nothing to decode, the node goes back to the ones that can be requested
+            NexusLoadedAsset->UnloadNode(BestNodeID);
+            SetNodeStatus(BestNodeID, ENodeStatus::Dropped);
+            return;
+        }
+        FNexusJob Job { BestNodeID, UCurrentNodeData, UCurrentNode, NexusLoadedAsset };
+        Job.PinnedNodeData = NexusLoadedAsset->PinNodeData(BestNodeID);
+        Job.Priority = Priority;
+        Job.JobsDone = JobsDone;
+        Job.Streams = MakeShared<FNexusPreparedStreams, ESPMode::ThreadSafe>();
+        Job.Streams->bCompactVertices = UsesCompactVertices();
+        if (OccluderMeshes.IsValidIndex(BestNodeID))
+        {
+            Job.Occluder = MakeShared<FNexusOccluderMesh, ESPMode::ThreadSafe>();
+        }
+        Executor->AddNewJobs({ Job });
     }));
 }
@@ -136,8 +136,40 @@ uint32_t UUnrealNexusData::Size(const uint32_t Node)
     return Nodes[Node].NexusNode.getSize();
 }
 
+const FNexusNodeTable& UUnrealNexusData::GetNodeTable()
+{
+	if (NodeTable.Num() != Nodes.Num())
+	{
+		NodeTable.Build(Nodes);
+	}
+	return NodeTable;
+}
+
 void UUnrealNexusData::LoadNodeAsync(const uint32 NodeID, const FStreamableDelegate Callback)
 {
+	if (NodeSource == ENexusNodeSource::ContainerFile)
+	{
+		if (!ContainerFile)
+		{
+			ContainerFile = MakeUnique<FNexusContainerFile>(FPaths::Combine(FPaths::ProjectContentDir(), ContainerFilePath));
+		}
+		if (ContainerFile->IsNodeRequested(NodeID)) return;
+		
+		Node& TheNode = Nodes[NodeID].NexusNode;
+		// nx::Node::getSize reads the next node, which isn't contiguous in FUnrealNexusNode
+		const int64 NodeSize = Nodes[NodeID + 1].NexusNode.getBeginOffset() - TheNode.getBeginOffset();
+		TWeakObjectPtr<UUnrealNexusData> WeakThis(this);
+		ContainerFile->RequestNode(NodeID, TheNode.getBeginOffset(), NodeSize, [WeakThis, NodeID, Callback](const uint32 RequestSerial)
+		{
+			// The node might have been unloaded while it was being read, or unloaded and requested again
+			if (!WeakThis.IsValid() || !WeakThis->ContainerFile || !WeakThis->ContainerFile->IsCurrentRequest(NodeID, RequestSerial)) return;
+			if(!Callback.ExecuteIfBound()) {
+				// Log this
+			}
+		});
+		return;
+	}
+	
 	if (NodeHandles.Contains(NodeID))
 	{
 		auto& Handle = NodeHandles[NodeID];
@@ -157,7 +189,16 @@ void UUnrealNexusData::LoadNodeAsync(const uint32 NodeID, const FStreamableDeleg
 }
 
 void UUnrealNexusData::UnloadNode(const int NodeID)
-{	
+{
+	if (NodeSource == ENexusNodeSource::ContainerFile)
+	{
+		if (ContainerFile)
+		{
+			ContainerFile->ReleaseNode(NodeID);
+		}
+		return;
+	}
+	
 	if(!NodeHandles.Contains(NodeID)) return;
 	
 	const FSoftObjectPath NodePath = Nodes[NodeID].NodeDataPath;
@@ -167,19 +208,32 @@ void UUnrealNexusData::UnloadNode(const int NodeID)
 
 void UUnrealNexusData::LoadTextureForNode(const uint32 NodeID, FStreamableDelegate Callback)
 {
-	if (NodeHandles.Contains(NodeID))
+	if (TextureSource == ENexusTextureSource::CompressedImages)
 	{
-		auto& Handle = NodeHandles[NodeID];
-		if (Handle->HasLoadCompleted())
+		if (DecodedTextures.Contains(NodeID))
 		{
-			if(!Callback.ExecuteIfBound()) {
-				// Log this
-			}
+			Callback.ExecuteIfBound();
+			return;
+		}
+		RequestTextureImage(NodeID);
+		return;
+	}
+	
+	const TSharedPtr<FStreamableHandle>* TextureHandle = NodeTexturesHandles.Find(NodeID);
+	if (TextureHandle && (*TextureHandle)->HasLoadCompleted())
+	{
+		if(!Callback.ExecuteIfBound()) {
+			// Log this
 		}
 	} else
 	{
 		const FSoftObjectPath NodePath = NodeTexturesPaths[NodeID];
 		check(NodePath.IsValid());
+		if (IsInGameThread())
+		{
+			NodeTexturesHandles.Add(NodeID, GetStreamableManager().RequestAsyncLoad({NodePath}, Callback));
+			return;
+		}
 		AsyncTask(ENamedThreads::GameThread, [NodePath, Callback, NodeID, this]() {
 			const auto Handle = GetStreamableManager().RequestAsyncLoad({NodePath}, Callback);
 			NodeTexturesHandles.Add(NodeID, Handle);
@@ -189,21 +243,195 @@ void UUnrealNexusData::LoadTextureForNode(const uint32 NodeID, FStreamableDelega
 
 UTexture* UUnrealNexusData::GetTexture(const uint32 TextureID)
 {
-	const FSoftObjectPath TexturePath = NodeTexturesPaths[TextureID];
-	if (!TexturePath.IsValid())
+	if (TextureSource == ENexusTextureSource::CompressedImages)
 	{
-		return Cast<UTexture>(GetStreamableManager().LoadSynchronous(TexturePath));
+		return DecodedTextures.FindRef(TextureID);
 	}
-	return Cast<UTexture>(TexturePath.ResolveObject());
+	// Never loads, the textures are only ever loaded asynchronously through LoadTextureForNode
+	return Cast<UTexture>(NodeTexturesPaths[TextureID].ResolveObject());
 }
 
 void UUnrealNexusData::UnloadTexture(const int NodeID)
 {
+	if (TextureSource == ENexusTextureSource::CompressedImages)
+	{
+		// A read or a decode still in flight is dropped once it completes
+		DecodingTextures.Remove(NodeID);
+		ImageOwnerHandles.Remove(NodeID);
+		DecodedTextures.Remove(NodeID);
+		return;
+	}
+	
 	const FSoftObjectPath NodePath = NodeTexturesPaths[NodeID];
 	check(NodePath.IsValid());
+	TSharedPtr<FStreamableHandle> Handle;
+	if (NodeTexturesHandles.RemoveAndCopyValue(NodeID, Handle) && Handle.IsValid() && Handle->IsLoadingInProgress())
+	{
+		Handle->CancelHandle();
+	}
 	GetStreamableManager().Unload(NodePath);
 }
 
+bool UUnrealNexusData::HasTexture(const uint32 TextureID) const
+{
+	if (!NodeTexturesPaths.IsValidIndex(TextureID)) return false;
+	return TextureSource == ENexusTextureSource::CompressedImages || NodeTexturesPaths[TextureID].IsValid();
+}
+
+bool UUnrealNexusData::IsTextureLoaded(const uint32 TextureID) const
+{
+	if (TextureSource == ENexusTextureSource::CompressedImages)
+	{
+		return DecodedTextures.Contains(TextureID);
+	}
+	const TSharedPtr<FStreamableHandle>* Handle = NodeTexturesHandles.Find(TextureID);
+	return Handle && (*Handle)->HasLoadCompleted();
+}
+
+void UUnrealNexusData::GetOwnedTextures(const uint32 NodeID, TArray<uint32, TInlineAllocator<4>>& OutTextures)
+{
+	for (const Patch& NodePatch : Nodes[NodeID].NodePatches)
+	{
+		if (GetTextureOwner(NodePatch.texture) == static_cast<int32>(NodeID))
+		{
+			OutTextures.AddUnique(NodePatch.texture);
+		}
+	}
+}
+
+int32 UUnrealNexusData::GetTextureOwner(const uint32 TextureID)
+{
+	if (TextureOwners.Num() != NodeTexturesPaths.Num())
+	{
+		TextureOwners.Init(INDEX_NONE, NodeTexturesPaths.Num());
+		for (int32 N = 0; N < Nodes.Num(); N ++)
+		{
+			for (const Patch& NodePatch : Nodes[N].NodePatches)
+			{
+				if (TextureOwners.IsValidIndex(NodePatch.texture) && TextureOwners[NodePatch.texture] == INDEX_NONE)
+				{
+					TextureOwners[NodePatch.texture] = N;
+				}
+			}
+		}
+	}
+	return TextureOwners.IsValidIndex(TextureID) ? TextureOwners[TextureID] : INDEX_NONE;
+}
+
+void UUnrealNexusData::RequestTextureImage(const uint32 TextureID)
+{
+	if (DecodingTextures.Contains(TextureID)) return;
+	
+	if (NodeSource == ENexusNodeSource::ContainerFile)
+	{
+		if (!ContainerFile)
+		{
+			ContainerFile = MakeUnique<FNexusContainerFile>(FPaths::Combine(FPaths::ProjectContentDir(), ContainerFilePath));
+		}
+		if (!TextureImageOffsets.IsValidIndex(TextureID + 1)) return;
+		DecodingTextures.Add(TextureID);
+		const int64 Offset = TextureImageOffsets[TextureID];
+		TWeakObjectPtr<UUnrealNexusData> WeakThis(this);
+		ContainerFile->RequestImage(TextureID, Offset, TextureImageOffsets[TextureID + 1] - Offset, [WeakThis, TextureID]()
+		{
+			if (!WeakThis.IsValid() || !WeakThis->ContainerFile) return;
+			FNexusTextureImage Image;
+			// Taken even if the texture was unloaded meanwhile, a later request reads it again
+			if (!WeakThis->ContainerFile->TakeImage(TextureID, Image) || !WeakThis->DecodingTextures.Contains(TextureID)) return;
+			WeakThis->QueueImageDecoding(MoveTemp(Image));
+		});
+		return;
+	}
+
+	// The image is stored in the asset of the first node using the texture, which might not be loaded
+	const int32 OwnerID = GetTextureOwner(TextureID);
+	if (OwnerID == INDEX_NONE) return;
+	const FSoftObjectPath OwnerPath = Nodes[OwnerID].NodeDataPath;
+	if (!OwnerPath.IsValid()) return;
+	DecodingTextures.Add(TextureID);
+	ImageOwnerHandles.Add(TextureID, GetStreamableManager().RequestAsyncLoad({OwnerPath}, FStreamableDelegate::CreateWeakLambda(this, [this, TextureID, OwnerPath]()
+	{
+		if (!DecodingTextures.Contains(TextureID)) return;
+		const UUnrealNexusNodeData* Owner = Cast<UUnrealNexusNodeData>(OwnerPath.ResolveObject());
+		const FNexusTextureImage* Image = Owner ? Owner->GetTextureImages().FindByPredicate([TextureID](const FNexusTextureImage& Candidate)
+		{
+			return Candidate.TextureID == TextureID;
+		}) : nullptr;
+		if (!Image)
+		{
+			UE_LOG(NexusErrors, Error, TEXT("Could not find the image of texture %d"), TextureID);
+			DecodingTextures.Remove(TextureID);
+			ImageOwnerHandles.Remove(TextureID);
+			return;
+		}
+		QueueImageDecoding(FNexusTextureImage(*Image));
+	})));
+}
+
+void UUnrealNexusData::QueueImageDecoding(FNexusTextureImage&& Image)
+{
+	FNexusJobExecutor* Executor = FNexusJobExecutor::Get();
+	if (!Executor)
+	{
+		DecodingTextures.Remove(Image.TextureID);
+		ImageOwnerHandles.Remove(Image.TextureID);
+		return;
+	}
+	if (!ImageJobsDone)
+	{
+		ImageJobsDone = MakeShared<FNexusJobsDoneQueue, ESPMode::ThreadSafe>();
+	}
+	FNexusJob Job;
+	Job.NodeIndex = Image.TextureID;
+	Job.NodeData = nullptr;
+	Job.Node = nullptr;
+	Job.Data = this;
+	// Only the nodes already drawn use a texture, decode it before loading anything else
+	Job.Priority = MAX_flt;
+	Job.TextureImages.Add(MoveTemp(Image));
+	Job.JobsDone = ImageJobsDone;
+	TArray<FNexusJob> Jobs;
+	Jobs.Add(MoveTemp(Job));
+	Executor->AddNewJobs(MoveTemp(Jobs));
+}
+
+void UUnrealNexusData::UpdateDecodedTextures()
+{
+	if (!ImageJobsDone) return;
+	FNexusJob DoneJob;
+	while (ImageJobsDone->Dequeue(DoneJob))
+	{
+		ImageOwnerHandles.Remove(DoneJob.NodeIndex);
+		// Unloaded while it was decoding
+		if (DecodingTextures.Remove(DoneJob.NodeIndex) == 0) continue;
+		for (const FNexusDecodedTexture& Decoded : DoneJob.DecodedTextures)
+		{
+			UTexture2D* Texture = UTexture2D::CreateTransient(Decoded.Width, Decoded.Height, PF_B8G8R8A8);
+			if (Texture == nullptr) continue;
+			
+			// CreateTransient only makes the first mip, the rest of the chain was filtered by the worker
+			for (int32 Mip = 0; Mip < Decoded.Mips.Num(); Mip ++)
+			{
+				if (Mip > 0)
+				{
+					FTexture2DMipMap* MipMap = new FTexture2DMipMap();
+					MipMap->SizeX = FMath::Max(Decoded.Width >> Mip, 1);
+					MipMap->SizeY = FMath::Max(Decoded.Height >> Mip, 1);
+					Texture->PlatformData->Mips.Add(MipMap);
+				}
+				FByteBulkData& MipData = Texture->PlatformData->Mips[Mip].BulkData;
+				MipData.Lock(LOCK_READ_WRITE);
+				void* Pixels = MipData.Realloc(Decoded.Mips[Mip].Num());
+				FMemory::Memcpy(Pixels, Decoded.Mips[Mip].GetData(), Decoded.Mips[Mip].Num());
+				MipData.Unlock();
+			}
+			Texture->SRGB = true;
+			Texture->UpdateResource();
+			DecodedTextures.Add(Decoded.TextureID, Texture);
+		}
+	}
+}
+
 UUnrealNexusNodeData* UUnrealNexusData::GetNode(const uint32 NodeId)
 {
 	const FSoftObjectPath NodePath = Nodes[NodeId].NodeDataPath;
@@ -214,6 +442,33 @@ UUnrealNexusNodeData* UUnrealNexusData::GetNode(const uint32 NodeId)
 	return Cast<UUnrealNexusNodeData>(NodePath.ResolveObject());
 }
 
+INexusNodeData* UUnrealNexusData::GetNodeData(const uint32 NodeId)
+{
+	if (NodeSource == ENexusNodeSource::ContainerFile)
+	{
+		return ContainerFile ? ContainerFile->GetNode(NodeId) : nullptr;
+	}
+	return GetNode(NodeId);
+}
+
+TSharedPtr<INexusNodeData, ESPMode::ThreadSafe> UUnrealNexusData::PinNodeData(const uint32 NodeId) const
+{
+	if (NodeSource != ENexusNodeSource::ContainerFile || !ContainerFile) return nullptr;
+	return ContainerFile->PinNode(NodeId);
+}
+
+void UUnrealNexusData::BeginDestroy()
+{
+	Super::BeginDestroy();
+	// The pool exists if anything was ever queued
+	FNexusJobExecutor* Executor = ImageJobsDone ? FNexusJobExecutor::Get() : nullptr;
+	if (Executor)
+	{
+		Executor->CancelJobs(ImageJobsDone);
+	}
+	ContainerFile.Reset();
+}
+
 void UUnrealNexusData::Serialize(FArchive& Archive)
 {
 	Super::Serialize(Archive);
@@ -2,36 +2,97 @@
 #include "UnrealNexusData.h"
 
 #include "NexusCommons.h"
+#include "NexusCustomVersion.h"
+
+DECLARE_CYCLE_STAT(TEXT("Node Payload Serialization"), STATID_NexusNodeSerialization, STATGROUP_NexusLoading);
+DECLARE_CYCLE_STAT(TEXT("Node Decoding"), STATID_NexusNodeDecoding, STATGROUP_NexusLoading);
 
 void UUnrealNexusNodeData::DecodeData(Header& Header, const int VertsCount, const int FacesCount)
 {
     if (DidDecodeData) return;
-    LoadUtils::LoadNodeData(Header, VertsCount, FacesCount, NexusNodeData, NodeSize, UncompressedTexture);
+    SCOPE_CYCLE_COUNTER(STATID_NexusNodeDecoding);
+    const uint8* Payload = static_cast<const uint8*>(NodePayload.LockReadOnly());
+    LoadUtils::LoadNodeData(Header, VertsCount, FacesCount, NexusNodeData, Payload, NodeSize, DecodedMemory, UncompressedTexture);
+    NodePayload.Unlock();
     DidDecodeData = true;
 }
 
-void UUnrealNexusNodeData::SerializeNodeData(FArchive& Archive, nx::NodeData& NodeData)
+void UUnrealNexusNodeData::SetTangentFrames(const TArrayView<const FPackedNormal> InTangentFrames)
 {
-    Archive << NodeSize;
+    TangentFrames = InTangentFrames;
+}
+
+void UUnrealNexusNodeData::AddTextureImage(const uint32 TextureID, const uint8* Data, const uint32 Size)
+{
+    FNexusTextureImage& Image = TextureImages.AddDefaulted_GetRef();
+    Image.TextureID = TextureID;
+    Image.Bytes.Append(Data, Size);
+}
+
+void UUnrealNexusNodeData::SetNodePayload(const uint8* Data, const uint32 Size, const bool bMemoryMapped)
+{
+    NodeSize = Size;
+    NodePayload.Lock(LOCK_READ_WRITE);
+    void* Dest = NodePayload.Realloc(Size);
+    FMemory::Memcpy(Dest, Data, Size);
+    NodePayload.Unlock();
 
-    // TODO: Replace with TArray<char>
-    if (NodeData.memory == nullptr)
+    // Memory mapping only applies to cooked payloads stored outside of the export data
+    if (bMemoryMapped)
+    {
+        NodePayload.SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload | BULKDATA_MemoryMappedPayload);
+    } else
     {
-        // Deserializing: Allocate memory
-        NodeData.memory = new char[NodeSize];
+        NodePayload.ClearBulkDataFlags(BULKDATA_Force_NOT_InlinePayload | BULKDATA_MemoryMappedPayload);
     }
-    
+}
+
+void UUnrealNexusNodeData::SerializeLegacyNodeData(FArchive& Archive)
+{
+    // Before NodeDataAsBulkData every byte of the payload was written as an uint16
+    Archive << NodeSize;
+    TArray<uint8> Payload;
+    Payload.SetNumUninitialized(NodeSize);
     for (uint32 i = 0; i < NodeSize; i ++)
     {
-        uint16 Index = NodeData.memory[i];
-        Archive << Index;
-        NodeData.memory[i] = Index;
+        uint16 Byte;
+        Archive << Byte;
+        Payload[i] = static_cast<uint8>(Byte);
+    }
+    SetNodePayload(Payload.GetData(), NodeSize);
+}
+
+void UUnrealNexusNodeData::SerializeNodeData(FArchive& Archive)
+{
+    SCOPE_CYCLE_COUNTER(STATID_NexusNodeSerialization);
+    if (Archive.IsLoading() && Archive.CustomVer(FNexusCustomVersion::GUID) < FNexusCustomVersion::NodeDataAsBulkData)
+    {
+        SerializeLegacyNodeData(Archive);
+        return;
+    }
+
+    Archive << NodeSize;
+    NodePayload.Serialize(Archive, this);
+    if (!Archive.IsLoading() || Archive.CustomVer(FNexusCustomVersion::GUID) >= FNexusCustomVersion::NodeTangentFrames)
+    {
+        TangentFrames.BulkSerialize(Archive);
+    }
+    if (!Archive.IsLoading() || Archive.CustomVer(FNexusCustomVersion::GUID) >= FNexusCustomVersion::NodeTextureImages)
+    {
+        Archive << TextureImages;
+    }
+
+    // Pull the payload in while we are still on the async loading thread,
+    // memory mapped payloads are already resident
+    if (Archive.IsLoading() && !NodePayload.IsBulkDataLoaded())
+    {
+        NodePayload.ForceBulkDataResident();
     }
-    
 }
 
 void UUnrealNexusNodeData::Serialize(FArchive& Archive)
 {
     Super::Serialize(Archive);
-    SerializeNodeData(Archive, NexusNodeData);
+    Archive.UsingCustomVersion(FNexusCustomVersion::GUID);
+    SerializeNodeData(Archive);
 }
@@ -8,323 +8,170 @@
 #include "NexusJobExecutorThread.h"
 #include "Animation/AnimCompress.h"
 #include "Materials/MaterialInstance.h"
+#include "ContentStreaming.h"
 
 using namespace NexusCommons;
 
 DECLARE_STATS_GROUP(TEXT("Unreal Nexus Render Proxy"), STATGROUP_NexusRenderer, STATCAT_Advanced);
 DECLARE_CYCLE_STAT(TEXT("Unreal Nexus Render Update Statistics"), STATID_NexusRenderer, STATGROUP_NexusRenderer)
 DECLARE_CYCLE_STAT(TEXT("Unreal Nexus Render Node Selection Statistics"), STATID_NexusNodeSelection, STATGROUP_NexusRenderer)
-
-template <class T>
-FVertexBufferRHIRef CreateBufferAndFillWithData(const T* Data, const SIZE_T Size)
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Backfacing Nodes Culled"), STATID_NexusBackfacingNodesCulled, STATGROUP_NexusRenderer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Prefetch Requests"), STATID_NexusPrefetchRequests, STATGROUP_NexusRenderer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Prefetch Hits"), STATID_NexusPrefetchHits, STATGROUP_NexusRenderer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Prefetch Misses"), STATID_NexusPrefetchMisses, STATGROUP_NexusRenderer);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Prefetch Hit Rate (%)"), STATID_NexusPrefetchHitRate, STATGROUP_NexusRenderer);
+
+FNexusNodeRenderData::FNexusNodeRenderData(const FNexusGeometryAllocation& InAllocation, const FVector4& InDequantization, const uint32 InNumPrimitives)
+    : Allocation(InAllocation),
+        Dequantization(InDequantization),
+        NumPrimitives(InNumPrimitives)
 {
-    FRHIResourceCreateInfo CreateInfo;
-    FVertexBufferRHIRef Buffer = RHICreateVertexBuffer(Size, BUF_Static | BUF_ShaderResource, CreateInfo);
-    void* Pointer = RHILockVertexBuffer(Buffer, 0, Size, RLM_WriteOnly);
-    FMemory::Memcpy(Pointer, Data, Size);
-    RHIUnlockVertexBuffer(Buffer);
-    return Buffer;
 }
 
-FNexusNodeRenderData::FNexusNodeRenderData(const FUnrealNexusProxy* Proxy, NodeData& Data, Node& Node, UMaterialInstanceDynamic* InInstancedMaterial)
-    : NodeVertexFactory(Proxy->GetScene().GetFeatureLevel(), "NexusNodeVertexFactory"),
-        InstancedMaterial(InInstancedMaterial)
+bool FUnrealNexusProxy::IsContainedInFrustum(const FConvexVolume& Frustum, const FVector& Translation, const FVector& SphereCenter, const float SphereRadius) const
 {
-    check(IsInRenderingThread());
-    
-    Signature& TheSig = Proxy->ComponentData->Header.signature;
-    NumPrimitives = Node.nface;
-    CreatePositionBuffer(Node, Data);
-    CreateIndexBuffer(TheSig, Node, Data);
-
-    InitColorBuffer(Proxy, TheSig, Data, Node);
-    InitTexBuffer(Proxy,  TheSig, Data, Node);
-    InitTangentsBuffer(Proxy, TheSig, Data, Node);
-    InitVertexFactory();
+    const FMatrix& LocalToWorld = GetLocalToWorld();
+    return Frustum.IntersectSphere(LocalToWorld.TransformPosition(SphereCenter) + Translation, SphereRadius * LocalToWorld.GetMaximumAxisScale());
 }
 
-void FNexusNodeRenderData::CreateIndexBuffer(Signature& Sig, Node& Node,  nx::NodeData& Data)
+void FNexusRenderCut::Init(const int32 NodesCount)
 {
-    check(Sig.face.hasIndex())
-    uint16* FaceIndices = Data.faces(Sig, Node.nvert);
-    const SIZE_T IndicesCount = Node.nface * 3;
-    
-    FRHIResourceCreateInfo Info;
-    IndexBuffer.IndexBufferRHI = RHICreateIndexBuffer(sizeof(uint16), IndicesCount * sizeof(uint16) , BUF_Static, Info);
-    void* Pointer = RHILockIndexBuffer(IndexBuffer.IndexBufferRHI, 0, IndicesCount * sizeof(uint16), RLM_WriteOnly);
-    FMemory::Memcpy(Pointer, FaceIndices, IndicesCount * sizeof(uint16));
-    RHIUnlockIndexBuffer(IndexBuffer.IndexBufferRHI);
-    BeginInitResource(&IndexBuffer);
+    SelectedStamps.Init(0, NodesCount);
+    SelectedNodes.Reset();
+    Generation = 1;
 }
 
-void FNexusNodeRenderData::CreatePositionBuffer(nx::Node& Node, nx::NodeData& Data)
+void FNexusRenderCut::Update(TArray<uint32>&& InSelectedNodes, const bool bInCullBackfaces)
 {
-    TArray<FVector> Vertices;
-    Vertices.SetNum(Node.nvert);
-    for (int i = 0; i < Node.nvert; i++)
+    Generation ++;
+    if (Generation == 0)
     {
-        vcg::Point3f Point = Data.coords()[i];
-        const FVector Vertex{ Point.X(), Point.Z(), Point.Y()  };
-        Vertices[i] = Vertex;
+        Init(SelectedStamps.Num());
     }
-
-    PositionBuffer.VertexBufferRHI = CreateBufferAndFillWithData(Vertices.GetData(), Vertices.Num() * sizeof(FVector));
-    PositionBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(PositionBuffer.VertexBufferRHI, PF_R32_FLOAT));
-    BeginInitResource(&PositionBuffer);
+    SelectedNodes = MoveTemp(InSelectedNodes);
+    for (const uint32 SelectedID : SelectedNodes)
+    {
+        SelectedStamps[SelectedID] = Generation;
+    }
+    bCullBackfaces = bInCullBackfaces;
 }
 
-
-void FNexusNodeRenderData::InitColorBuffer(const FUnrealNexusProxy* Proxy, Signature& TheSig, NodeData& Data, Node& Node)
+FUnrealNexusProxy::FUnrealNexusProxy(UUnrealNexusComponent* TheComponent, const int InMaxPending)
+    : FPrimitiveSceneProxy(static_cast<UPrimitiveComponent*>(TheComponent)),
+        ComponentData(TheComponent->NexusLoadedAsset),
+        Component(TheComponent),
+        UploadScheduler(this),
+        MaxPending(InMaxPending)
 {
-    bHasColors = TheSig.vertex.hasColors();
-    if (bHasColors)
+    bCompactVertices = Component->UsesCompactVertices();
+    bCanCullBackfaces = Component->ModelMaterial == nullptr || !Component->ModelMaterial->IsTwoSided();
+    SetWireframeColor(FLinearColor::Green);
+
+    const int32 NodesCount = ComponentData ? ComponentData->Nodes.Num() : 0;
+    ResidentNodes.Init(NodesCount);
+    CandidateNodes.Init(NodesCount);
+    PrefetchNodes.Init(NodesCount);
+    ScheduledNodes.Init(NodesCount);
+    LastUsedFrames.Init(0, NodesCount);
+    NodeAllocations.SetNum(NodesCount);
+    RenderCut.Init(NodesCount);
+    ShadowCut.Init(NodesCount);
+    if (ComponentData && ComponentData->Header.signature.vertex.hasTextures() && Component->ModelMaterial != nullptr)
     {
-        ColorBuffer.VertexBufferRHI = CreateBufferAndFillWithData(Data.colors(TheSig, Node.nvert), Node.nvert * sizeof(FColor));
-        ColorBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(ColorBuffer.VertexBufferRHI, PF_R8G8B8A8));
-        BeginInitResource(&ColorBuffer);
+        TextureResidency.Init(ComponentData);
     }
+
+    MaterialProxy = Component->ModelMaterial == nullptr ?
+                    UMaterial::GetDefaultMaterial(MD_Surface)->GetRenderProxy() : Component->ModelMaterial->GetRenderProxy();
 }
 
-void FNexusNodeRenderData::InitTexBuffer(const FUnrealNexusProxy* Proxy, Signature& TheSig, NodeData& Data, Node& Node)
+void FUnrealNexusProxy::AddCandidate(uint32 CandidateID, float FirstNodeError)
 {
-    if (TheSig.vertex.hasTextures()) {
-        TexCoordsBuffer.VertexBufferRHI = CreateBufferAndFillWithData(Data.texCoords(TheSig, Node.nvert), Node.nvert * sizeof(vcg::Point2f));
-    } else {
-        TArray<FVector2D> TexCoords;
-        TexCoords.SetNum(Node.nvert);
-        UE_LOG(NexusInfo, Display, TEXT("This node has no textures"));
-        FMemory::Memset(TexCoords.GetData(), 0, TexCoords.Num() * sizeof(FVector2D));
-        TexCoordsBuffer.VertexBufferRHI = CreateBufferAndFillWithData(TexCoords.GetData(), TexCoords.Num() * sizeof(FVector2D));
-    }
-    TexCoordsBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(TexCoordsBuffer.VertexBufferRHI, PF_G32R32F));
-    BeginInitResource(&TexCoordsBuffer);
+    CandidateNodes.Push(CandidateID, FirstNodeError);
 }
 
-void FNexusNodeRenderData::CalculateTangents(TArray<FPackedNormal>& OutTangents, Signature& TheSig,  NodeData& Data, Node& Node)
+float FUnrealNexusProxy::GetCacheError(const uint32 NodeID) const
 {
-    TArray<FVector> T;
-    TArray<FVector> TSums;
-    TArray<int> Counts;
-    
-    Counts.SetNum(Node.nvert);
-    T.SetNum(Node.nface);
-    TSums.SetNum(Node.nvert);
-    
-    vcg::Point3f* Vertices = Data.coords();
-    vcg::Point3s* Normals = Data.normals(TheSig, Node.nvert);
-    vcg::Point2f* TexCoords = Data.texCoords(TheSig, Node.nvert);
-    uint16* Indices = Data.faces(TheSig, Node.nvert);
+    const float Error = Component->GetErrorForNode(NodeID);
+    const FNexusScheduledNode* Upcoming = ProtectedUpcomingNodes.Contains(NodeID) ? UpcomingNodes.Find(NodeID) : nullptr;
+    const FNexusScheduledNode* Predicted = PredictedNodes.Find(NodeID);
+    return FMath::Max3(Error, Upcoming ? Upcoming->Error : 0.0f, Predicted ? Predicted->Error : 0.0f);
+}
 
-    auto Point3SToVector = [](const vcg::Point3s Point) -> FVector
-    {
-        return FVector(Point.X(), Point.Z(), Point.Y());
-    };
-    
-    auto Point3FToVector = [](const vcg::Point3f Point) -> FVector
-    {
-        return FVector(Point.X(), Point.Z(), Point.Y());
-    };
-    
-    auto Point2FToVector = [](const vcg::Point2f Point) -> FVector2D
+void FUnrealNexusProxy::UpdateResidentPriorities()
+{
+    // Once their time came the traversal sees them, and their current error takes over
+    for (auto It = UpcomingNodes.CreateIterator(); It; ++It)
     {
-        return FVector2D(Point.X(), Point.Y());
-    };
-    
-    // Step 1: Find per-face T Vectors
-    for (uint32 Index = 0; Index < Node.nface; Index += 3)
+        if (It.Value().Time < Component->ScheduleTime)
+        {
+            It.RemoveCurrent();
+        }
+    }
+    // A long schedule would otherwise keep growing the cache past its budget, the latest nodes wait for their turn
+    TArray<const FNexusScheduledNode*> UpcomingOrder;
+    UpcomingOrder.Reserve(UpcomingNodes.Num());
+    for (const auto& Entry : UpcomingNodes)
     {
-        const uint32 Index1 = Indices[Index + 0];
-        const uint32 Index2 = Indices[Index + 1];
-        const uint32 Index3 = Indices[Index + 2];
-
-        Counts[Index1] ++;
-        Counts[Index2] ++;
-        Counts[Index3] ++;
-        
-        FVector Vertex1 =  Point3FToVector(Vertices[Index1]);
-        FVector Vertex2 =  Point3FToVector(Vertices[Index2]);
-        FVector Vertex3 =  Point3FToVector(Vertices[Index3]);
-        
-        FVector2D TexCoord1 =  Point2FToVector(TexCoords[Index1]);
-        FVector2D TexCoord2 =  Point2FToVector(TexCoords[Index2]);
-        FVector2D TexCoord3 =  Point2FToVector(TexCoords[Index3]);
-
-        FVector Edge21 = Vertex2 - Vertex1;
-        FVector Edge31 = Vertex3 - Vertex1;
-
-        const FVector2D TexEdge21 = TexCoord2 - TexCoord1;
-        const FVector2D TexEdge31 = TexCoord3 - TexCoord1;
-        
-        T[Index] = (TexEdge21.Y != 0.0f ? Edge21 / TexEdge21.Y : Edge31 / TexEdge31.Y).GetSafeNormal();
-        
-        TSums[Index1] += T[Index];
-        TSums[Index2] += T[Index];
-        TSums[Index3] += T[Index];
-
-        Counts[Index1] ++;
-        Counts[Index2] ++;
-        Counts[Index3] ++;
+        UpcomingOrder.Add(&Entry.Value);
     }
-    
-    for (uint32 Index = 0; Index < Node.nvert; Index ++)
+    UpcomingOrder.Sort([](const FNexusScheduledNode& A, const FNexusScheduledNode& B) { return A.Time < B.Time; });
+    ProtectedUpcomingNodes.Reset();
+    uint64 ProtectedSize = 0;
+    for (const FNexusScheduledNode* Upcoming : UpcomingOrder)
     {
-        FVector CalculatedTangentPerVertex = TSums[Index] / Counts[Index];
-        OutTangents[Index * 2 + 0] = FPackedNormal(CalculatedTangentPerVertex.GetSafeNormal());
-        OutTangents[Index * 2 + 1] = FPackedNormal(Point3SToVector(Normals[Index]).GetSafeNormal());
+        ProtectedSize += Component->GetNodeSize(Upcoming->NodeID);
+        if (ProtectedSize > static_cast<uint64>(Component->DrawBudget)) break;
+        ProtectedUpcomingNodes.Add(Upcoming->NodeID);
     }
-}
-
-void FNexusNodeRenderData::InitTangentsBuffer(const FUnrealNexusProxy* Proxy, Signature& TheSig, NodeData& Data, Node& Node)
-{
-
-    TArray<FPackedNormal> Tangents;
-    Tangents.SetNum(Node.nvert * 2);
-    CalculateTangents(Tangents, TheSig, Data, Node);
-    TangentBuffer.VertexBufferRHI = CreateBufferAndFillWithData<void>(Tangents.GetData(), Node.nvert * 2 * sizeof(FPackedNormal));
-    TangentBuffer.ShaderResourceViewRHI = RHICreateShaderResourceView(FShaderResourceViewInitializer(TangentBuffer.VertexBufferRHI, PF_R8G8B8A8_SNORM));
-    BeginInitResource(&TangentBuffer);
-}
-
-void FNexusNodeRenderData::InitVertexFactory()
-{
-
-    struct FFactoryInitParams
+    // Same once the cameras had the time to get where they were predicted
+    const float Now = Component->GetWorld()->GetTimeSeconds();
+    for (auto It = PredictedNodes.CreateIterator(); It; ++It)
     {
-        FLocalVertexFactory* VertexFactory;
-        FVertexBufferWithSRV* PositionBuffer;
-        FVertexBufferWithSRV* TexCoordsBuffer;
-        FVertexBufferWithSRV* TangentBuffer;
-        FVertexBuffer* ColorBuffer;
-        FRHIShaderResourceView* ColorBufferSRV;
-        // All the other members
-    } Params;
-    
-    Params.VertexFactory = &NodeVertexFactory;
-    Params.PositionBuffer = &PositionBuffer;
-    Params.TexCoordsBuffer = &TexCoordsBuffer;
-    Params.TangentBuffer = &TangentBuffer;
-    Params.ColorBuffer = bHasColors ? static_cast<FVertexBuffer*>(&ColorBuffer) : &GNullColorVertexBuffer;
-    Params.ColorBufferSRV = bHasColors ? ColorBuffer.ShaderResourceViewRHI : GNullColorVertexBuffer.VertexBufferSRV;
-    
-    ENQUEUE_RENDER_COMMAND(NodeInitVertexFactory)([Params](FRHICommandListImmediate& Commands)
+        if (It.Value().Time < Now)
         {
-            FLocalVertexFactory::FDataType Data;
-            Data.PositionComponent = FVertexStreamComponent(
-                Params.PositionBuffer,
-                0,
-                sizeof(FVector),
-                VET_Float3
-            );
-            Data.PositionComponentSRV = Params.PositionBuffer->ShaderResourceViewRHI;
-
-            Data.TextureCoordinates.Add(FVertexStreamComponent(
-                Params.TexCoordsBuffer,
-                0,
-                sizeof(FVector2D),
-                VET_Float2
-            ));
-            Data.TextureCoordinatesSRV = Params.TexCoordsBuffer->ShaderResourceViewRHI;
-
-            Data.TangentBasisComponents[0] = FVertexStreamComponent(
-                Params.TangentBuffer,
-                0,
-                2 * sizeof(FPackedNormal),
-                VET_PackedNormal
-            );
-
-            Data.TangentBasisComponents[1] = FVertexStreamComponent(
-                Params.TangentBuffer,
-                sizeof(FPackedNormal),
-                2 * sizeof(FPackedNormal),
-                VET_PackedNormal
-            );
-            Data.TangentsSRV = Params.TangentBuffer->ShaderResourceViewRHI;
-
-            Data.LightMapCoordinateComponent = FVertexStreamComponent(
-                Params.TexCoordsBuffer,
-                0,
-                sizeof(FVector2D),
-                VET_Float2
-            );
-        
-            Data.LightMapCoordinateIndex = 0;
-            Data.NumTexCoords = 1;
-        
-            Data.ColorIndexMask = 0;
-
-            Data.ColorComponentsSRV = Params.ColorBufferSRV;
-            Data.ColorComponent = FVertexStreamComponent(
-                Params.ColorBuffer,
-                0, // Struct offset to color
-                sizeof(FColor), //asserted elsewhere
-                VET_Color,
-                (EVertexStreamUsage::ManualFetch)
-            );
-        
-            Params.VertexFactory->SetData(Data);
-            Params.VertexFactory->InitResource();
-
-        });
-}
-
-FNexusNodeRenderData::~FNexusNodeRenderData()
-{
-    BeginReleaseResource(&NodeVertexFactory);
-    BeginReleaseResource(&PositionBuffer);
-    BeginReleaseResource(&TexCoordsBuffer);
-    BeginReleaseResource(&TangentBuffer);
-    BeginReleaseResource(&IndexBuffer);
-}
-
-
-bool FUnrealNexusProxy::IsContainedInViewFrustum(const FVector& SphereCenter, const float SphereRadius) const
-{
-    return LastCameraInfo.ViewFrustum.IntersectSphere(SphereCenter, SphereRadius);
-}
-
-FUnrealNexusProxy::FUnrealNexusProxy(UUnrealNexusComponent* TheComponent, const int InMaxPending)
-    : FPrimitiveSceneProxy(static_cast<UPrimitiveComponent*>(TheComponent)),
-        ComponentData(TheComponent->NexusLoadedAsset),
-        Component(TheComponent),
-        MaxPending(InMaxPending)
-{
-    SetWireframeColor(FLinearColor::Green);
-
-    MaterialProxy = Component->ModelMaterial == nullptr ?
-                    UMaterial::GetDefaultMaterial(MD_Surface)->GetRenderProxy() : Component->ModelMaterial->GetRenderProxy();
-}
-
-void FUnrealNexusProxy::AddCandidate(uint32 CandidateID, float FirstNodeError)
-{
-    CandidateNodes.Add(FCandidateNode {CandidateID, FirstNodeError});
+            It.RemoveCurrent();
+        }
+    }
+    const bool bBreakTiesByLRU = Component->bBreakEvictionTiesByLRU;
+    ResidentNodes.Reprioritize([this, bBreakTiesByLRU](const uint32 ID)
+    {
+        const float Error = GetCacheError(ID);
+        const uint64 NodeSize = FMath::Max<uint64>(Component->GetNodeSize(ID), 1);
+        return FNexusResidentPriority { static_cast<float>(Error / NodeSize), Error, bBreakTiesByLRU ? LastUsedFrames[ID] : 0 };
+    });
 }
 
 void FUnrealNexusProxy::UnloadNode(uint32 WorstID)
 {
-    Component->UnloadNode(WorstID);
+    if (PrefetchedNodes.Remove(WorstID) > 0)
+    {
+        PrefetchMisses ++;
+        INC_DWORD_STAT(STATID_NexusPrefetchMisses);
+    }
+    PredictedNodes.Remove(WorstID);
+    // The queued upload of the node is cancelled before its data is released
     DropGPUData(WorstID);
+    Component->UnloadNode(WorstID);
 }
 
 void FUnrealNexusProxy::FreeCache(Node* BestNode, const uint64 BestNodeID)
 {
-    while (Component->CurrentCacheSize > static_cast<uint64>(Component->DrawBudget))
+    const uint64 TextureBudget = static_cast<uint64>(Component->TextureBudget);
+    const auto IsOverBudget = [this, TextureBudget]()
     {
-        Node* Worst = nullptr;
-        uint32 WorstID = 0;
-        TArray<uint32> LoadedNodes;
-        LoadedMeshData.GenerateKeyArray(LoadedNodes);
-        for (uint32 ID : LoadedNodes)
-        {
-            if(!LoadedMeshData.Contains(ID)) return;
-            Node* SelectedNode = &ComponentData->Nodes[ID].NexusNode;
-            const float SelectedNodeError = Component->GetErrorForNode(ID);
-            if (!Worst || SelectedNodeError < Component->GetErrorForNode(WorstID))
-            {
-                Worst = SelectedNode;
-                WorstID = ID;
-            }
-        }
-        if (!Worst || Component->GetErrorForNode(WorstID) >= Component->GetErrorForNode(BestNodeID) * 0.9f)
+        return Component->CurrentCacheSize > static_cast<uint64>(Component->DrawBudget) || TextureResidency.IsOverBudget(TextureBudget);
+    };
+    if (!IsOverBudget()) return;
+
+    // The errors changed with the traversal, the heap is rebuilt once and then every eviction is O(log n)
+    UpdateResidentPriorities();
+    // Compared on the same error per byte the heap is ordered by
+    const float BestNodeScore = GetCacheError(BestNodeID) / FMath::Max<uint64>(Component->GetNodeSize(BestNodeID), 1);
+    while (IsOverBudget() && ResidentNodes.Num() > 0)
+    {
+        const uint32 WorstID = ResidentNodes.Top();
+        if (ResidentNodes.TopPriority().Score >= BestNodeScore * 0.9f)
         {
             return;
         }
@@ -349,37 +196,98 @@ void FUnrealNexusProxy::Flush()
 
 TOptional<TTuple<uint32, Node*>> FUnrealNexusProxy::FindBestNode()
 {
-    Node* BestNode = nullptr;
-    uint32 BestNodeID = 0;
-    for (FCandidateNode& CandidateNode : CandidateNodes)
+    while (CandidateNodes.Num() > 0)
     {
-        auto& UNode = ComponentData->Nodes[CandidateNode.ID];
-        Node* Candidate = &UNode.NexusNode;
-        if (!Component->IsNodeLoaded(CandidateNode.ID) && ( !BestNode || CandidateNode.FirstNodeError > BestNode->error))
+        const uint32 BestNodeID = CandidateNodes.Top();
+        if (!Component->IsNodeLoaded(BestNodeID))
         {
-            BestNode = Candidate;
-            BestNodeID = CandidateNode.ID;
+            return TTuple<uint32, Node*>{BestNodeID, &ComponentData->Nodes[BestNodeID].NexusNode};
         }
+        // Got loaded since the traversal picked it
+        CandidateNodes.Pop();
     }
-    return BestNode == nullptr ? TOptional<TTuple<uint32, Node*>>() : TTuple<uint32, Node*>{BestNodeID, BestNode};
+    return TOptional<TTuple<uint32, Node*>>();
 }
 
-void FUnrealNexusProxy::RemoveCandidateWithId(const uint32 NodeID)
+void FUnrealNexusProxy::RequestPrefetchNode()
 {
-    int NodeIndex = -1;
-    for (int i = 0; i < CandidateNodes.Num(); i ++)
+    while (PrefetchNodes.Num() > 0)
     {
-        FCandidateNode& Candidate = CandidateNodes[i];
-        if (Candidate.ID == NodeID)
+        const float PredictedError = PrefetchNodes.TopPriority();
+        const uint32 NodeID = PrefetchNodes.Pop();
+        if (Component->NodeStatuses[NodeID] != ENodeStatus::Dropped) continue;
+
+        Node* PrefetchNode = &ComponentData->Nodes[NodeID].NexusNode;
+        FreeCache(PrefetchNode, NodeID);
+        if (Component->CurrentCacheSize + Component->GetNodeSize(NodeID) > static_cast<uint64>(Component->DrawBudget) ||
+            TextureResidency.IsOverBudget(static_cast<uint64>(Component->TextureBudget)))
         {
-            NodeIndex = i;
-            break;
+            // The cache is full of nodes the current view needs more
+            return;
         }
+        // Otherwise the next eviction would rank it by its current error and drop it before the cameras get there
+        FNexusScheduledNode& Predicted = PredictedNodes.FindOrAdd(NodeID);
+        Predicted.NodeID = NodeID;
+        Predicted.Time = Component->GetWorld()->GetTimeSeconds() + Component->PrefetchLookahead;
+        Predicted.Error = PredictedError;
+        PrefetchedNodes.Add(NodeID);
+        INC_DWORD_STAT(STATID_NexusPrefetchRequests);
+        TextureResidency.AcquireNode(NodeID);
+        Component->SetNodeStatus(NodeID, ENodeStatus::Pending);
+        Component->RequestNode(NodeID);
+        return;
     }
-    if (NodeIndex != -1)
+}
+
+void FUnrealNexusProxy::AddScheduledNode(const FNexusScheduledNode& Scheduled)
+{
+    UpcomingNodes.Add(Scheduled.NodeID, Scheduled);
+    if (!ScheduledNodes.Contains(Scheduled.NodeID))
+    {
+        ScheduledNodes.Push(Scheduled.NodeID, Scheduled.Time);
+    }
+}
+
+void FUnrealNexusProxy::ClearScheduledNodes()
+{
+    ScheduledNodes.Reset();
+    UpcomingNodes.Reset();
+    ProtectedUpcomingNodes.Reset();
+}
+
+bool FUnrealNexusProxy::RequestScheduledNode()
+{
+    while (ScheduledNodes.Num() > 0)
     {
-        CandidateNodes.RemoveAt(NodeIndex);
+        const uint32 NodeID = ScheduledNodes.Top();
+        if (Component->NodeStatuses[NodeID] != ENodeStatus::Dropped)
+        {
+            ScheduledNodes.Pop();
+            continue;
+        }
+
+        FreeCache(&ComponentData->Nodes[NodeID].NexusNode, NodeID);
+        if (Component->CurrentCacheSize + Component->GetNodeSize(NodeID) > static_cast<uint64>(Component->DrawBudget) ||
+            TextureResidency.IsOverBudget(static_cast<uint64>(Component->TextureBudget)))
+        {
+            // Kept in the schedule, it's requested once the cache has room for it
+            return false;
+        }
+        ScheduledNodes.Pop();
+        RemoveCandidateWithId(NodeID);
+        PrefetchedNodes.Add(NodeID);
+        INC_DWORD_STAT(STATID_NexusPrefetchRequests);
+        TextureResidency.AcquireNode(NodeID);
+        Component->SetNodeStatus(NodeID, ENodeStatus::Pending);
+        Component->RequestNode(NodeID);
+        return true;
     }
+    return false;
+}
+
+void FUnrealNexusProxy::RemoveCandidateWithId(const uint32 NodeID)
+{
+    CandidateNodes.Remove(NodeID);
 }
 
 void FUnrealNexusProxy::BeginFrame(float DeltaSeconds)
@@ -397,23 +305,92 @@ void FUnrealNexusProxy::BeginFrame(float DeltaSeconds)
         }
         Component->CurrentError = FMath::Max(Component->TargetError, FMath::Min(Component->MaxError, Component->CurrentError));
     }
-    CandidateNodes.Empty();
+    CandidateNodes.Reset();
     Component->CurrentError = FMath::Max(Component->TargetError, FMath::Min(Component->MaxError, Component->CurrentError));
 }
 
-void FUnrealNexusProxy::Update(const FCameraInfo InLastCameraInfo, const FTraversalData InLastTraversalData)
+void FUnrealNexusProxy::ConsumeTraversal(const FTraversalData& Traversal)
+{
+    CurrentFrame ++;
+    CandidateNodes.Reset();
+    for (const FTraversalCandidate& Candidate : Traversal.Candidates)
+    {
+        AddCandidate(Candidate.ID, Candidate.Error);
+    }
+    PrefetchNodes.Reset();
+    for (const FTraversalCandidate& Candidate : Traversal.PrefetchCandidates)
+    {
+        if (!CandidateNodes.Contains(Candidate.ID))
+        {
+            PrefetchNodes.Push(Candidate.ID, Candidate.Error);
+        }
+    }
+    
+    TArray<uint32> SelectedNodes;
+    SelectedNodes.Reserve(Traversal.SelectedNodes.Num());
+    for (const uint32 SelectedID : Traversal.SelectedNodes)
+    {
+        if (!Traversal.IsSelected(SelectedID)) continue;
+        LastUsedFrames[SelectedID] = CurrentFrame;
+        SelectedNodes.Add(SelectedID);
+        if (PrefetchedNodes.Remove(SelectedID) > 0)
+        {
+            PrefetchHits ++;
+            INC_DWORD_STAT(STATID_NexusPrefetchHits);
+        }
+    }
+    // The cache may have dropped some of them as well
+    TArray<uint32> ShadowSelectedNodes;
+    ShadowSelectedNodes.Reserve(Traversal.ShadowSelectedNodes.Num());
+    for (const uint32 SelectedID : Traversal.ShadowSelectedNodes)
+    {
+        if (!Component->IsNodeLoaded(SelectedID)) continue;
+        LastUsedFrames[SelectedID] = CurrentFrame;
+        ShadowSelectedNodes.Add(SelectedID);
+    }
+    UpdateTextureMips();
+    const bool bCullBackfaces = bCanCullBackfaces && Traversal.Inputs.ErrorParams.BackfaceFactor > 0.0f;
+    const bool bShadowCut = Traversal.Inputs.bShadowCut;
+    ENQUEUE_RENDER_COMMAND(NexusUpdateRenderCut)([this, SelectedNodes = MoveTemp(SelectedNodes), ShadowSelectedNodes = MoveTemp(ShadowSelectedNodes), bCullBackfaces, bShadowCut](FRHICommandListImmediate& Commands) mutable
+    {
+        RenderCut.Update(MoveTemp(SelectedNodes), bCullBackfaces);
+        ShadowCut.Update(MoveTemp(ShadowSelectedNodes), false);
+        bHasShadowCut = bShadowCut;
+    });
+}
+
+void FUnrealNexusProxy::Update()
 {
     DECLARE_SCOPE_CYCLE_COUNTER(TEXT("Nexus Proxy Update"), CYCLEID_NexusRenderer, STATGROUP_NexusRenderer);
 
-    LastCameraInfo = InLastCameraInfo;
-    LastTraversalData = InLastTraversalData;
+    UpdateTextures();
+    GeometryIdleFrames ++;
+    const int32 FramesBeforeCompaction = NexusGeometryPool::GetIdleFramesBeforeCompaction();
+    if (FramesBeforeCompaction > 0 && GeometryIdleFrames >= FramesBeforeCompaction)
+    {
+        CompactGeometry();
+        GeometryIdleFrames = 0;
+    }
+
+    const uint32 PrefetchOutcomes = PrefetchHits + PrefetchMisses;
+    SET_FLOAT_STAT(STATID_NexusPrefetchHitRate, PrefetchOutcomes > 0 ? 100.0f * PrefetchHits / PrefetchOutcomes : 0.0f);
+
     if (this->PendingCount >= this->MaxPending)
         return;
-    
 
+    // The path of the camera is known, its nodes are requested in the order the path needs them.
+    // They take turns with the current view, which would otherwise starve for as long as the schedule runs
     const auto OptionalBestNode = FindBestNode();
+    if ((!OptionalBestNode || !bLastRequestWasScheduled) && RequestScheduledNode())
+    {
+        bLastRequestWasScheduled = true;
+        return;
+    }
+    bLastRequestWasScheduled = false;
     if (!OptionalBestNode)
     {
+        // The current view has everything it asked for, get ahead of the camera
+        RequestPrefetchNode();
         return;
     }
     
@@ -424,49 +401,203 @@ void FUnrealNexusProxy::Update(const FCameraInfo InLastCameraInfo, const FTraver
     FreeCache(BestNode, BestNodeID);
     
     RemoveCandidateWithId(BestNodeID);
+    // The textures are prefetched with the node, so that they're ready when it's drawn
+    TextureResidency.AcquireNode(BestNodeID);
     Component->SetNodeStatus(BestNodeID, ENodeStatus::Pending);
     Component->RequestNode(BestNodeID);
 }
 
 FUnrealNexusProxy::~FUnrealNexusProxy()
 {
+    for (auto& LoadedNode : LoadedMeshData)
+    {
+        delete LoadedNode.Value;
+    }
+    for (FNexusGeometryPage* Page : GeometryPages)
+    {
+        if (Page == nullptr) continue;
+        Page->ReleaseResource();
+        delete Page;
+    }
 }
 
-void FUnrealNexusProxy::LoadGPUData(const uint32 N)
+FNexusGeometryAllocation FUnrealNexusProxy::AllocateGeometry(const uint32 N)
 {
-    if (LoadedMeshData.Contains(N)) return;
-    auto& TheNode = ComponentData->Nodes[N].NexusNode;
-    auto* TheNodeData = ComponentData->GetNode(N);
-    NodeData& TheData = TheNodeData->NexusNodeData;
-    check(TheNodeData->NexusNodeData.memory);
-    UMaterialInstanceDynamic* MaterialInstance = nullptr;
-    if (ComponentData->Header.signature.vertex.hasTextures() && Component->ModelMaterial != nullptr)
+    const Node& TheNode = ComponentData->Nodes[N].NexusNode;
+    FNexusGeometryAllocation Allocation;
+    bool bCreatedPage = false;
+    GeometryAllocator.Allocate(TheNode.nvert, TheNode.nface * 3, Allocation, bCreatedPage);
+    if (bCreatedPage)
     {
-        MaterialInstance = UMaterialInstanceDynamic::Create(Component->ModelMaterial, nullptr);
-        Component->NotifyNewMaterial(MaterialInstance);
+        const int32 PageIndex = Allocation.Page;
+        const uint32 VertexCapacity = GeometryAllocator.GetPage(PageIndex).Vertices.GetCapacity();
+        const uint32 IndexCapacity = GeometryAllocator.GetPage(PageIndex).Indices.GetCapacity();
+        const bool bHasColors = ComponentData->Header.signature.vertex.hasColors();
+        const bool bCompact = bCompactVertices;
+        const ERHIFeatureLevel::Type FeatureLevel = GetScene().GetFeatureLevel();
+        ENQUEUE_RENDER_COMMAND(NexusCreateGeometryPage)([this, PageIndex, VertexCapacity, IndexCapacity, bHasColors, bCompact, FeatureLevel](FRHICommandListImmediate& Commands)
+        {
+            if (GeometryPages.Num() <= PageIndex)
+            {
+                GeometryPages.SetNumZeroed(PageIndex + 1);
+            }
+            check(GeometryPages[PageIndex] == nullptr);
+            GeometryPages[PageIndex] = new FNexusGeometryPage(FeatureLevel, VertexCapacity, IndexCapacity, bHasColors, bCompact);
+            GeometryPages[PageIndex]->InitResource();
+        });
+    }
+    return Allocation;
+}
+
+void FUnrealNexusProxy::CompactGeometry()
+{
+    // Keep one empty page around, so that the next loads don't have to create it again
+    const TArray<int32> ClosedPages = GeometryAllocator.CloseEmptyPages(1);
+    if (ClosedPages.Num() > 0)
+    {
+        ENQUEUE_RENDER_COMMAND(NexusReleaseGeometryPages)([this, ClosedPages](FRHICommandListImmediate& Commands)
+        {
+            for (const int32 PageIndex : ClosedPages)
+            {
+                GeometryPages[PageIndex]->ReleaseResource();
+                delete GeometryPages[PageIndex];
+                GeometryPages[PageIndex] = nullptr;
+            }
+        });
     }
+
+    const int32 SparsePage = GeometryAllocator.FindSparsePage(0.25f);
+    if (SparsePage == INDEX_NONE) return;
+
+    // Move the nodes to the other pages holding nodes, the sparse page is closed by a later compaction once it's empty.
+    // The nodes that don't fit anywhere stay, opening a page for them would only move the sparse page around
+    for (const auto& Entry : ResidentNodes.GetEntries())
+    {
+        const uint32 N = Entry.ID;
+        if (NodeAllocations[N].Page != SparsePage || UploadScheduler.IsQueued(N)) continue;
+        INexusNodeData* TheNodeData = ComponentData->GetNodeData(N);
+        if (TheNodeData == nullptr || TheNodeData->GetNodeData().memory == nullptr) continue;
+
+        const Node& TheNode = ComponentData->Nodes[N].NexusNode;
+        FNexusPendingUpload Move;
+        if (!GeometryAllocator.AllocateInUsedPages(TheNode.nvert, TheNode.nface * 3, Move.Allocation, SparsePage)) continue;
+        Move.NodeID = N;
+        Move.PreviousAllocation = NodeAllocations[N];
+        NodeAllocations[N] = Move.Allocation;
+        UploadScheduler.Enqueue(Move);
+    }
+}
+
+void FUnrealNexusProxy::CommitUpload(const FNexusPendingUpload& Upload, const FNexusNodeStreams& Streams, const uint32 NumPrimitives)
+{
+    check(IsInRenderingThread());
+    GeometryPages[Upload.Allocation.Page]->UploadStreams(Upload.Allocation, Streams);
+    if (FNexusNodeRenderData** Data = LoadedMeshData.Find(Upload.NodeID))
+    {
+        // Moved by the compaction
+        (*Data)->Allocation = Upload.Allocation;
+        (*Data)->Dequantization = Streams.Dequantization;
+        return;
+    }
+    LoadedMeshData.Add(Upload.NodeID, new FNexusNodeRenderData(Upload.Allocation, Streams.Dequantization, NumPrimitives));
+}
+
+void FUnrealNexusProxy::LoadGPUData(const uint32 N, const TSharedPtr<FNexusPreparedStreams, ESPMode::ThreadSafe>& Streams)
+{
+    if (ResidentNodes.Contains(N)) return;
+    check(ComponentData->GetNodeData(N) && ComponentData->GetNodeData(N)->GetNodeData().memory);
+    TextureResidency.AcquireNode(N);
     Component->CurrentCacheSize += Component->GetNodeSize(N);
-    
-    ENQUEUE_RENDER_COMMAND(NexusLoadGPUData)([&, N, MaterialInstance](FRHICommandListImmediate& Commands)
-    {
-        FNexusNodeRenderData* Data = new FNexusNodeRenderData(this, TheData, TheNode, MaterialInstance);
-        this->PendingCount ++;
-        UE_LOG(NexusInfo, Log, TEXT("Increase cache %d by %d"), Component->CurrentCacheSize, Component->GetNodeSize(N));
-        Data->NumPrimitives = TheNode.nface;
-        LoadedMeshData.Add(N, Data);
-        this->PendingCount --;
-    });
+    ResidentNodes.Push(N, FNexusResidentPriority { 0.0f, 0.0f, CurrentFrame });
+    GeometryIdleFrames = 0;
+
+    // The geometry is copied by the upload scheduler, within the per frame budget
+    FNexusPendingUpload Upload;
+    Upload.NodeID = N;
+    Upload.Allocation = AllocateGeometry(N);
+    Upload.Prepared = Streams;
+    NodeAllocations[N] = Upload.Allocation;
+    UploadScheduler.Enqueue(Upload);
+    UE_LOG(NexusInfo, Log, TEXT("Increase cache %d by %d"), Component->CurrentCacheSize, Component->GetNodeSize(N));
+}
+
+void FUnrealNexusProxy::UpdateTextures()
+{
+    TArray<uint32> LoadedTextures;
+    TextureResidency.Update(LoadedTextures);
+    for (const uint32 TextureID : LoadedTextures)
+    {
+        // The material is created when the texture is there, never while loading a node
+        UMaterialInstanceDynamic* Material = UMaterialInstanceDynamic::Create(Component->ModelMaterial, Component);
+        Material->SetTextureParameterValue(TEXT("InputTexture"), ComponentData->GetTexture(TextureID));
+        Component->NotifyNewMaterial(Material);
+        TextureMaterials.Add(TextureID, Material);
+        
+        FMaterialRenderProxy* MaterialRenderProxy = Material->GetRenderProxy();
+        ENQUEUE_RENDER_COMMAND(NexusAddTextureMaterial)([this, TextureID, MaterialRenderProxy](FRHICommandListImmediate& Commands)
+        {
+            TextureMaterialProxies.Add(TextureID, MaterialRenderProxy);
+        });
+    }
+    if (LoadedTextures.Num() > 0)
+    {
+        UpdateTextureMips();
+    }
+
+    TArray<uint32> UnloadedTextures;
+    TextureResidency.EnforceBudget(static_cast<uint64>(Component->TextureBudget), UnloadedTextures);
+    for (const uint32 TextureID : UnloadedTextures)
+    {
+        UMaterialInstanceDynamic* Material = nullptr;
+        if (!TextureMaterials.RemoveAndCopyValue(TextureID, Material)) continue;
+        Component->NotifyMaterialDeleted(Material);
+        ENQUEUE_RENDER_COMMAND(NexusRemoveTextureMaterial)([this, TextureID](FRHICommandListImmediate& Commands)
+        {
+            TextureMaterialProxies.Remove(TextureID);
+        });
+    }
+}
+
+void FUnrealNexusProxy::UpdateTextureMips()
+{
+    const FNexusNodeTable& NodeTable = ComponentData->GetNodeTable();
+    const auto GetNodeProjectedSize = [this, &NodeTable](const uint32 NodeID)
+    {
+        // The screen space error is the node error in pixels, the same ratio turns the node diameter into pixels
+        const float NodeError = NodeTable.Error[NodeID];
+        if (NodeError <= 0.0f) return MAX_flt;
+        return Component->GetErrorForNode(NodeID) * 2.0f * NodeTable.Radius[NodeID] / NodeError;
+    };
+    if (TextureResidency.UpdateWantedResolutions(GetNodeProjectedSize))
+    {
+        IStreamingManager::Get().NotifyPrimitiveUpdated(Component);
+    }
 }
 
 void FUnrealNexusProxy::DropGPUData(uint32 N)
 {
-    if (!LoadedMeshData.Contains(N)) return;
+    TextureResidency.ReleaseNode(N, Component->GetErrorForNode(N));
+    if (!ResidentNodes.Contains(N)) return;
     Component->CurrentCacheSize -= Component->GetNodeSize(N);
-    if (LastTraversalData.SelectedNodes.Contains(N))
-        LastTraversalData.SelectedNodes.Remove(N);
+    Component->GetFrontTraversal().Deselect(N);
+    ResidentNodes.Remove(N);
+    FNexusPendingUpload CancelledUpload;
+    if (UploadScheduler.Cancel(N, CancelledUpload))
+    {
+        GeometryAllocator.Free(CancelledUpload.PreviousAllocation);
+    }
+    GeometryAllocator.Free(NodeAllocations[N]);
+    NodeAllocations[N] = FNexusGeometryAllocation();
+    GeometryIdleFrames = 0;
     ENQUEUE_RENDER_COMMAND(NexusLoadGPUData)([&, N](FRHICommandListImmediate& Commands)
     {
-        LoadedMeshData.Remove(N);
+        RenderCut.Deselect(N);
+        ShadowCut.Deselect(N);
+        FNexusNodeRenderData* Data = nullptr;
+        if (LoadedMeshData.RemoveAndCopyValue(N, Data))
+        {
+            delete Data;
+        }
     });
     UE_LOG(NexusInfo, Log, TEXT("Decrease cache %d by %d"), Component->CurrentCacheSize, Component->GetNodeSize(N));
 }
@@ -482,12 +613,25 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
     
     DECLARE_SCOPE_CYCLE_COUNTER(TEXT("Nexus Edge Selection"), CYCLEID_NexusNodeSelection, STATGROUP_NexusRenderer);
     int RenderedCount = 0;
-    const TSet<uint32> SelectedNodes = LastTraversalData.SelectedNodes;
-    for (uint32 Id : SelectedNodes)
+    // Shadow depth views come with the frustum of the shadow, and draw the shadow cut
+    const FConvexVolume* ShadowFrustum = View->GetDynamicMeshElementsShadowCullFrustum();
+    const bool bIsShadowPass = ShadowFrustum != nullptr;
+    const FNexusRenderCut& Cut = bIsShadowPass && bHasShadowCut ? ShadowCut : RenderCut;
+    const FConvexVolume& CullFrustum = bIsShadowPass ? *ShadowFrustum : View->ViewFrustum;
+    const FVector CullTranslation = bIsShadowPass ? View->GetPreShadowTranslation() : FVector::ZeroVector;
+    // The node table is in model space
+    const FNexusNodeTable& NodeTable = ComponentData->NodeTable;
+    const bool bCullBackfaces = !bIsShadowPass && Cut.bCullBackfaces && NodeTable.Num() == ComponentData->Nodes.Num();
+    const FVector ModelViewpoint = GetLocalToWorld().InverseTransformPosition(View->ViewMatrices.GetViewOrigin());
+    for (uint32 Id : Cut.SelectedNodes)
     {
-        if (!LoadedMeshData.Contains(Id))
+        if (!Cut.IsSelected(Id) || !LoadedMeshData.Contains(Id))
             continue; // This node was dropped
         FNexusNodeRenderData* Data = LoadedMeshData[Id];
+        const FNexusGeometryAllocation& Allocation = Data->Allocation;
+        const FNexusGeometryPage* Page = GeometryPages[Allocation.Page];
+        // Compact vertices are relative to the node, all its draws share a transform that dequantizes them
+        const FDynamicPrimitiveUniformBuffer* NodeUniformBuffer = nullptr;
 
         // Detecting if this node is on the edge
         auto& CurrentNode = ComponentData->Nodes[Id];
@@ -498,7 +642,7 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
         for (auto& Patch : CurrentNode.NodePatches)
         {
             const int ChildNode = Patch.node;
-            if (!SelectedNodes.Contains(ChildNode))
+            if (!Cut.IsSelected(ChildNode))
             {
                 IsVisible = true;
                 break;
@@ -506,11 +650,16 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
         }
         if(Component->bIsFrustumCullingEnabled && !IsVisible) continue;
 
-        if (!IsContainedInViewFrustum( VcgPoint3FToVector(CurrentNode.NexusNode.sphere.Center()),
+        if (!IsContainedInFrustum(CullFrustum, CullTranslation, VcgPoint3FToVector(CurrentNode.NexusNode.sphere.Center()),
             CurrentNode.NexusNode.tight_radius))
         {
             continue;
         }
+        if (bCullBackfaces && NexusErrorKernel::IsBackfacing(NodeTable, ModelViewpoint, Id))
+        {
+            INC_DWORD_STAT(STATID_NexusBackfacingNodesCulled);
+            continue;
+        }
 
         int Offset = 0;
         int EndIndex = 0;
@@ -518,7 +667,7 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
         {
             const Patch& CurrentNodePatch = CurrentNode.NodePatches[PatchId - CurrentNode.NexusNode.first_patch];
             const uint32 ChildNode = CurrentNodePatch.node;
-            if (!SelectedNodes.Contains(ChildNode))
+            if (!Cut.IsSelected(ChildNode))
             {
                 EndIndex = CurrentNodePatch.triangle_offset;
                 if (PatchId < NextNodeFirstPatch - 1) // TODO: Ask prof if moving if out can solve this
@@ -531,7 +680,7 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
 
                 FMeshBatch& Mesh = Collector.AllocateMesh();
                 Mesh.bWireframe = false;
-                Mesh.VertexFactory = &Data->NodeVertexFactory;
+                Mesh.VertexFactory = &Page->VertexFactory;
                 Mesh.Type = PT_TriangleList;
                 Mesh.DepthPriorityGroup = SDPG_World;
                 Mesh.bUseAsOccluder = true;
@@ -550,30 +699,31 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
                     Mesh.bWireframe = true;
                     Mesh.bCanApplyViewModeOverrides = false;
                 }
-                else if (Data->InstancedMaterial != nullptr)
+                else if (FMaterialRenderProxy* const* TextureMaterial = TextureMaterialProxies.Find(CurrentNodePatch.texture))
                 {
-                    if (Data->CurrentSetTextureID != CurrentNodePatch.texture)
-                    {
-                        uint32 TextureID = CurrentNodePatch.texture; 
-                        ComponentData->LoadTextureForNode(CurrentNodePatch.texture, FStreamableDelegate::CreateLambda([TextureID, Data, this]()
-                        {
-                            auto* Texture = ComponentData->GetTexture(TextureID);
-                            Data->InstancedMaterial->SetTextureParameterValue(TEXT("InputTexture"), Texture);
-                        }));
-                        
-                        Data->CurrentSetTextureID = CurrentNodePatch.texture;
-                    }
-                    
-                    Mesh.MaterialRenderProxy = Data->InstancedMaterial->GetRenderProxy();
+                    Mesh.MaterialRenderProxy = *TextureMaterial;
                 } else
                 {
+                    // Untextured, or the texture is still loading
                     Mesh.MaterialRenderProxy = MaterialProxy;
                 }
     
                 auto& Element = Mesh.Elements[0];
-                Element.IndexBuffer = &Data->IndexBuffer;
-                Element.FirstIndex = Offset * 3;
+                Element.IndexBuffer = &Page->IndexBuffer;
+                Element.FirstIndex = Allocation.IndexOffset + Offset * 3;
                 Element.NumPrimitives = (EndIndex - Offset);
+                // The indices are local to the node
+                Element.BaseVertexIndex = Allocation.VertexOffset;
+                Element.MinVertexIndex = 0;
+                Element.MaxVertexIndex = Allocation.VertexCount - 1;
+                if (bCompactVertices)
+                {
+                    if (NodeUniformBuffer == nullptr)
+                    {
+                        NodeUniformBuffer = &AllocateNodeUniformBuffer(Collector, *Data);
+                    }
+                    Element.PrimitiveUniformBufferResource = &NodeUniformBuffer->UniformBuffer;
+                }
                 Collector.AddMesh(ViewIndex, Mesh);
                 RenderedCount += (EndIndex - Offset);
             }
@@ -584,6 +734,18 @@ void FUnrealNexusProxy::DrawEdgeNodes(const int ViewIndex, const FSceneView* Vie
     TotalRenderedCount += RenderedCount;
 }
 
+const FDynamicPrimitiveUniformBuffer& FUnrealNexusProxy::AllocateNodeUniformBuffer(FMeshElementCollector& Collector, const FNexusNodeRenderData& Data) const
+{
+    const FMatrix Dequantize = FScaleMatrix(FVector(Data.Dequantization.W)) * FTranslationMatrix(FVector(Data.Dequantization));
+    const FMatrix NodeToWorld = Dequantize * GetLocalToWorld();
+    // The quantized positions span [-1, 1]
+    const FBoxSphereBounds NodeBounds(FVector::ZeroVector, FVector(1.0f), FMath::Sqrt(3.0f));
+    
+    FDynamicPrimitiveUniformBuffer& UniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+    UniformBuffer.Set(NodeToWorld, NodeToWorld, NodeBounds.TransformBy(NodeToWorld), NodeBounds, true, false, false, false);
+    return UniformBuffer;
+}
+
 void FUnrealNexusProxy::GetDynamicMeshElements(const TArray<const FSceneView*>& Views,
                                                const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const
 {
@@ -598,11 +760,15 @@ void FUnrealNexusProxy::GetDynamicMeshElements(const TArray<const FSceneView*>&
 
 void FUnrealNexusProxy::DrawStaticElements(FStaticPrimitiveDrawInterface* PDI)
 {
-    if (LoadedMeshData.Num() == 0) return;
-    FNexusNodeRenderData* Data = LoadedMeshData[0];
+    // Static draws can't carry the per node transform the compact vertices need
+    if (LoadedMeshData.Num() == 0 || bCompactVertices) return;
+    FNexusNodeRenderData** FoundData = LoadedMeshData.Find(0);
+    if (FoundData == nullptr) return;
+    const FNexusNodeRenderData* Data = *FoundData;
+    const FNexusGeometryPage* Page = GeometryPages[Data->Allocation.Page];
     FMeshBatch Mesh;
     Mesh.bWireframe = false;
-    Mesh.VertexFactory = &Data->NodeVertexFactory;
+    Mesh.VertexFactory = &Page->VertexFactory;
     Mesh.Type = PT_TriangleList;
     Mesh.DepthPriorityGroup = SDPG_World;
     Mesh.bUseAsOccluder = true;
@@ -625,9 +791,12 @@ void FUnrealNexusProxy::DrawStaticElements(FStaticPrimitiveDrawInterface* PDI)
     }
     
     auto& Element = Mesh.Elements[0];
-    Element.IndexBuffer = &Data->IndexBuffer;
-    Element.FirstIndex = 0;
+    Element.IndexBuffer = &Page->IndexBuffer;
+    Element.FirstIndex = Data->Allocation.IndexOffset;
     Element.NumPrimitives = Data->NumPrimitives;
+    Element.BaseVertexIndex = Data->Allocation.VertexOffset;
+    Element.MinVertexIndex = 0;
+    Element.MaxVertexIndex = Data->Allocation.VertexCount - 1;
     PDI->DrawMesh(Mesh, FLT_MAX);
 }
 
@@ -648,6 +817,10 @@ FPrimitiveViewRelevance FUnrealNexusProxy::GetViewRelevance(const FSceneView* Vi
 TArray<uint32> FUnrealNexusProxy::GetLoadedNodes() const
 {
     TArray<uint32> LoadedNodes;
-    LoadedMeshData.GetKeys(LoadedNodes);
+    LoadedNodes.Reserve(ResidentNodes.Num());
+    for (const auto& Entry : ResidentNodes.GetEntries())
+    {
+        LoadedNodes.Add(Entry.ID);
+    }
     return LoadedNodes;
 }
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_STATS_GROUP(TEXT("Unreal Nexus Memory"), STATGROUP_NexusMemory, STATCAT_Advanced);
+
+// Size classed pool for the compressed and decoded node payloads.
+// Released buffers are kept in a free list per size class and handed out again,
+// so streaming nodes in and out doesn't keep going back to the allocator
+class NEXUSPLUGIN_API FNexusBufferPool
+{
+    // Buffers up to 2^MinSizeLog2 bytes share the first class, bigger than 2^MaxSizeLog2 aren't pooled
+    static constexpr uint32 MinSizeLog2 = 10;
+    static constexpr uint32 MaxSizeLog2 = 24;
+    // Every power of two is split in this many classes, so that at most 25% of a buffer is wasted
+    static constexpr uint32 StepsPerPowerOfTwo = 4;
+    static constexpr int32 SizeClassesCount = (MaxSizeLog2 - MinSizeLog2) * StepsPerPowerOfTwo;
+
+    FCriticalSection PoolMutex;
+    TArray<uint8*> FreeBuffers[SizeClassesCount];
+    uint64 LiveBytes = 0;
+    uint64 PeakLiveBytes = 0;
+    uint64 PooledBytes = 0;
+    
+public:
+    static FNexusBufferPool& Get();
+    
+    static int32 GetSizeClass(uint32 Size);
+    static uint32 GetSizeClassBytes(int32 SizeClass);
+
+    // Returns a buffer of at least Size bytes, SizeClass has to be passed back to Release
+    uint8* Allocate(uint32 Size, int32& OutSizeClass);
+    void Release(uint8* Buffer, uint32 Size, int32 SizeClass);
+
+    // Frees every buffer that is sitting in the pool
+    void Trim();
+};
+
+// Owns a buffer taken from FNexusBufferPool and gives it back when destroyed
+class NEXUSPLUGIN_API FNexusPooledBuffer
+{
+    uint8* Data = nullptr;
+    uint32 Size = 0;
+    int32 SizeClass = INDEX_NONE;
+    
+public:
+    FNexusPooledBuffer() = default;
+    explicit FNexusPooledBuffer(uint32 InSize);
+    ~FNexusPooledBuffer();
+
+    FNexusPooledBuffer(const FNexusPooledBuffer&) = delete;
+    FNexusPooledBuffer& operator=(const FNexusPooledBuffer&) = delete;
+    FNexusPooledBuffer(FNexusPooledBuffer&& Other) noexcept;
+    FNexusPooledBuffer& operator=(FNexusPooledBuffer&& Other) noexcept;
+
+    void Allocate(uint32 InSize);
+    void Reset();
+
+    FORCEINLINE uint8* GetData() const { return Data; }
+    FORCEINLINE uint32 Num() const { return Size; }
+    FORCEINLINE bool IsValid() const { return Data != nullptr; }
+};
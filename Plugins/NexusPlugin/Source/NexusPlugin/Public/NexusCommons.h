@@ -3,6 +3,8 @@
 #include "Engine/StreamableManager.h"
 #include "space/deprecated_point3.h"
 
+class FNexusPooledBuffer;
+
 namespace nx {
     class NodeData;
     struct Header;
@@ -19,5 +21,6 @@ namespace NexusCommons
 
 namespace LoadUtils
 {
-    void LoadNodeData(nx::Header& Header, int VertCount, int FacesCount, nx::NodeData& TheNodeData, const uint64 DataSizeOnDisk, UTexture2D*& OutputTexture);
+    // Decodes the node payload read from disk into OutMemory and points TheNodeData to it
+    NEXUSPLUGIN_API void LoadNodeData(nx::Header& Header, int VertCount, int FacesCount, nx::NodeData& TheNodeData, const uint8* Payload, const uint64 DataSizeOnDisk, FNexusPooledBuffer& OutMemory, UTexture2D*& OutputTexture);
 }
\ No newline at end of file
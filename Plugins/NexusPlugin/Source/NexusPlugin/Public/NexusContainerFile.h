@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "NexusBufferPool.h"
+#include "UnrealNexusNodeData.h"
+
+class IAsyncReadFileHandle;
+class IAsyncReadRequest;
+
+// A node read straight from the container file, without any UObject around it
+class NEXUSPLUGIN_API FNexusStreamedNode final
+    : public INexusNodeData
+{
+    friend class FNexusContainerFile;
+    
+    FNexusPooledBuffer Payload;
+    FNexusPooledBuffer DecodedMemory;
+    nx::NodeData NexusNodeData;
+    IAsyncReadRequest* ReadRequest = nullptr;
+    TFunction<void(bool, IAsyncReadRequest*)> ReadCallback;
+    // Tells the read callbacks of an earlier request of the same node apart
+    uint32 RequestSerial = 0;
+    bool DidDecodeData = false;
+
+    void WaitForReads();
+    
+public:
+    virtual ~FNexusStreamedNode() override;
+    
+    // Begin INexusNodeData interface
+    virtual bool IsDataDecoded() const override { return DidDecodeData; }
+    virtual void DecodeData(nx::Header& Header, int VertsCount, int FacesCount) override;
+    virtual nx::NodeData& GetNodeData() override { return NexusNodeData; }
+    // End INexusNodeData interface
+};
+
+// Reads node byte ranges from a .nxs/.nxz file through an async file handle
+class NEXUSPLUGIN_API FNexusContainerFile
+{
+    TUniquePtr<IAsyncReadFileHandle> FileHandle;
+    // Shared with the decoding jobs, a released node lives until the job using it is done
+    TMap<uint32, TSharedPtr<FNexusStreamedNode, ESPMode::ThreadSafe>> StreamedNodes;
+    uint32 NextRequestSerial = 1;
+
+    // The compressed image of a texture, read on its own when the texture is first used
+    struct FImageRead
+    {
+        FNexusTextureImage Image;
+        IAsyncReadRequest* Request = nullptr;
+        TFunction<void(bool, IAsyncReadRequest*)> Callback;
+    };
+    TMap<uint32, TUniquePtr<FImageRead>> ImageReads;
+    
+public:
+    explicit FNexusContainerFile(const FString& FilePath);
+    ~FNexusContainerFile();
+
+    // Starts reading [Offset, Offset + Size) for the node, OnRead is called on the game thread with the serial of the request
+    // once the read completes. The node may have been released and requested again by then, see IsCurrentRequest
+    void RequestNode(uint32 NodeID, int64 Offset, int64 Size, TFunction<void(uint32)> OnRead);
+    void ReleaseNode(uint32 NodeID);
+    bool IsNodeRequested(uint32 NodeID) const { return StreamedNodes.Contains(NodeID); }
+    bool IsCurrentRequest(uint32 NodeID, uint32 RequestSerial) const;
+    // Waits for the read if it's still in flight, the payload is never handed out while it's being written
+    FNexusStreamedNode* GetNode(uint32 NodeID);
+    TSharedPtr<FNexusStreamedNode, ESPMode::ThreadSafe> PinNode(uint32 NodeID) const { return StreamedNodes.FindRef(NodeID); }
+
+    // Starts reading the image of a texture, OnRead is called on the game thread once TakeImage can return it.
+    // Does nothing if the image is already being read
+    void RequestImage(uint32 TextureID, int64 Offset, int64 Size, TFunction<void()> OnRead);
+    bool TakeImage(uint32 TextureID, FNexusTextureImage& OutImage);
+};
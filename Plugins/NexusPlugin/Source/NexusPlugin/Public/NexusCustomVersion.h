@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Guid.h"
+
+// Version of the serialized Nexus assets, bump it whenever the on-disk format changes
+struct NEXUSPLUGIN_API FNexusCustomVersion
+{
+    enum Type
+    {
+        // Node payloads were serialized one uint16 per byte
+        BeforeCustomVersionWasAdded = 0,
+
+        // Node payloads are stored as a single raw bulk data blob
+        NodeDataAsBulkData,
+
+        // Node assets carry the tangent frames computed at import
+        NodeTangentFrames,
+
+        // Node assets carry the compressed images of the textures they own
+        NodeTextureImages,
+
+        // -----<new versions can be added above this line>-------------------------------------------------
+        VersionPlusOne,
+        LatestVersion = VersionPlusOne - 1
+    };
+
+    static const FGuid GUID;
+
+private:
+    FNexusCustomVersion() {}
+};
@@ -0,0 +1,179 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "RenderResource.h"
+#include "LocalVertexFactory.h"
+#include "NexusBufferPool.h"
+
+namespace nx
+{
+    struct Node;
+    class NodeData;
+    class Signature;
+}
+
+// Hands out ranges of [0, Capacity) using a sorted free list,
+// neighbouring free ranges are merged back when released
+class NEXUSPLUGIN_API FNexusRangeAllocator
+{
+public:
+    void Init(uint32 InCapacity);
+    // Best fit, so that the small holes left by small nodes get reused first
+    bool Allocate(uint32 Size, uint32& OutOffset);
+    void Free(uint32 Offset, uint32 Size);
+
+    uint32 GetCapacity() const { return Capacity; }
+    uint32 GetUsed() const { return Used; }
+    bool IsEmpty() const { return Used == 0; }
+    
+private:
+    struct FRange
+    {
+        uint32 Offset;
+        uint32 Size;
+    };
+    TArray<FRange> FreeRanges;
+    uint32 Capacity = 0;
+    uint32 Used = 0;
+};
+
+// Where the geometry of a node lives in the pool
+struct FNexusGeometryAllocation
+{
+    int32 Page = INDEX_NONE;
+    uint32 VertexOffset = 0;
+    uint32 VertexCount = 0;
+    uint32 IndexOffset = 0;
+    uint32 IndexCount = 0;
+
+    bool IsValid() const { return Page != INDEX_NONE; }
+};
+
+// A node converted to the layout of the geometry page buffers
+struct FNexusNodeStreams
+{
+    // FVector per vertex, or four int16 relative to Dequantization when the vertices are compact
+    const void* Positions = nullptr;
+    // nullptr if the model has no colors
+    const FColor* Colors = nullptr;
+    // FVector2D per vertex, or FVector2DHalf when the vertices are compact
+    const void* TexCoords = nullptr;
+    // Tangent and normal of every vertex
+    const FPackedNormal* Tangents = nullptr;
+    const uint16* Indices = nullptr;
+    uint32 VertexCount = 0;
+    uint32 IndexCount = 0;
+    bool bCompactVertices = false;
+    // Compact positions are dequantized as XYZ + Position * W
+    FVector4 Dequantization = FVector4(0.0f, 0.0f, 0.0f, 1.0f);
+};
+
+// The same streams seen by WriteNodeStreams while it fills them
+struct FNexusWritableNodeStreams
+{
+    void* Positions = nullptr;
+    FColor* Colors = nullptr;
+    void* TexCoords = nullptr;
+    FPackedNormal* Tangents = nullptr;
+    uint16* Indices = nullptr;
+};
+
+// Streams converted by a decoding worker, waiting for the upload scheduler to stage them
+struct FNexusPreparedStreams
+{
+    // Set by the requester, the layout of the geometry pages of its proxy
+    bool bCompactVertices = false;
+    FNexusPooledBuffer Memory;
+    FNexusNodeStreams Streams;
+};
+
+// Game thread bookkeeping of the geometry pages, the buffers themselves are owned by the render thread
+class NEXUSPLUGIN_API FNexusGeometryAllocator
+{
+public:
+    struct FPage
+    {
+        FNexusRangeAllocator Vertices;
+        FNexusRangeAllocator Indices;
+        bool bInUse = false;
+    };
+
+    // bOutCreatedPage is set when a new page had to be opened, the caller has to create its buffers
+    bool Allocate(uint32 VertexCount, uint32 IndexCount, FNexusGeometryAllocation& OutAllocation, bool& bOutCreatedPage);
+    // Only looks at the pages already holding nodes and never opens one, for the compaction to move nodes around.
+    // Filling an empty or a new page would just make it the next sparse page
+    bool AllocateInUsedPages(uint32 VertexCount, uint32 IndexCount, FNexusGeometryAllocation& OutAllocation, int32 ExcludedPage);
+    void Free(const FNexusGeometryAllocation& Allocation);
+
+    // Closes every empty page but KeepCount of them, returns the closed pages so that their buffers can be released
+    TArray<int32> CloseEmptyPages(int32 KeepCount);
+    // The open page with the lowest vertex occupancy, if it's below MaxOccupancy
+    int32 FindSparsePage(float MaxOccupancy) const;
+    
+    const FPage& GetPage(const int32 Page) const { return Pages[Page]; }
+    int32 GetPagesCount() const { return Pages.Num(); }
+
+private:
+    TArray<FPage> Pages;
+
+    bool AllocateInPage(int32 PageIndex, FNexusGeometryAllocation& OutAllocation);
+};
+
+// A set of big vertex and index buffers shared by many nodes.
+// Every node is drawn through the same vertex factory, offset by the base vertex index
+class FNexusGeometryPage final : public FRenderResource
+{
+public:
+    FLocalVertexFactory VertexFactory;
+    FVertexBufferWithSRV PositionBuffer;
+    FVertexBufferWithSRV ColorBuffer;
+    FVertexBufferWithSRV TexCoordsBuffer;
+    FVertexBufferWithSRV TangentBuffer;
+    FIndexBuffer IndexBuffer;
+
+    FNexusGeometryPage(ERHIFeatureLevel::Type InFeatureLevel, uint32 InVertexCapacity, uint32 InIndexCapacity, bool bInHasColors, bool bInCompactVertices);
+
+    virtual void InitRHI() override;
+    virtual void ReleaseRHI() override;
+    virtual FString GetFriendlyName() const override { return TEXT("FNexusGeometryPage"); }
+
+    // Copies the streams of a node at its allocated ranges
+    void UploadStreams(const FNexusGeometryAllocation& Allocation, const FNexusNodeStreams& Streams);
+    // Load time fallback for the nodes imported without tangent frames
+    static void CalculateTangents(TArrayView<FPackedNormal> OutTangents, nx::Signature& TheSig, nx::NodeData& Data, nx::Node& Node);
+    uint64 GetAllocatedSize() const;
+
+private:
+    uint32 VertexCapacity;
+    uint32 IndexCapacity;
+    bool bHasColors;
+    bool bCompactVertices;
+    
+    void InitVertexFactory();
+};
+
+namespace NexusGeometryPool
+{
+    // Capacity of a new page, big enough for at least the given node
+    uint32 GetPageVertexCapacity(uint32 MinVertices);
+    uint32 GetPageIndexCapacity(uint32 MinIndices);
+    // Frames without loads or drops before the pool is compacted
+    int32 GetIdleFramesBeforeCompaction();
+
+    // Compact vertices store 16 bit positions relative to the node and half float UVs
+    uint32 GetPositionStride(bool bCompactVertices);
+    uint32 GetTexCoordStride(bool bCompactVertices);
+    
+    // Bytes the node takes in the geometry pages
+    uint64 GetNodeGPUSize(nx::Signature& Sig, const nx::Node& Node, bool bCompactVertices);
+    // Bytes WriteNodeStreams needs for the node
+    uint32 GetStreamsSize(nx::Signature& Sig, const nx::Node& Node, bool bCompactVertices);
+    // Where every stream of the node lives in Memory, the layout is the same wherever the streams are written
+    FNexusNodeStreams MapNodeStreams(nx::Signature& Sig, const nx::Node& Node, const uint8* Memory, bool bCompactVertices);
+    FNexusWritableNodeStreams MapWritableNodeStreams(nx::Signature& Sig, const nx::Node& Node, uint8* Memory, bool bCompactVertices);
+    // Converts the node data to the page layout in Memory, 16 bytes aligned.
+    // The tangents are generated unless the frames computed at import are passed
+    FNexusNodeStreams WriteNodeStreams(nx::Signature& Sig, nx::NodeData& Data, nx::Node& Node, uint8* Memory, bool bCompactVertices, TArrayView<const FPackedNormal> TangentFrames = {});
+    // Worst position error the 16 bit quantization introduces, in the same units as the node error
+    float GetQuantizationError(const FNexusNodeStreams& Streams);
+}
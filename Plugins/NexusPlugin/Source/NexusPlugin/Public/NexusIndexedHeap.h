@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+// Binary heap of node IDs that also tracks where every ID sits in the heap,
+// so that a node can be found, reprioritized or removed in O(log n).
+// Predicate(A, B) returns true when the priority A has to stay above B
+template <typename PriorityType, typename PredicateType>
+class TNexusIndexedHeap
+{
+public:
+    struct FEntry
+    {
+        uint32 ID;
+        PriorityType Priority;
+    };
+
+    // IDs must be in [0, IDsCount)
+    void Init(const int32 IDsCount)
+    {
+        Entries.Reset();
+        Positions.Init(INDEX_NONE, IDsCount);
+    }
+
+    // Empties the heap, in O(Num()) regardless of the IDs count
+    void Reset()
+    {
+        for (const FEntry& Entry : Entries)
+        {
+            Positions[Entry.ID] = INDEX_NONE;
+        }
+        Entries.Reset();
+    }
+
+    FORCEINLINE int32 Num() const { return Entries.Num(); }
+    FORCEINLINE bool Contains(const uint32 ID) const { return Positions.IsValidIndex(ID) && Positions[ID] != INDEX_NONE; }
+    FORCEINLINE uint32 Top() const { return Entries[0].ID; }
+    FORCEINLINE const PriorityType& TopPriority() const { return Entries[0].Priority; }
+    FORCEINLINE const PriorityType& GetPriority(const uint32 ID) const { return Entries[Positions[ID]].Priority; }
+    FORCEINLINE const TArray<FEntry>& GetEntries() const { return Entries; }
+
+    // Adds the ID, or moves it to its new place if it's already in the heap
+    void Push(const uint32 ID, const PriorityType& Priority)
+    {
+        if (Contains(ID))
+        {
+            const int32 Index = Positions[ID];
+            Entries[Index].Priority = Priority;
+            SiftDown(SiftUp(Index));
+            return;
+        }
+        const int32 Index = Entries.Add({ ID, Priority });
+        Positions[ID] = Index;
+        SiftUp(Index);
+    }
+
+    uint32 Pop()
+    {
+        const uint32 ID = Top();
+        Remove(ID);
+        return ID;
+    }
+
+    void Remove(const uint32 ID)
+    {
+        if (!Contains(ID)) return;
+        const int32 Index = Positions[ID];
+        const int32 LastIndex = Entries.Num() - 1;
+        if (Index != LastIndex)
+        {
+            SwapEntries(Index, LastIndex);
+        }
+        Entries.RemoveAt(LastIndex, 1, false);
+        Positions[ID] = INDEX_NONE;
+        if (Index != LastIndex)
+        {
+            SiftDown(SiftUp(Index));
+        }
+    }
+
+    // Recomputes every priority with GetPriority(ID) and rebuilds the heap in O(n),
+    // cheaper than pushing every ID again when most of the priorities changed
+    template <typename GetPriorityType>
+    void Reprioritize(GetPriorityType&& GetPriority)
+    {
+        for (FEntry& Entry : Entries)
+        {
+            Entry.Priority = GetPriority(Entry.ID);
+        }
+        for (int32 Index = Entries.Num() / 2 - 1; Index >= 0; Index --)
+        {
+            SiftDown(Index);
+        }
+    }
+
+private:
+    TArray<FEntry> Entries;
+    TArray<int32> Positions;
+    PredicateType Predicate;
+
+    FORCEINLINE void SwapEntries(const int32 A, const int32 B)
+    {
+        Swap(Entries[A], Entries[B]);
+        Positions[Entries[A].ID] = A;
+        Positions[Entries[B].ID] = B;
+    }
+
+    int32 SiftUp(int32 Index)
+    {
+        while (Index > 0)
+        {
+            const int32 Parent = (Index - 1) / 2;
+            if (!Predicate(Entries[Index].Priority, Entries[Parent].Priority)) break;
+            SwapEntries(Index, Parent);
+            Index = Parent;
+        }
+        return Index;
+    }
+
+    void SiftDown(int32 Index)
+    {
+        const int32 Count = Entries.Num();
+        while (true)
+        {
+            const int32 Left = Index * 2 + 1;
+            if (Left >= Count) break;
+            const int32 Right = Left + 1;
+            const int32 Best = Right < Count && Predicate(Entries[Right].Priority, Entries[Left].Priority) ? Right : Left;
+            if (!Predicate(Entries[Best].Priority, Entries[Index].Priority)) break;
+            SwapEntries(Index, Best);
+            Index = Best;
+        }
+    }
+};
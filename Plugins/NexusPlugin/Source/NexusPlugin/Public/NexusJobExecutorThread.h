@@ -1,5 +1,10 @@
 ﻿#pragma once
 
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Containers/Queue.h"
+#include "UnrealNexusNodeData.h"
+
 namespace nx {
     class NexusFile;
 }
@@ -9,36 +14,101 @@ enum class EJobKind : uint8
     Load,
     Drop
 };
+
+struct FNexusJob;
+struct FNexusPreparedStreams;
+struct FNexusOccluderMesh;
+
+// Every component owns one of these, the decoding workers push the finished jobs into it
+using FNexusJobsDoneQueue = TQueue<FNexusJob, EQueueMode::Mpsc>;
+
+// A texture decoded by a worker, turned into a UTexture2D on the game thread
+struct FNexusDecodedTexture
+{
+    uint32 TextureID = 0;
+    int32 Width = 0;
+    int32 Height = 0;
+    // BGRA8 mip chain down to 1x1, the full image first
+    TArray<TArray64<uint8>> Mips;
+};
+
 struct FNexusJob
 {
     uint32 NodeIndex;
-    class UUnrealNexusNodeData* NodeData;
+    class INexusNodeData* NodeData;
     struct FUnrealNexusNode* Node;
     class UUnrealNexusData* Data;
+    // Keeps a streamed node alive while the job uses it, even if the node is unloaded meanwhile
+    TSharedPtr<class INexusNodeData, ESPMode::ThreadSafe> PinnedNodeData;
+
+    // Jobs with a higher priority are decoded first
+    float Priority = 0.0f;
+    // When set, the worker also converts the decoded node to the geometry pool layout
+    TSharedPtr<FNexusPreparedStreams, ESPMode::ThreadSafe> Streams;
+    // When set, the worker also copies the triangles of the node for the occlusion buffer
+    TSharedPtr<FNexusOccluderMesh, ESPMode::ThreadSafe> Occluder;
+    // Compressed images to decode, NodeIndex is the texture they belong to and NodeData is null
+    TArray<FNexusTextureImage> TextureImages;
+    TArray<FNexusDecodedTexture> DecodedTextures;
+    TSharedPtr<FNexusJobsDoneQueue, ESPMode::ThreadSafe> JobsDone;
 };
 
+// A single decoding worker of the FNexusJobExecutor pool
 class FNexusJobExecutorThread final
     : public FRunnable
 {
 private:
+    class FNexusJobExecutor& Executor;
     FEvent* QueueJobInsertedEvent;
-    // FPThreadEvent JobQueueEmpty;
-    FCriticalSection QueueMutex;
-    class nx::NexusFile* File;
-    
-    bool bShouldBeRunning = false;
+    FThreadSafeBool bShouldBeRunning = true;
     
-protected:
-    TQueue<FNexusJob> QueuedJobs;
-    TQueue<FNexusJob> JobsDone;
 public:
-
-    explicit FNexusJobExecutorThread(class nx::NexusFile* InFile);
+    explicit FNexusJobExecutorThread(class FNexusJobExecutor& InExecutor);
+    virtual ~FNexusJobExecutorThread() override;
 
     virtual uint32 Run() override;
     virtual void Stop() override;
 
-    void AddNewJobs(TArray<FNexusJob> Jobs) noexcept;
-    TQueue<FNexusJob>& GetJobsDone() { return JobsDone; }
+    void WakeUp() const;
+};
+
+// Decodes the jobs of every nexus component on a shared pool of workers.
+// Workers sleep on their own event and are only woken up when there's something to decode
+class NEXUSPLUGIN_API FNexusJobExecutor
+{
+    friend class FNexusJobExecutorThread;
+    
+    FCriticalSection QueueMutex;
+    TArray<FNexusJob> QueuedJobs; // Max heap on FNexusJob::Priority
+    TArray<FNexusJobExecutorThread*> IdleWorkers;
+    TArray<const FNexusJobsDoneQueue*> RunningJobsQueues;
+    // The queue CancelJobs waits for, the worker finishing its last running job triggers JobsCancelledEvent
+    const FNexusJobsDoneQueue* CancellingQueue = nullptr;
+    FEvent* JobsCancelledEvent = nullptr;
+    
+    TArray<FNexusJobExecutorThread*> Workers;
+    TArray<FRunnableThread*> WorkerThreads;
+    // Loaded on the game thread when the pool is created, the workers can't load modules
+    class IImageWrapperModule* ImageWrapperModule = nullptr;
+
+    explicit FNexusJobExecutor(int32 WorkersCount);
+    
+    // Pops the most important job, returns false and marks the worker as idle if there's none
+    bool DequeueJob(FNexusJobExecutorThread* Worker, FNexusJob& OutJob);
+    void OnJobDone(FNexusJob& Job);
+    void DecodeTextureImages(FNexusJob& Job) const;
     
+public:
+    ~FNexusJobExecutor();
+
+    // Creates the pool on first use, nullptr once the module has shut it down
+    static FNexusJobExecutor* Get();
+    static void Shutdown();
+
+    void AddNewJobs(TArray<FNexusJob> Jobs) noexcept;
+
+    // Drops the queued jobs that report to JobsDone and waits for the running ones, game thread only
+    void CancelJobs(const TSharedPtr<FNexusJobsDoneQueue, ESPMode::ThreadSafe>& JobsDone);
+
+    int32 GetWorkersCount() const { return Workers.Num(); }
 };
@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+struct FUnrealNexusNode;
+
+// Structure of arrays copy of the node bounds, in unreal space.
+// The traversal evaluates the nodes in batches straight from these arrays
+// instead of chasing the FUnrealNexusNode structs
+struct NEXUSPLUGIN_API FNexusNodeTable
+{
+    TArray<float> CenterX, CenterY, CenterZ;
+    TArray<float> Radius, TightRadius, Error;
+    // Axis of the normal cone and the sine of its aperture, the sine is above 1 for nodes that can't be culled
+    TArray<float> ConeX, ConeY, ConeZ, ConeSin;
+    // Error of the coarsest parent, the parents drawn in place of a node stray this far from its surface
+    TArray<float> ParentError;
+    // Distinct parents of every node, a node can only be refined once all of them are
+    TArray<uint16> ParentsCount;
+
+    void Build(const TArray<FUnrealNexusNode>& Nodes);
+    int32 Num() const { return Error.Num(); }
+};
+
+// A view the nodes are refined for, in model space
+struct NEXUSPLUGIN_API FNexusErrorView
+{
+    FVector Viewpoint = FVector::ZeroVector;
+    float Resolution = 1.0f;
+    // The view frustum planes, normalized and pointing outwards
+    TArray<FPlane, TInlineAllocator<6>> Planes;
+
+    bool Equals(const FNexusErrorView& Other) const;
+};
+
+// Everything the error of a node depends on besides the node itself
+struct NEXUSPLUGIN_API FNexusErrorParams
+{
+    // The error of a node is the largest among the views, so that one cut serves them all
+    TArray<FNexusErrorView, TInlineAllocator<2>> Views;
+    float OuterNodeFactor = 0.0f;
+    // Like OuterNodeFactor for the nodes facing away from the viewpoint, 0 disables the cone test
+    float BackfaceFactor = 0.0f;
+    float ScaleConversion = 1.0f;
+};
+
+namespace NexusErrorKernel
+{
+    // Signed distance of the point from the frustum, negative when the point is outside
+    float CalculateDistanceFromViewFrustum(const FNexusErrorView& View, const FVector& Point);
+
+    // True when every normal of the node points away from the viewpoint
+    bool IsBackfacing(const FNexusNodeTable& Table, const FVector& Viewpoint, uint32 NodeID);
+
+    // Screen space error of a single node, the reference for CalculateErrors
+    float CalculateError(const FNexusNodeTable& Table, const FNexusErrorParams& Params, uint32 NodeID, bool bUseTight);
+
+    // Screen space error of Count nodes, evaluated four at a time with the platform vector registers
+    void CalculateErrors(const FNexusNodeTable& Table, const FNexusErrorParams& Params, const uint32* NodeIDs, int32 Count, bool bUseTight, float* OutErrors);
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+namespace nx
+{
+    struct Node;
+    class NodeData;
+    class Signature;
+}
+
+// Triangles of a coarse node in model space, copied by the decoding worker
+// so that the traversal can rasterize them while the node gets dropped
+struct FNexusOccluderMesh
+{
+    TArray<FVector> Positions;
+    TArray<uint16> Indices;
+};
+
+using FNexusOccluderMeshRef = TSharedPtr<const FNexusOccluderMesh, ESPMode::ThreadSafe>;
+
+// A node of the coarse cut and the triangles it draws, the ones of the patches whose child isn't in the cut
+struct FNexusOccluder
+{
+    FNexusOccluderMeshRef Mesh;
+    // First and end triangle of every drawn range
+    TArray<TPair<uint32, uint32>, TInlineAllocator<8>> TriangleRanges;
+};
+
+// Low resolution depth buffer the traversal rasterizes the coarse cut into,
+// so that nodes hidden behind other parts of the model aren't refined.
+// The rasterizer only needs Core, it runs on the traversal worker
+class NEXUSPLUGIN_API FNexusOcclusionBuffer
+{
+public:
+    // Multiple of 4, every row is processed 4 pixels at a time
+    static constexpr int32 Width = 256;
+    static constexpr int32 Height = 128;
+
+    // Starts a new frame, nothing is occluded until something gets rasterized
+    void Clear(const FMatrix& InModelToClip);
+    // Returns the number of triangles that were rasterized
+    int32 Rasterize(const FNexusOccluder& Occluder);
+    // True when the sphere is entirely behind what was rasterized, model space
+    bool IsSphereOccluded(const FVector& Center, float Radius) const;
+    bool IsEmpty() const { return bIsEmpty; }
+    // 1 / W of the nearest occluder at a pixel, 0 where nothing was rasterized
+    float GetInvDepth(const int32 X, const int32 Y) const { return InvDepth[Y * Width + X]; }
+
+    static void WriteOccluderMesh(FNexusOccluderMesh& OutMesh, nx::Signature& Sig, nx::NodeData& Data, const nx::Node& Node);
+
+private:
+    FMatrix ModelToClip = FMatrix::Identity;
+    bool bIsEmpty = true;
+    // 1 / W of the nearest occluder, 0 where nothing was rasterized
+    TArray<float> InvDepth;
+    // Screen position and 1 / W of the vertices of the mesh being rasterized, W <= 0 when behind the near plane
+    TArray<FVector4> ScreenVertices;
+
+    void RasterizeTriangle(const FVector4& A, FVector4 B, FVector4 C);
+};
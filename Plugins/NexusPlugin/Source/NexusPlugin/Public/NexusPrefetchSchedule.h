@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+
+#include "NexusPrefetchSchedule.generated.h"
+
+class UUnrealNexusData;
+class USplineComponent;
+
+// A node of the schedule, with the first time the camera path needs it
+USTRUCT()
+struct FNexusScheduledNode
+{
+    GENERATED_BODY()
+
+    // Seconds from the start of the camera path
+    UPROPERTY()
+    float Time = 0.0f;
+
+    UPROPERTY()
+    int32 NodeID = 0;
+
+    // Its error at that time, the cache keeps the node until then
+    UPROPERTY()
+    float Error = 0.0f;
+};
+
+// A pose of a known camera path, in world space
+USTRUCT(BlueprintType)
+struct FNexusCameraSample
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nexus)
+    float Time = 0.0f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nexus)
+    FVector Location = FVector::ZeroVector;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nexus)
+    FRotator Rotation = FRotator::ZeroRotator;
+
+    // Horizontal, in degrees
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nexus)
+    float FieldOfView = 90.0f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nexus)
+    float AspectRatio = 16.0f / 9.0f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nexus)
+    int32 ViewWidth = 1920;
+};
+
+// The nodes a known camera path needs, in the order it needs them.
+// Built offline from a sequence or a spline and fed to the component ahead of the playback,
+// see UUnrealNexusComponent::PlayPrefetchSchedule
+UCLASS(BlueprintType)
+class NEXUSPLUGIN_API UNexusPrefetchSchedule final : public UObject
+{
+    GENERATED_BODY()
+public:
+    UPROPERTY(VisibleAnywhere, Category=Nexus)
+    UUnrealNexusData* NexusData = nullptr;
+
+    UPROPERTY(VisibleAnywhere, Category=Nexus)
+    float TargetError = 0.0f;
+
+    // Seconds from the first to the last sample of the camera path
+    UPROPERTY(VisibleAnywhere, Category=Nexus)
+    float Duration = 0.0f;
+
+    // Sorted by time, and parents first within the same time
+    UPROPERTY()
+    TArray<FNexusScheduledNode> Nodes;
+
+    // Refines the DAG at every sample with the error of the traversal, as if every node was loaded.
+    // ModelToWorld is the transform of the component showing the model
+    UFUNCTION(BlueprintCallable, Category=Nexus)
+    void Build(UUnrealNexusData* InNexusData, const FTransform& ModelToWorld, const TArray<FNexusCameraSample>& Samples, float InTargetError = 2.0f);
+
+    // Samples a camera moving along the spline at constant speed, looking along it
+    UFUNCTION(BlueprintCallable, Category=Nexus)
+    static TArray<FNexusCameraSample> SampleSpline(const USplineComponent* Spline, float InDuration, float SampleRate = 30.0f, float FieldOfView = 90.0f, int32 ViewWidth = 1920);
+
+    // Index of the first node needed at Time or later
+    int32 FindFirstNode(float Time) const;
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "NexusIndexedHeap.h"
+
+class UUnrealNexusData;
+
+// Game thread, keeps the textures of the nodes in use loaded within a memory budget.
+// A texture is referenced by every requested or loaded node drawing with it, like nx::TextureData::count_ram,
+// and stays loaded once unreferenced until the budget needs its memory
+class NEXUSPLUGIN_API FNexusTextureResidency
+{
+public:
+    void Init(UUnrealNexusData* InData);
+    // The node was requested, its textures are loaded along with it
+    void AcquireNode(uint32 NodeID);
+    // The node was dropped with the given error, does nothing if it wasn't acquired
+    void ReleaseNode(uint32 NodeID, float Error);
+    // Collects the textures that finished loading since the last call
+    void Update(TArray<uint32>& OutLoadedTextures);
+    // Unloads the unreferenced textures with the smallest error until the loaded ones fit in the budget
+    void EnforceBudget(uint64 Budget, TArray<uint32>& OutUnloadedTextures);
+    // Picks the resolution every loaded texture should stream to, from the size in pixels of the nodes using it.
+    // A texture keeps about one texel per pixel of its largest node on screen. Returns whether any resolution changed
+    bool UpdateWantedResolutions(TFunctionRef<float(uint32)> GetNodeProjectedSize);
+
+    FORCEINLINE int32 Num() const { return Textures.Num(); }
+    FORCEINLINE bool IsLoaded(const uint32 TextureID) const { return Textures.IsValidIndex(TextureID) && Textures[TextureID].bLoaded; }
+    // Largest side of the wanted mip, 0 until the texture is loaded and for the textures that can't stream
+    FORCEINLINE int32 GetWantedResolution(const uint32 TextureID) const { return Textures[TextureID].WantedResolution; }
+    FORCEINLINE uint64 GetLoadedSize() const { return LoadedSize; }
+    // Whether unloading unreferenced textures isn't enough, nodes have to be dropped to fit in the budget
+    FORCEINLINE bool IsOverBudget(const uint64 Budget) const { return LoadedSize - UnusedSize > Budget; }
+
+private:
+    struct FTextureEntry
+    {
+        // Requested and loaded nodes using the texture
+        int32 RefCount = 0;
+        // Highest error of the nodes that released it, decides the eviction order once unreferenced
+        float Error = 0.0f;
+        uint64 Size = 0;
+        int32 WantedResolution = 0;
+        // Largest size in pixels of the nodes using it in the last traversal
+        float ProjectedSize = 0.0f;
+        bool bRequested = false;
+        bool bLoaded = false;
+    };
+
+    UUnrealNexusData* Data = nullptr;
+    TArray<FTextureEntry> Textures;
+    TBitArray<> AcquiredNodes;
+    TArray<uint32> LoadingTextures;
+    // Loaded textures no node uses, smallest error on top
+    TNexusIndexedHeap<float, TLess<>> UnusedTextures;
+    uint64 LoadedSize = 0;
+    uint64 UnusedSize = 0;
+
+    void GetNodeTextures(uint32 NodeID, TArray<uint32, TInlineAllocator<8>>& OutTextures) const;
+    void Unload(uint32 TextureID);
+};
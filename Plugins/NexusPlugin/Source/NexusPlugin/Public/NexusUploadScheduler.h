@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "NexusGeometryPool.h"
+
+class FUnrealNexusProxy;
+
+// CPU memory the node streams are staged in before being copied to the geometry pages.
+// The game thread writes at the head, the render thread releases what it has copied
+class NEXUSPLUGIN_API FNexusStagingRing
+{
+public:
+    void Init(uint32 InCapacity);
+    // Contiguous memory for Size bytes, nullptr when the ring has no room left
+    uint8* Allocate(uint32 Size);
+    // Grows the ring to fit a single node, only possible while nothing is staged
+    bool Reserve(uint32 Size);
+
+    uint64 GetWriteCursor() const { return WriteCursor; }
+    // Render thread, everything written before Cursor has been consumed
+    void Release(const uint64 Cursor) { ReleaseCursor = Cursor; }
+    
+    uint32 GetCapacity() const { return Memory.Num(); }
+    uint32 GetUsed() const { return static_cast<uint32>(WriteCursor - ReleaseCursor); }
+
+private:
+    TArray<uint8, TAlignedHeapAllocator<16>> Memory;
+    uint64 WriteCursor = 0;
+    TAtomic<uint64> ReleaseCursor { 0 };
+};
+
+// A node waiting to be copied to its place in the geometry pool
+struct FNexusPendingUpload
+{
+    uint32 NodeID;
+    FNexusGeometryAllocation Allocation;
+    // Freed once the node is staged, the node keeps being drawn from here until then
+    FNexusGeometryAllocation PreviousAllocation;
+    // Converted by the decoding worker, the node data is converted while staging otherwise
+    TSharedPtr<FNexusPreparedStreams, ESPMode::ThreadSafe> Prepared;
+};
+
+// Batches the node uploads of a frame into a single render command, within a byte and a time budget.
+// What doesn't fit in the budget is left in the queue for the next frames
+class NEXUSPLUGIN_API FNexusUploadScheduler
+{
+public:
+    explicit FNexusUploadScheduler(FUnrealNexusProxy* InProxy);
+    
+    void Enqueue(const FNexusPendingUpload& Upload);
+    // Drops the pending upload of a node, returns false if it has already been sent to the render thread
+    bool Cancel(uint32 NodeID, FNexusPendingUpload& OutUpload);
+    bool IsQueued(const uint32 NodeID) const { return QueuedNodes.Contains(NodeID); }
+    int32 GetQueueDepth() const { return Queue.Num(); }
+
+    // Stages as many queued nodes as the budget allows and sends them to the render thread
+    void Flush();
+
+private:
+    // Render thread side of a staged node
+    struct FStagedNode
+    {
+        FNexusPendingUpload Upload;
+        FNexusNodeStreams Streams;
+        uint32 NumPrimitives;
+    };
+    
+    FUnrealNexusProxy* Proxy;
+    FNexusStagingRing StagingRing;
+    TArray<FNexusPendingUpload> Queue;
+    TSet<uint32> QueuedNodes;
+};
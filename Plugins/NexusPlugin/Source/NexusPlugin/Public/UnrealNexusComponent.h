@@ -5,6 +5,9 @@
 #include "MeshDescription.h"
 #include "nexusdata.h"
 #include "UnrealNexusData.h"
+#include "NexusJobExecutorThread.h"
+#include "NexusOcclusionBuffer.h"
+#include "Async/TaskGraphInterfaces.h"
 
 #include "UnrealNexusComponent.generated.h"
 
@@ -18,22 +21,42 @@ namespace nx
 
 using namespace nx;
 
-enum class ENodeStatus
+enum class ENodeStatus : uint8
 {
     Dropped, // The node isn't loaded
     Pending, // The node has been selected for loading from disk
     Loaded, // The node is loaded in memory
 };
 
+// A view the cut is refined for, in model space.
+// The two eyes of a stereo pair are collapsed into a single camera
 struct FCameraInfo
 {
-    FVector2D ViewportSize;
-    FVector ViewpointLocation; // Viewport
-    FRotator ViewpointRotation;
+    FVector ViewpointLocation;
+    FQuat ViewRotation;
     FConvexVolume ViewFrustum;
+    // Size of a pixel one unit away from the viewpoint
     float CurrentResolution;
-    bool IsUsingSameResolutionAsBefore;
-    FMatrix WorldToModelMatrix;
+    // Same for the texels of the shadow cascades drawn for the view, never finer than its pixels
+    float ShadowResolution;
+    // One per eye, each of them gets its own occlusion buffer
+    TArray<FMatrix, TInlineAllocator<2>> ModelToClipMatrices;
+};
+
+using FCameraInfoArray = TArray<FCameraInfo, TInlineAllocator<2>>;
+
+// How a camera moved across the last updates, in model space
+struct FCameraMotion
+{
+    FVector LastLocation = FVector::ZeroVector;
+    FQuat LastRotation = FQuat::Identity;
+    float LastTime = 0.0f;
+    bool bHasLastPose = false;
+    FVector Velocity = FVector::ZeroVector;
+    // Rotation axis scaled by the radians per second
+    FVector AngularVelocity = FVector::ZeroVector;
+
+    FORCEINLINE bool IsMoving() const { return !Velocity.IsNearlyZero() || !AngularVelocity.IsNearlyZero(); }
 };
 
 struct FTraversalElement
@@ -43,12 +66,126 @@ struct FTraversalElement
     float CalculatedError;
 };
 
+// A node the traversal wants loaded, with its error in the cut
+struct FTraversalCandidate
+{
+    uint32 ID;
+    float Error;
+};
+
+// What the traversal decided for a node it popped from the queue.
+// The nodes are popped by their static error, so while these decisions hold
+// a full traversal would pop the same nodes in the same order
+struct FTraversalDecision
+{
+    uint32 ID;
+    // Blocked by a parent, it couldn't be expanded regardless of its error
+    bool bBlocked;
+    bool bExpanded;
+    // Popped before the blocked nodes limit was hit, so it's a candidate when not loaded
+    bool bWithinBlockLimit;
+    // Hidden by the coarse cut, its children weren't pushed
+    bool bOccluded;
+};
+
+// Everything a traversal reads from the component,
+// copied on the game thread so that the traversal can run on a worker
+struct FTraversalInputs
+{
+    FCameraInfoArray Cameras;
+    FNexusErrorParams ErrorParams;
+    // The shadow cut ignores the frustums and the normal cones, casters out of view still shade it
+    FNexusErrorParams ShadowErrorParams;
+    bool bShadowCut = false;
+    float ShadowTargetError = 0.0f;
+    // The moving cameras where they should be after the prefetch lookahead, empty when none is moving
+    FNexusErrorParams PrefetchErrorParams;
+    float CurrentError = 0.0f;
+    float TargetError = 0.0f;
+    int32 MaxBlockedNodes = 0;
+    TArray<ENodeStatus> NodeStatuses;
+    // Decisions of the previous traversal, empty when its cut can't be reused
+    TArray<FTraversalDecision> PreviousDecisions;
+    TArray<uint32> LoadedNodes;
+    // The coarse part of the previous cut, rasterized before traversing
+    TArray<FNexusOccluder> Occluders;
+    uint64 FrameNumber = 0;
+    uint32 LaunchCycles = 0;
+};
+
+// Traversal state, kept across frames and indexed by node ID.
+// A node belongs to a set when its stamp matches the current generation,
+// so starting a new traversal costs nothing regardless of the DAG size
 struct FTraversalData
 {
     FVector ComponentLocation;
+    FTraversalInputs Inputs;
     TArray<FTraversalElement> TraversalQueue;
-    TSet<uint32> BlockedNodes, SelectedNodes, VisitedNodes;
-    TArray<float> InstanceErrors;
+    // The selected nodes in selection order, check IsSelected() since nodes can be deselected afterwards
+    TArray<uint32> SelectedNodes;
+    TArray<FTraversalCandidate> Candidates;
+    TArray<FTraversalDecision> Decisions;
+    // The expanded nodes of the shadow cut, only ever loaded nodes
+    TArray<uint32> ShadowSelectedNodes;
+    // Nodes the cameras will want soon, requested after the candidates
+    TArray<FTraversalCandidate> PrefetchCandidates;
+    // Time between the launch of the traversal and its end
+    float LatencyMs = 0.0f;
+    // Whether the previous cut was still valid and got reused
+    bool bReusedPreviousCut = false;
+    // One per eye of every camera, a node is occluded when it's hidden in all of them
+    TArray<FNexusOcclusionBuffer, TInlineAllocator<2>> OcclusionBuffers;
+    int32 OccluderTriangles = 0;
+    int32 OccludedNodes = 0;
+
+    void Init(int32 NodesCount);
+    void BeginTraversal();
+
+    FORCEINLINE bool IsVisited(const uint32 NodeID) const { return VisitedStamps[NodeID] == Generation; }
+    FORCEINLINE bool IsBlocked(const uint32 NodeID) const { return BlockedStamps[NodeID] == Generation; }
+    FORCEINLINE bool IsSelected(const uint32 NodeID) const { return SelectedStamps.IsValidIndex(NodeID) && SelectedStamps[NodeID] == Generation; }
+    FORCEINLINE bool HasError(const uint32 NodeID) const { return ErrorStamps[NodeID] == Generation; }
+    FORCEINLINE bool IsNodeLoaded(const uint32 NodeID) const { return Inputs.NodeStatuses[NodeID] == ENodeStatus::Loaded; }
+    // Counts the parents of the node expanded by the shadow cut, returns the new count
+    FORCEINLINE uint32 AddShadowExpandedParent(const uint32 NodeID)
+    {
+        if (ShadowParentStamps[NodeID] != Generation)
+        {
+            ShadowParentStamps[NodeID] = Generation;
+            ShadowExpandedParents[NodeID] = 0;
+        }
+        return ++ ShadowExpandedParents[NodeID];
+    }
+    
+    FORCEINLINE void MarkVisited(const uint32 NodeID) { VisitedStamps[NodeID] = Generation; }
+    FORCEINLINE void MarkBlocked(const uint32 NodeID) { BlockedStamps[NodeID] = Generation; }
+    FORCEINLINE bool IsPrefetchVisited(const uint32 NodeID) const { return PrefetchStamps[NodeID] == Generation; }
+    FORCEINLINE void MarkPrefetchVisited(const uint32 NodeID) { PrefetchStamps[NodeID] = Generation; }
+    FORCEINLINE void MarkSelected(const uint32 NodeID)
+    {
+        SelectedStamps[NodeID] = Generation;
+        SelectedNodes.Add(NodeID);
+    }
+    FORCEINLINE void Deselect(const uint32 NodeID)
+    {
+        if (SelectedStamps.IsValidIndex(NodeID)) SelectedStamps[NodeID] = 0;
+    }
+
+    // The error calculated for the node this frame, 0 if the node wasn't reached
+    FORCEINLINE float GetError(const uint32 NodeID) const { return HasError(NodeID) ? Errors[NodeID] : 0.0f; }
+    FORCEINLINE void SetError(const uint32 NodeID, const float Error)
+    {
+        ErrorStamps[NodeID] = Generation;
+        Errors[NodeID] = Error;
+    }
+    
+private:
+    // Never 0, so that a zeroed stamp doesn't belong to any generation
+    uint32 Generation = 1;
+    TArray<uint32> VisitedStamps, BlockedStamps, SelectedStamps, ErrorStamps;
+    TArray<float> Errors;
+    TArray<uint32> ShadowParentStamps, ShadowExpandedParents;
+    TArray<uint32> PrefetchStamps;
 };
 
 
@@ -63,15 +200,15 @@ class NEXUSPLUGIN_API UUnrealNexusComponent final
     friend class UNexusJobExecutorTester;
     
 private:
-    FCameraInfo CameraInfo;
-    int CurrentlyBlockedNodes = 0;
-    int CurrentDrawBudget = 0;
+    FCameraInfoArray Cameras;
+    // Matched by index with Cameras
+    TArray<FCameraMotion, TInlineAllocator<2>> CameraMotions;
     float CurrentError = 0.0f;
     bool bIsTraversalEnabled = true;
     bool bIsFrustumCullingEnabled = true;
     
-    class FRunnableThread* JobThread = nullptr;
-    class FNexusJobExecutorThread* JobExecutor = nullptr;
+    // Filled by the shared decoding pool with the nodes requested by this component
+    TSharedPtr<FNexusJobsDoneQueue, ESPMode::ThreadSafe> JobsDone;
 
     // TODO: Load first node and calculate Radius based on that
     float ComponentBoundsRadius = 1000.0f;
@@ -80,35 +217,82 @@ private:
     // This is done to reduce the weight of outer nodes,
     // while being consistent with the tree
     const float Outer_Node_Factor = 100.0f;
-    TArray<float> CalculatedErrors;
+    // Same for the nodes whose normal cone faces away from the viewpoint,
+    // their children are only fetched when nothing else is left to refine
+    const float Backface_Node_Factor = 100.0f;
+    // The traversal runs on a worker into the back buffer, while the
+    // game thread and the proxy keep using the last published cut in the front one
+    FTraversalData TraversalBuffers[2];
+    int32 FrontTraversal = 0;
+    bool bHasPublishedTraversal = false;
+    // Any node changed status since the last traversal was launched
+    bool bNodeStatusesChanged = true;
+    FGraphEventRef TraversalTask;
+    // Updated with the camera, feeds the node error kernel
+    FNexusErrorParams ErrorParams;
+    FNexusErrorParams ShadowErrorParams;
+    FNexusErrorParams PrefetchErrorParams;
+    // Playback of PrefetchSchedule
+    bool bIsPlayingSchedule = false;
+    float ScheduleTime = 0.0f;
+    int32 NextScheduledNode = 0;
+    // Triangles of the loaded coarse nodes, the first nodes of the DAG up to the occluder triangles budget
+    TArray<FNexusOccluderMeshRef> OccluderMeshes;
     uint64 CurrentCacheSize;
+    // The directional light whose cascades the shadow cut is refined for, looked up again when it goes away
+    TWeakObjectPtr<class UDirectionalLightComponent> CascadeLight;
     
     UPROPERTY()
     TArray<UMaterialInterface*> DynamicMaterials;
 
-    float CalculateDistanceFromSphereToViewFrustum(const vcg::Sphere3f& Sphere3, const float SphereTightRadius) const;
-    float CalculateErrorForNode(const uint32 NodeID, bool UseTight) const;
-    void UpdateRemainingErrors(TArray<float>& InstanceErrors);
+    float CalculateErrorForNode(const FNexusErrorParams& Params, const uint32 NodeID, bool UseTight) const;
+    // Batched version of CalculateErrorForNode, OutErrors must be as big as NodeIDs
+    void CalculateErrorsForNodes(const FNexusErrorParams& Params, const TArrayView<const uint32> NodeIDs, const TArrayView<float> OutErrors) const;
+    void UpdateRemainingErrors(FTraversalData& TraversalData) const;
     void UpdateCameraView();
+    void AddPlayerCamera(class ULocalPlayer* Player);
+    void AddSceneCaptureCamera(const class USceneCaptureComponent2D* Capture);
+    void AddCamera(const FVector& ViewLocation, const FRotator& ViewRotation, const FMatrix& ViewProjectionMatrix, const FMatrix& ProjectionMatrix, int32 ViewWidth);
+    // Shadow texel size over the distance at the far split of the finest cascade, 0 without cascaded shadows
+    float GetCascadeShadowResolution(const FMatrix& ProjectionMatrix);
+    // Estimates the velocities of the cameras from their poses in the previous update
+    void UpdateCameraMotions();
+    // Extrapolates the moving cameras by the prefetch lookahead
+    void UpdatePrefetchViews();
+    // Hands the scheduled nodes due within the lead time to the proxy
+    void FeedPrefetchSchedule(float DeltaTime);
+    float GetShadowTargetError() const;
+    // Whether the published cut would come out of a new traversal unchanged
+    bool IsPublishedTraversalCurrent() const;
+    // Snapshots the inputs into the back buffer and starts traversing on a worker
+    void LaunchTraversal();
+    // Swaps the finished back buffer to the front and hands the new cut to the proxy
+    void PublishTraversal();
+    void WaitForTraversal();
+    void DrawDebugNodes() const;
+    FORCEINLINE FTraversalData& GetFrontTraversal() { return TraversalBuffers[FrontTraversal]; }
+    FORCEINLINE const FTraversalData& GetFrontTraversal() const { return TraversalBuffers[FrontTraversal]; }
     void AllocateMemory();
     virtual void OnRegister() override;
-    void CreateThreads();
+    void CreateJobsQueue();
     virtual void BeginPlay() override;
-    void DeleteThreads();
+    void DeleteJobsQueue();
     virtual void BeginDestroy() override;
 protected:
     class FUnrealNexusProxy* Proxy = nullptr;
-    TMap<uint32, ENodeStatus> NodeStatuses;
+    TArray<ENodeStatus> NodeStatuses;
 
-    // Updates the calculated error for the node
-    void SetErrorForNode(uint32 NodeID, float Error);
-
-    // Gets the calculated error for the node
+    // Gets the error of the node in the last published traversal
     float GetErrorForNode(uint32 NodeID) const;
     
-    bool CanNodeBeExpanded(Node* Node, int NodeID, float NodeError, float CurrentProxyError) const;
-    void AddNodeToTraversal(FTraversalData& TraversalData, const uint32 NewNodeId);
-    void AddNodeChildren(const FTraversalElement& CurrentElement, FTraversalData& TraversalData, bool ShouldMarkBlocked);
+    bool CanNodeBeExpanded(const FTraversalData& TraversalData, Node* Node, int NodeID, float NodeError, float CurrentProxyError) const;
+    bool IsNodeOccluded(const FTraversalData& TraversalData, uint32 NodeID) const;
+    // Picks the coarse nodes of the published cut and the triangles they draw
+    void GatherOccluders(TArray<FNexusOccluder>& OutOccluders) const;
+    void RasterizeOccluders(FTraversalData& TraversalData) const;
+    void AddNodesToTraversal(FTraversalData& TraversalData, const TArrayView<const uint32> NewNodeIds) const;
+    // Occluded nodes mark their children as blocked but don't push them
+    void AddNodeChildren(const FTraversalElement& CurrentElement, FTraversalData& TraversalData, bool ShouldMarkBlocked, bool bPushChildren = true) const;
 
     void NotifyNewMaterial(UMaterialInterface* DynamicMaterial);
     void NotifyMaterialDeleted(UMaterialInterface* DynamicMaterial);
@@ -120,7 +304,10 @@ public:
     
     virtual void TickComponent(float DeltaTime, ELevelTick TickType,
         FActorComponentTickFunction* ThisTickFunction) override;
+    // Size of the node in the nexus file, scaled down by the memory the compact layout saves
     uint64 GetNodeSize(const uint32 NodeID) const;
+    // bUseCompactVertices, unless the platform can't draw the compact streams
+    bool UsesCompactVertices() const;
     void UnloadNode(uint32 UnloadedNodeID);
     void RequestNode(const uint32 BestNodeID);
 
@@ -137,18 +324,51 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     int MaxBlockedNodes = 30;
     
+    // Size in the nexus file of the resident nodes, compact nodes count for the part of it they take on the GPU
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     int DrawBudget = 1024 * 1024 * 1024 * 1; // 1 GB
 
+    // Memory of the loaded textures, the unused ones are unloaded first and then the nodes using them
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int TextureBudget = 256 * 1024 * 1024; // 256 MB
+
+    // Keep the resident nodes with 16 bit positions relative to the node and half float UVs,
+    // so that the same DrawBudget holds a finer cut. Read when the render state is created.
+    // Does nothing on the platforms with manual vertex fetch (D3D11, D3D12, Vulkan and Metal SM5),
+    // the vertex factory only reads float positions there. A warning is logged when it's ignored
+    UPROPERTY(EditAnywhere)
+    bool bUseCompactVertices = false;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite, META=(ClampMin="0", ClampMax="50"))
     float TargetError = 2.0f;
 
+    // Seconds ahead of a moving camera the nodes are prefetched for, 0 disables prefetching.
+    // Prefetched nodes are only requested when the current view has nothing left to request
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, META=(ClampMin="0", ClampMax="5"))
+    float PrefetchLookahead = 0.5f;
+
+    // Nodes needed by a known camera path, requested ahead of the current view while the schedule plays
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    class UNexusPrefetchSchedule* PrefetchSchedule = nullptr;
+
+    // Seconds before the scheduled time a node is requested
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, META=(ClampMin="0", ClampMax="30"))
+    float PrefetchScheduleLead = 2.0f;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite, META=(ClampMin="0", ClampMax="30"))
     float MaxError;
     
+    // When two cached nodes are worth the same, evict the one that was drawn least recently
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bBreakEvictionTiesByLRU = true;
+    
     UPROPERTY(EditAnywhere)
     bool bShowDebugStuff = false;
 
+    // Scene captures showing the model, the cut is refined for them along with the local players
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    TArray<class USceneCaptureComponent2D*> SceneCaptures;
+
     UPROPERTY(EditAnywhere)
     class UMaterialInterface* ModelMaterial = nullptr;
 
@@ -161,6 +381,17 @@ public:
     UFUNCTION(BlueprintCallable)
     void ToggleFrustumCulling(bool NewFrustumCullingState);
 
+    // Starts feeding PrefetchSchedule from StartTime, call it when the shot or the tour starts
+    UFUNCTION(BlueprintCallable)
+    void PlayPrefetchSchedule(float StartTime = 0.0f);
+
+    UFUNCTION(BlueprintCallable)
+    void StopPrefetchSchedule();
+
+    // Keeps the schedule in sync with a sequence player that was paused or scrubbed
+    UFUNCTION(BlueprintCallable)
+    void SetPrefetchScheduleTime(float Time);
+
     UFUNCTION(BlueprintCallable, BlueprintPure)
     FORCEINLINE bool IsFrustumCullingEnabled() const { return bIsFrustumCullingEnabled; }
     
@@ -170,9 +401,17 @@ public:
     */
     
     virtual void GetUsedMaterials(TArray <UMaterialInterface *> & OutMaterials, bool bGetDebugMaterials) const override;
+    virtual void GetStreamingRenderAssetInfo(FStreamingTextureLevelContext& LevelContext, TArray<FStreamingRenderAssetPrimitiveInfo>& OutStreamingRenderAssets) const override;
     virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
     bool IsNodeLoaded(uint32 NodeID) const;
     void SetNodeStatus(uint32 NodeID, ENodeStatus NewStatus);
-    void ClearErrors();
-    FTraversalData DoTraversal();
+    // Runs on a worker, must only touch TraversalData and the immutable asset data
+    void DoTraversal(FTraversalData& TraversalData) const;
+    void DoFullTraversal(FTraversalData& TraversalData) const;
+    // Picks the cut drawn into the shadow maps among the loaded nodes, so that shadows never request any node
+    void DoShadowTraversal(FTraversalData& TraversalData) const;
+    // Walks the loaded nodes with the extrapolated cameras and collects the unloaded ones they would want
+    void DoPrefetchTraversal(FTraversalData& TraversalData) const;
+    // Checks the decisions of the previous traversal against the new errors, and reuses its cut if none changed
+    bool TryReusingPreviousCut(FTraversalData& TraversalData) const;
 };
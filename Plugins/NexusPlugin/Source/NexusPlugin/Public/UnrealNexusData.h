@@ -1,12 +1,35 @@
 ﻿#pragma once
 #include "dag.h"
 #include "nexusdata.h"
+#include "NexusContainerFile.h"
+#include "NexusJobExecutorThread.h"
+#include "NexusNodeTable.h"
 #include "Engine/StreamableManager.h"
+#include "Engine/Texture2D.h"
 
 #include "UnrealNexusData.generated.h"
 
 using namespace nx;
 
+UENUM()
+enum class ENexusNodeSource : uint8
+{
+    // Every node is stored in its own UUnrealNexusNodeData asset
+    NodeAssets,
+    // Nodes are read straight from the imported .nxs/.nxz file
+    ContainerFile
+};
+
+UENUM()
+enum class ENexusTextureSource : uint8
+{
+    // Every texture is stored in its own UTexture2D asset
+    TextureAssets,
+    // Textures are kept as the jpegs found in the nexus file and decoded when they're first used,
+    // smaller on disk for some CPU time while streaming
+    CompressedImages
+};
+
 USTRUCT()
 struct FUnrealNexusNode {
     GENERATED_BODY()
@@ -33,6 +56,9 @@ class NEXUSPLUGIN_API UUnrealNexusData final : public UObject
 
     void SerializeNodes(FArchive& Archive);
 
+    // Reads the compressed image of a texture and hands it over to the decoding workers
+    void RequestTextureImage(uint32 TextureID);
+    void QueueImageDecoding(FNexusTextureImage&& Image);
     
 public:
     UUnrealNexusData();
@@ -49,24 +75,68 @@ public:
     UPROPERTY()
     int RootsCount;
 
+    UPROPERTY(VisibleAnywhere, Category=Nexus)
+    ENexusNodeSource NodeSource = ENexusNodeSource::NodeAssets;
+
+    // Path of the container file, relative to the project content directory.
+    // The folder must be staged as a non asset directory when packaging
+    UPROPERTY(VisibleAnywhere, Category=Nexus)
+    FString ContainerFilePath;
+
+    UPROPERTY(VisibleAnywhere, Category=Nexus)
+    ENexusTextureSource TextureSource = ENexusTextureSource::TextureAssets;
+
+    // Where the image of every texture begins in the container, plus where the last one ends.
+    // Only used when the textures are compressed images streamed from the container file
+    UPROPERTY()
+    TArray<int64> TextureImageOffsets;
+
+    // The textures decoded at runtime, kept from the first LoadTextureForNode until UnloadTexture
+    UPROPERTY(Transient)
+    TMap<uint32, UTexture2D*> DecodedTextures;
+    // Requested textures whose image is being read or decoded
+    TSet<uint32> DecodingTextures;
+    TSharedPtr<FNexusJobsDoneQueue, ESPMode::ThreadSafe> ImageJobsDone;
+    // Keeps the asset holding the image of a texture loaded until the image is decoded
+    TMap<uint32, TSharedPtr<FStreamableHandle>> ImageOwnerHandles;
+    // The first node using every texture, built on first use
+    TArray<int32> TextureOwners;
+
     TMap<uint32, TSharedPtr<FStreamableHandle>> NodeHandles;
     TMap<uint32, TSharedPtr<FStreamableHandle>> NodeTexturesHandles;
+    TUniquePtr<FNexusContainerFile> ContainerFile;
+    FNexusNodeTable NodeTable;
 
 
 
     vcg::Sphere3f &BoundingSphere();
     bool Intersects(vcg::Ray3f &Ray, float &Distance);
     uint32_t Size(uint32_t Node);
+    // The node bounds laid out for the traversal, built on first use
+    const FNexusNodeTable& GetNodeTable();
     void LoadNodeAsync(const uint32 NodeID, FStreamableDelegate Callback);
     void UnloadNode(const int NodeID);
     void LoadTextureForNode(const uint32 NodeID, FStreamableDelegate Callback);
     UTexture* GetTexture(const uint32 TextureID);
     void UnloadTexture(const int NodeID);
+    bool HasTexture(uint32 TextureID) const;
+    bool IsTextureLoaded(uint32 TextureID) const;
+    // The textures whose compressed image is stored with the node
+    void GetOwnedTextures(uint32 NodeID, TArray<uint32, TInlineAllocator<4>>& OutTextures);
+    int32 GetTextureOwner(uint32 TextureID);
+    // Game thread, turns the images decoded by the workers into textures
+    void UpdateDecodedTextures();
     
     class UUnrealNexusNodeData* GetNode(uint32 NodeId);
 
+    // Gets the data of a requested node, wherever it was loaded from
+    class INexusNodeData* GetNodeData(uint32 NodeId);
+    // Keeps a streamed node alive after UnloadNode until the reference goes away, nullptr for node assets
+    TSharedPtr<class INexusNodeData, ESPMode::ThreadSafe> PinNodeData(uint32 NodeId) const;
+
     // Unreal engine specific stuff
     // Begin UObject interface
     virtual void Serialize( FArchive& Archive ) override;
+    virtual void BeginDestroy() override;
     // End UObject interface
 };
@@ -1,12 +1,49 @@
 ﻿#pragma once
 #include "dag.h"
 #include "nexusdata.h"
+#include "NexusBufferPool.h"
+#include "PackedNormal.h"
+#include "Serialization/BulkData.h"
 
 
 #include "UnrealNexusNodeData.generated.h"
 
+DECLARE_STATS_GROUP(TEXT("Unreal Nexus Loading"), STATGROUP_NexusLoading, STATCAT_Advanced);
+
+// A texture kept as the compressed image found in the nexus file,
+// it's decoded by a worker when the texture residency first uses it
+struct FNexusTextureImage
+{
+    uint32 TextureID = 0;
+    TArray<uint8> Bytes;
+
+    friend FArchive& operator<<(FArchive& Archive, FNexusTextureImage& Image)
+    {
+        Archive << Image.TextureID;
+        Image.Bytes.BulkSerialize(Archive);
+        return Archive;
+    }
+};
+
+// A node whose payload can be handed over to the decoding thread,
+// regardless of where the payload was read from
+class NEXUSPLUGIN_API INexusNodeData
+{
+public:
+    virtual ~INexusNodeData() = default;
+    
+    virtual bool IsDataDecoded() const = 0;
+    virtual void DecodeData(nx::Header& Header, int VertsCount, int FacesCount) = 0;
+    virtual nx::NodeData& GetNodeData() = 0;
+    // Tangent and normal of every vertex computed at import, empty if the node has to generate them
+    virtual TArrayView<const FPackedNormal> GetTangentFrames() const { return {}; }
+    // Compressed images of the textures the node owns, empty unless the asset decodes its textures at runtime
+    virtual TArrayView<const FNexusTextureImage> GetTextureImages() const { return {}; }
+};
+
 UCLASS()
-class NEXUSPLUGIN_API UUnrealNexusNodeData final : public UObject
+class NEXUSPLUGIN_API UUnrealNexusNodeData final
+    : public UObject, public INexusNodeData
 {
     GENERATED_BODY()
 private:
@@ -14,14 +51,36 @@ private:
     
     UPROPERTY()
     UTexture2D* UncompressedTexture = nullptr;
+
+    // The node data as found in the nexus file (corto compressed for nxz files)
+    FByteBulkData NodePayload;
+
+    // Backs NexusNodeData.memory once the node has been decoded
+    FNexusPooledBuffer DecodedMemory;
+
+    // Two packed normals per vertex, in the geometry pool layout
+    TArray<FPackedNormal> TangentFrames;
+
+    TArray<FNexusTextureImage> TextureImages;
+
+    void SerializeLegacyNodeData(FArchive& Archive);
     
 public:
     nx::NodeData NexusNodeData;
     uint32 NodeSize = 0;
     
-    FORCEINLINE bool IsDataDecoded() const { return DidDecodeData; }
-    void DecodeData(nx::Header& Header, int VertsCount, int FacesCount);
-    void SerializeNodeData(FArchive& Archive, nx::NodeData& NodeData);
+    // Begin INexusNodeData interface
+    virtual bool IsDataDecoded() const override { return DidDecodeData; }
+    virtual void DecodeData(nx::Header& Header, int VertsCount, int FacesCount) override;
+    virtual nx::NodeData& GetNodeData() override { return NexusNodeData; }
+    virtual TArrayView<const FPackedNormal> GetTangentFrames() const override { return TangentFrames; }
+    virtual TArrayView<const FNexusTextureImage> GetTextureImages() const override { return TextureImages; }
+    // End INexusNodeData interface
+    
+    void SetTangentFrames(TArrayView<const FPackedNormal> InTangentFrames);
+    void AddTextureImage(uint32 TextureID, const uint8* Data, uint32 Size);
+    void SetNodePayload(const uint8* Data, uint32 Size, bool bMemoryMapped = false);
+    void SerializeNodeData(FArchive& Archive);
 
     // Begin UObject interface
     virtual void Serialize( FArchive& Archive ) override;
@@ -1,49 +1,63 @@
 ﻿#pragma once
 
 #include "UnrealNexusComponent.h"
+#include "NexusIndexedHeap.h"
+#include "NexusGeometryPool.h"
+#include "NexusUploadScheduler.h"
+#include "NexusTextureResidency.h"
+#include "NexusPrefetchSchedule.h"
 
+// A loaded node, its geometry lives in one of the shared geometry pages
 class FNexusNodeRenderData
 {   
 public:
-    FLocalVertexFactory NodeVertexFactory;
-    FVertexBufferWithSRV PositionBuffer;
-    FVertexBufferWithSRV ColorBuffer;
-    FVertexBufferWithSRV TexCoordsBuffer;
-    FVertexBufferWithSRV TangentBuffer;
-    FIndexBuffer IndexBuffer;
-
-    UMaterialInstanceDynamic* InstancedMaterial = nullptr;
-
-    bool bHasColors = false;
+    FNexusGeometryAllocation Allocation;
+    // Folded in the transform of the node draws when the vertices are compact
+    FVector4 Dequantization;
     
     int NumPrimitives;
-    uint32_t CurrentSetTextureID = UINT32_MAX;
-
-    FNexusNodeRenderData(const FUnrealNexusProxy* Proxy, NodeData& Data, Node& Node, UMaterialInstanceDynamic* InInstancedMaterial = nullptr);
-    void CreatePositionBuffer(nx::Node& Node, nx::NodeData& Data);
-    void InitColorBuffer(const FUnrealNexusProxy* Proxy, Signature& TheSig, NodeData& Data, Node& Node);
-    void CreateIndexBuffer(Signature& Sig, Node& Node, nx::NodeData& Data);
-    void InitTexBuffer(const FUnrealNexusProxy* Proxy, Signature& TheSig, NodeData& Data, Node& Node);
-    static void CalculateTangents(TArray<FPackedNormal>& OutTangents, Signature& TheSig,  NodeData& Data, Node& Node);
-    void InitTangentsBuffer(const FUnrealNexusProxy* Proxy, Signature& TheSig, NodeData& Data, Node& Node);
-    void InitVertexFactory();
-    ~FNexusNodeRenderData();
+
+    FNexusNodeRenderData(const FNexusGeometryAllocation& InAllocation, const FVector4& InDequantization, uint32 InNumPrimitives);
 };
 
-struct FCandidateNode
+// How much a loaded node is worth keeping in the cache
+struct FNexusResidentPriority
 {
-    uint32 ID;
-    float FirstNodeError;
-    float CandidateError;
+    // Error per byte, so that big nodes with a small error go first
+    float Score;
+    float Error;
+    // Breaks the ties between equal scores, 0 when the LRU tie break is disabled
+    uint32 LastUsedFrame;
+};
 
-    bool operator==(const uint32 OtherID) const
+// Puts the node that should be evicted first on top of the cache heap
+struct FNexusEvictFirst
+{
+    FORCEINLINE bool operator()(const FNexusResidentPriority& A, const FNexusResidentPriority& B) const
     {
-        return OtherID == ID;
+        return A.Score < B.Score || (A.Score == B.Score && A.LastUsedFrame < B.LastUsedFrame);
     }
-    explicit operator uint32 () const
+};
+
+// Render thread copy of the last published cut,
+// the traversal buffers are rewritten by the next traversal while frames are drawn
+struct FNexusRenderCut
+{
+    TArray<uint32> SelectedNodes;
+    // The nodes facing away from the view aren't drawn
+    bool bCullBackfaces = false;
+
+    void Init(int32 NodesCount);
+    void Update(TArray<uint32>&& InSelectedNodes, bool bInCullBackfaces);
+    FORCEINLINE bool IsSelected(const uint32 NodeID) const { return SelectedStamps.IsValidIndex(NodeID) && SelectedStamps[NodeID] == Generation; }
+    FORCEINLINE void Deselect(const uint32 NodeID)
     {
-        return ID;
+        if (SelectedStamps.IsValidIndex(NodeID)) SelectedStamps[NodeID] = 0;
     }
+    
+private:
+    uint32 Generation = 1;
+    TArray<uint32> SelectedStamps;
 };
 
 enum class EFrustumCullingResult
@@ -58,15 +72,58 @@ class FUnrealNexusProxy final
 {
     friend class FNexusNodeRenderData;
     friend class UUnrealNexusComponent;
+    friend class FNexusUploadScheduler;
 protected:
     class UUnrealNexusData* ComponentData;
     class UUnrealNexusComponent* Component;
 
     TArray<FBoxSphereBounds> MeshBounds;
     
-    FCameraInfo LastCameraInfo;
+    // Render thread only
     TMap<uint32, FNexusNodeRenderData*> LoadedMeshData;
-    TArray<FCandidateNode> CandidateNodes;
+    FNexusRenderCut RenderCut;
+    // Drawn into the shadow maps instead of RenderCut, when the traversal picks one
+    FNexusRenderCut ShadowCut;
+    bool bHasShadowCut = false;
+    TArray<FNexusGeometryPage*> GeometryPages;
+    // Game thread view of the geometry pages, and where every loaded node was placed
+    FNexusGeometryAllocator GeometryAllocator;
+    TArray<FNexusGeometryAllocation> NodeAllocations;
+    // Frames since a node was loaded or dropped, the pages are compacted when nothing is streaming
+    int32 GeometryIdleFrames = 0;
+    bool bCompactVertices = false;
+    // Backfacing nodes can only be dropped when the material culls the back faces anyway
+    bool bCanCullBackfaces = false;
+
+    // Game thread, one material instance per loaded texture shared by all the nodes drawing with it
+    FNexusTextureResidency TextureResidency;
+    TMap<uint32, UMaterialInstanceDynamic*> TextureMaterials;
+    // Render thread copy of the materials that are ready
+    TMap<uint32, FMaterialRenderProxy*> TextureMaterialProxies;
+    FNexusUploadScheduler UploadScheduler;
+    // Game thread mirror of the loaded nodes, worst node on top
+    TNexusIndexedHeap<FNexusResidentPriority, FNexusEvictFirst> ResidentNodes;
+    // Nodes the last traversal wants loaded, highest error on top
+    TNexusIndexedHeap<float, TGreater<>> CandidateNodes;
+    // Nodes the cameras will want after the prefetch lookahead, requested once no candidate is left
+    TNexusIndexedHeap<float, TGreater<>> PrefetchNodes;
+    // Prefetched nodes that weren't drawn yet, they count as hits once drawn and as misses if evicted first
+    TSet<uint32> PrefetchedNodes;
+    uint32 PrefetchHits = 0;
+    uint32 PrefetchMisses = 0;
+    // Nodes of the prefetch schedule that are due, earliest first
+    TNexusIndexedHeap<float, TLess<>> ScheduledNodes;
+    // The scheduled nodes whose time didn't come yet, the cache values them by their scheduled error
+    TMap<uint32, FNexusScheduledNode> UpcomingNodes;
+    // The earliest upcoming nodes that fit in DrawBudget, only these keep their scheduled error
+    TSet<uint32> ProtectedUpcomingNodes;
+    // The scheduled nodes and the candidates of the current view take turns
+    bool bLastRequestWasScheduled = false;
+    // Prefetched nodes until the prediction expires, Time is in world seconds.
+    // The cache values them by the error they'll have once the cameras get there
+    TMap<uint32, FNexusScheduledNode> PredictedNodes;
+    TArray<uint32> LastUsedFrames;
+    uint32 CurrentFrame = 0;
     bool bIsWireframe = false;
     
     int PendingCount = 0;
@@ -75,9 +132,12 @@ protected:
 
     mutable int TotalRenderedCount = 0;
     FMaterialRenderProxy* MaterialProxy;
-    FTraversalData LastTraversalData;
 
     void AddCandidate(uint32 CandidateID, float FirstNodeError);
+    // Refreshes the cache priorities with the errors of the last traversal
+    void UpdateResidentPriorities();
+    // The error the cache ranks the node by, the upcoming scheduled and prefetched nodes are worth their expected error
+    float GetCacheError(uint32 NodeID) const;
     void UnloadNode(uint32 WorstID);
     
     // Removes the worst node in the cache until there's enough space to load other nodes
@@ -87,19 +147,41 @@ protected:
     void Flush();
     
     TOptional<TTuple<uint32, Node*>> FindBestNode();
+    // Requests the best prefetch node, without evicting anything worth more than it right now
+    void RequestPrefetchNode();
+    // Requests the earliest scheduled node, returns false when none is due or the cache has no room for it
+    bool RequestScheduledNode();
 
     void RemoveCandidateWithId(const uint32 NodeID);
     void BeginFrame(float DeltaSeconds);
-    void Update(FCameraInfo InLastCameraInfo, FTraversalData InLastTraversalData);
+    // Takes the candidates and the cut of a freshly published traversal
+    void ConsumeTraversal(const FTraversalData& Traversal);
+    // Requests the best candidate, called every frame even when no new traversal was published
+    void Update();
     void EndFrame();
 
-    bool IsContainedInViewFrustum(const FVector& SphereCenter, float SphereRadius) const;
+    // Places the node geometry in the pool, opening a new page if none has room for it
+    FNexusGeometryAllocation AllocateGeometry(uint32 N);
+    // Releases the empty pages and moves the nodes out of a sparse one
+    void CompactGeometry();
+    // Creates the materials of the textures that finished loading and unloads the textures over the budget
+    void UpdateTextures();
+    // Tells the texture streamer the mips the errors of the last traversal need
+    void UpdateTextureMips();
+    // Render thread, copies a staged node to the pool and starts drawing it from there
+    void CommitUpload(const FNexusPendingUpload& Upload, const FNexusNodeStreams& Streams, uint32 NumPrimitives);
+
+    // The sphere is in model space, the cut serves every view so each of them culls it on its own.
+    // Shadow frustums are translated, see FSceneView::GetPreShadowTranslation
+    bool IsContainedInFrustum(const FConvexVolume& Frustum, const FVector& Translation, const FVector& SphereCenter, float SphereRadius) const;
     
 public:
     explicit FUnrealNexusProxy(UUnrealNexusComponent* TheComponent, const int InMaxPending = 5);
 
     ~FUnrealNexusProxy();
-    void LoadGPUData(uint32 N);
+    void AddScheduledNode(const FNexusScheduledNode& Scheduled);
+    void ClearScheduledNodes();
+    void LoadGPUData(uint32 N, const TSharedPtr<FNexusPreparedStreams, ESPMode::ThreadSafe>& Streams = nullptr);
     void DropGPUData(uint32 N);
     
     virtual SIZE_T GetTypeHash() const override
@@ -110,6 +192,8 @@ public:
     
     virtual bool CanBeOccluded() const override;
     virtual uint32 GetMemoryFootprint() const override { return sizeof *this + GetAllocatedSize(); }
+    // Transform of the draws of a node with compact vertices, valid for the current frame
+    const FDynamicPrimitiveUniformBuffer& AllocateNodeUniformBuffer(FMeshElementCollector& Collector, const FNexusNodeRenderData& Data) const;
     void DrawEdgeNodes(const int ViewIndex, const FSceneView* View, FMeshElementCollector& Collector, const FEngineShowFlags& EngineShowFlags) const;
     virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily,
                                         uint32 VisibilityMap, FMeshElementCollector& Collector) const override;
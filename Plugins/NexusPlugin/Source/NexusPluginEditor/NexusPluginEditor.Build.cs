@@ -1,4 +1,4 @@
-// Copyright Epic Games, Inc. All Rights Reserved.
+﻿// Copyright Epic Games, Inc. All Rights Reserved.
 
 using UnrealBuildTool;
 using System.IO;
@@ -52,8 +52,14 @@ public class NexusPluginEditor : ModuleRules
 			new string[]
 			{
 				"UnrealEd",
+				"LevelSequence",
+				"MovieScene",
+				"MovieSceneTracks",
+				"CinematicCamera",
 			}
 			);
+
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "MikkTSpace");
 		
 		
 		DynamicallyLoadedModuleNames.AddRange(
@@ -6,8 +6,11 @@
 #include "UnrealNexusNodeData.h"
 #include "NexusUtils.h"
 #include "NodeDataFactory.h"	
+#include "NexusCommons.h"
+#include "NexusBufferPool.h"
 #include "Engine/Texture2D.h"
 #include "Factories/Texture2dFactoryNew.h"
+#include "Async/ParallelFor.h"
 
 DEFINE_LOG_CATEGORY(NexusEditorInfo)
 DEFINE_LOG_CATEGORY(NexusEditorErrors)
@@ -100,73 +103,156 @@ bool UNexusFactory::ReadDataIntoNexusFile(UUnrealNexusData* UnrealNexusData, uin
     return ParseHeader(UnrealNexusData, Buffer, BufferEnd);
 }
 
-UTexture2D* CreateTexture2DFromData(FName Name, UPackage* Outer, int Width, int Height, EPixelFormat InFormat, uint8* InData)
+static TextureCompressionSettings GetCompressionSettings(const ENexusTextureCompression Compression)
 {
-    // Copied from UTexture2D::CreateTransient()
-    UTexture2D* NewTexture = NewObject<UTexture2D>(
-    Outer,
-    Name,
-    RF_Public | RF_Standalone
-    );
-    
-    NewTexture->PlatformData = new FTexturePlatformData();
-    NewTexture->PlatformData->SizeX = Width;
-    NewTexture->PlatformData->SizeY = Height;
-    NewTexture->PlatformData->PixelFormat = InFormat;
-
-    // Allocate first mipmap.
-    const int32 NumBlocksX = Width / GPixelFormats[InFormat].BlockSizeX;
-    const int32 NumBlocksY = Height / GPixelFormats[InFormat].BlockSizeY;
-    FTexture2DMipMap* Mip = new FTexture2DMipMap();
-    NewTexture->PlatformData->Mips.Add(Mip);
-    Mip->SizeX = Width;
-    Mip->SizeY = Height;
-    Mip->BulkData.Lock(LOCK_READ_WRITE);
-    const uint32 Size = NumBlocksX * NumBlocksY * GPixelFormats[InFormat].BlockBytes;
-    Mip->BulkData.Realloc(Size);
-    Mip->BulkData.Unlock();
-    
-    uint8* Data = static_cast<uint8*>(Mip->BulkData.Lock(LOCK_READ_WRITE));
-    FMemory::Memcpy(Data, InData, Size);
-    Mip->BulkData.Unlock();
-    NewTexture->UpdateResource();
-    return NewTexture;
+    switch (Compression)
+    {
+    case ENexusTextureCompression::BC1:
+        return TC_Default;
+    case ENexusTextureCompression::BC7:
+        return TC_BC7;
+    default:
+        // Uncompressed textures are TC_Default with CompressionNone, which keeps them as BGRA8
+        return TC_Default;
+    }
 }
 
-UTexture2D* ReadTextureFromBuffer(const UUnrealNexusData* NexusData, const uint8* Buffer, UINT32 Offset, UINT32 TextureSize, uint32 NodeID)
+struct FDecodedNodeTexture
 {
-    const uint8* TextureMemory = Buffer + Offset;
-    TArray64<uint8> DecodedTexture;
+    TArray64<uint8> Pixels;
+    int32 Width = 0;
+    int32 Height = 0;
+};
+
+void UNexusFactory::CreateNodeTextures(UUnrealNexusData* Data, const TArray<Texture>& Textures, const uint8* FileBegin) const
+{
+    // The last texture only marks the end of the previous one
+    const int32 TexturesCount = Textures.Num() - 1;
+    if (TexturesCount <= 0) return;
+    const double StartTime = FPlatformTime::Seconds();
+
+    // 1) Decode the jpegs, every texture has its own image wrapper
     IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
-    TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::JPEG);
+    TArray<FDecodedNodeTexture> DecodedTextures;
+    DecodedTextures.SetNum(TexturesCount);
+    ParallelFor(TexturesCount, [&](const int32 i)
+    {
+        const uint32 TextureSize = Textures[i + 1].offset - Textures[i].offset;
+        TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::JPEG);
+        FDecodedNodeTexture& Decoded = DecodedTextures[i];
+        if (!ImageWrapper->SetCompressed(FileBegin + Textures[i].offset, TextureSize) || !ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, Decoded.Pixels)) return;
+        Decoded.Width = ImageWrapper->GetWidth();
+        Decoded.Height = ImageWrapper->GetHeight();
+    });
+    const double DecodeTime = FPlatformTime::Seconds() - StartTime;
+
+    // 2) Create the assets with the decoded pixels as their source
+    const FString PackagePath = Data->GetOutermost()->GetName();
+    TArray<UTexture2D*> NewTextures;
+    uint64 SourceBytes = 0;
+    for (int32 i = 0; i < TexturesCount; i ++)
+    {
+        FDecodedNodeTexture& Decoded = DecodedTextures[i];
+        if (Decoded.Pixels.Num() == 0)
+        {
+            UE_LOG(NexusEditorErrors, Error, TEXT("Could not decode texture %d"), i);
+            continue;
+        }
+        const FString TexturePackagePath = FString::Printf(TEXT("%s_NodeTexture_%d"), *PackagePath, i);
+        const FString TextureName = FPaths::GetBaseFilename(TexturePackagePath);
+        UPackage* TexturePackage = CreatePackage(nullptr, *TexturePackagePath);
+        UTexture2D* NewTexture = NewObject<UTexture2D>(TexturePackage, *TextureName, RF_Public | RF_Standalone);
+        NewTexture->Source.Init(Decoded.Width, Decoded.Height, 1, 1, TSF_BGRA8, Decoded.Pixels.GetData());
+        NewTexture->CompressionSettings = GetCompressionSettings(TextureCompression);
+        NewTexture->CompressionNone = TextureCompression == ENexusTextureCompression::Uncompressed;
+        NewTexture->CompressionQuality = TextureCompressionQuality;
+        // The World group builds the mip chain, non power of two textures get none and are only ever loaded whole
+        NewTexture->MipGenSettings = TMGS_FromTextureGroup;
+        NewTexture->LODGroup = TEXTUREGROUP_World;
+        NewTexture->SRGB = true;
+        // The mips are streamed by the errors of the nodes using the texture
+        NewTexture->NeverStream = false;
+        SourceBytes += Decoded.Pixels.Num();
+        Decoded.Pixels.Empty();
+        
+        Data->NodeTexturesPaths[i] = NewTexture;
+        NewTextures.Add(NewTexture);
+    }
 
-    check(ImageWrapper->SetCompressed(TextureMemory, TextureSize));
-    check(ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, DecodedTexture));
+    // 3) Encode them, every texture builds its platform data on its own worker
+    const double EncodeStartTime = FPlatformTime::Seconds();
+    for (UTexture2D* NewTexture : NewTextures)
+    {
+        NewTexture->BeginCachePlatformData();
+    }
+    uint64 EncodedBytes = 0;
+    for (UTexture2D* NewTexture : NewTextures)
+    {
+        NewTexture->FinishCachePlatformData();
+        NewTexture->UpdateResource();
+        NewTexture->MarkPackageDirty();
+        EncodedBytes += NewTexture->CalcTextureMemorySizeEnum(TMC_AllMips);
+    }
+    const double EncodeTime = FPlatformTime::Seconds() - EncodeStartTime;
     
-    const FString PackagePath = NexusData->GetOutermost()->GetName();
-    const FString TexturePackagePath = FString::Printf(TEXT("%s_NodeTexture_%d"), *PackagePath, NodeID);
-    const FString TextureName = FPaths::GetBaseFilename(TexturePackagePath);
-    UPackage* TexturePackage = CreatePackage(nullptr, *TexturePackagePath);
-    UTexture2D* NewTexture = CreateTexture2DFromData(*TextureName, TexturePackage, ImageWrapper->GetWidth(), ImageWrapper->GetHeight(), EPixelFormat::PF_B8G8R8A8, DecodedTexture.GetData());
-    TexturePackage->MarkPackageDirty();
-    return NewTexture;
+    const double SourceMTexels = SourceBytes / 4.0 / (1024.0 * 1024.0);
+    UE_LOG(NexusEditorInfo, Log, TEXT("NEXUS: Encoded %d textures, %.1f Mtexels: decoded in %.2fs, compressed in %.2fs (%.1f Mtexels/s)"),
+        NewTextures.Num(), SourceMTexels, DecodeTime, EncodeTime, EncodeTime > 0.0 ? SourceMTexels / EncodeTime : 0.0);
+    UE_LOG(NexusEditorInfo, Log, TEXT("\t %.1f MB uncompressed, %.1f MB with the mips once encoded"),
+        SourceBytes / (1024.0 * 1024.0), EncodedBytes / (1024.0 * 1024.0));
 }
 
-void UNexusFactory::InitData(UUnrealNexusData* Data, uint8*& Buffer, const uint8* FileBegin) const
+void UNexusFactory::KeepCompressedTextures(UUnrealNexusData* Data, const TArray<Texture>& Textures, const uint8* FileBegin) const
 {
-    using namespace Utils;
-    using namespace DataUtils;
+    Data->TextureSource = ENexusTextureSource::CompressedImages;
+    if (Data->NodeSource == ENexusNodeSource::ContainerFile)
+    {
+        // The images are read from the container when the textures are first used
+        for (const Texture& TheTexture : Textures)
+        {
+            Data->TextureImageOffsets.Add(TheTexture.offset);
+        }
+        return;
+    }
 
-    const auto PackagePath = Data->GetOutermost()->GetName();
-    // Read all nodes
-    UNodeDataFactory* NodeFactory = NewObject<UNodeDataFactory>();
-    for (uint32 i = 0; i < Data->Header.n_nodes; i ++)
+    // Every image goes in the asset of the first node using it
+    uint64 ImagesSize = 0;
+    for (int32 N = 0; N < Data->Nodes.Num(); N ++)
     {
-        const auto Node = ReadNode(Buffer);
-        Data->Nodes.Add(FUnrealNexusNode {Node});
+        TArray<uint32, TInlineAllocator<4>> OwnedTextures;
+        Data->GetOwnedTextures(N, OwnedTextures);
+        UUnrealNexusNodeData* NodeData = Cast<UUnrealNexusNodeData>(Data->Nodes[N].NodeDataPath.ResolveObject());
+        if (NodeData == nullptr) continue;
+        for (const uint32 TextureID : OwnedTextures)
+        {
+            if (static_cast<int32>(TextureID) + 1 >= Textures.Num()) continue;
+            const uint32 ImageSize = Textures[TextureID + 1].offset - Textures[TextureID].offset;
+            NodeData->AddTextureImage(TextureID, FileBegin + Textures[TextureID].offset, ImageSize);
+            ImagesSize += ImageSize;
+        }
     }
+    UE_LOG(NexusEditorInfo, Log, TEXT("NEXUS: Kept %d textures as %.1f MB of compressed images"), Textures.Num() - 1, ImagesSize / (1024.0 * 1024.0));
+}
 
-    // Fill their NodeData memory
+static bool ComputeNodeTangentFrames(UUnrealNexusData* Data, const Node& TheNode, const uint8* Payload, const uint32 PayloadSize, TArray<FPackedNormal>& OutTangentFrames)
+{
+    Signature& TheSig = Data->Header.signature;
+    if (!TheSig.face.hasIndex() || !TheSig.vertex.hasNormals()) return false;
+    
+    NodeData DecodedData;
+    FNexusPooledBuffer DecodedMemory;
+    UTexture2D* UnusedTexture = nullptr;
+    LoadUtils::LoadNodeData(Data->Header, TheNode.nvert, TheNode.nface, DecodedData, Payload, PayloadSize, DecodedMemory, UnusedTexture);
+    const bool bComputed = DecodedData.memory != nullptr && TangentUtils::ComputeTangentFrames(TheSig, DecodedData, TheNode, OutTangentFrames);
+    // The memory belongs to the pooled buffer
+    DecodedData.memory = nullptr;
+    return bComputed;
+}
+
+void UNexusFactory::CreateNodeAssets(UUnrealNexusData* Data, const uint8* FileBegin) const
+{
+    const auto PackagePath = Data->GetOutermost()->GetName();
+    UNodeDataFactory* NodeFactory = NewObject<UNodeDataFactory>();
     for (uint32 i = 0; i < Data->Header.n_nodes - 1; i ++)
     {
         
@@ -179,12 +265,51 @@ void UNexusFactory::InitData(UUnrealNexusData* Data, uint8*& Buffer, const uint8
         UUnrealNexusNodeData* UNodeData = NodeFactory->CreateNodeAssetFile(NodeDataPackage, NodeName, RF_Public | RF_Standalone);
         // ReSharper disable once CppExpressionWithoutSideEffects
         UNodeData->MarkPackageDirty();
-        UNodeData->NodeSize = UNextNode.NexusNode.getBeginOffset() - UCurrentNode.NexusNode.getBeginOffset();
-        UNodeData->NexusNodeData.memory = new char[UNodeData->NodeSize];
+        const uint32 NodeSize = UNextNode.NexusNode.getBeginOffset() - UCurrentNode.NexusNode.getBeginOffset();
+        UNodeData->SetNodePayload(FileBegin + UCurrentNode.NexusNode.getBeginOffset(), NodeSize, bMemoryMapNodePayloads);
 
-        FMemory::Memcpy(UNodeData->NexusNodeData.memory, (FileBegin + UCurrentNode.NexusNode.getBeginOffset()), UNodeData->NodeSize);
+        // Tangents never change, compute them once here instead of every time the node is streamed in
+        TArray<FPackedNormal> TangentFrames;
+        if (ComputeNodeTangentFrames(Data, UCurrentNode.NexusNode, FileBegin + UCurrentNode.NexusNode.getBeginOffset(), NodeSize, TangentFrames))
+        {
+            UNodeData->SetTangentFrames(TangentFrames);
+        }
         UCurrentNode.NodeDataPath = UNodeData;
     }
+}
+
+bool UNexusFactory::CopyContainerFile(UUnrealNexusData* Data) const
+{
+    // Containers live in the content folder so that they can be staged along with the project
+    const FString ContainerName = FString::Printf(TEXT("NexusContainers/%s.%s"), *Data->GetName(), *FPaths::GetExtension(CurrentFilename));
+    const FString ContainerFullPath = FPaths::Combine(FPaths::ProjectContentDir(), ContainerName);
+    if (IFileManager::Get().Copy(*ContainerFullPath, *CurrentFilename) != COPY_OK)
+    {
+        UE_LOG(NexusEditorErrors, Error, TEXT("Could not copy %s into %s"), *CurrentFilename, *ContainerFullPath);
+        return false;
+    }
+    Data->NodeSource = ENexusNodeSource::ContainerFile;
+    Data->ContainerFilePath = ContainerName;
+    return true;
+}
+
+void UNexusFactory::InitData(UUnrealNexusData* Data, uint8*& Buffer, const uint8* FileBegin) const
+{
+    using namespace Utils;
+    using namespace DataUtils;
+
+    // Read all nodes
+    for (uint32 i = 0; i < Data->Header.n_nodes; i ++)
+    {
+        const auto Node = ReadNode(Buffer);
+        Data->Nodes.Add(FUnrealNexusNode {Node});
+    }
+
+    // Fill their NodeData memory
+    if (!bStreamFromContainerFile || !CopyContainerFile(Data))
+    {
+        CreateNodeAssets(Data, FileBegin);
+    }
 
     // Read patches
     TArray<Patch> Patches;
@@ -213,12 +338,13 @@ void UNexusFactory::InitData(UUnrealNexusData* Data, uint8*& Buffer, const uint8
     }
 
     Data->NodeTexturesPaths.SetNum(Textures.Num());
-    for (int i = 0; i < Textures.Num() - 1; i ++)
+    if (bKeepCompressedTextures)
+    {
+        KeepCompressedTextures(Data, Textures, FileBegin);
+    }
+    else
     {
-        Texture& This = Textures[i];
-        Texture& Next = Textures[i + 1];
-        const auto TextureSize = Next.offset - This.offset;
-        Data->NodeTexturesPaths[i] = ReadTextureFromBuffer(Data, FileBegin, This.offset, TextureSize, i);
+        CreateNodeTextures(Data, Textures, FileBegin);
     }
 
     //find number of roots:
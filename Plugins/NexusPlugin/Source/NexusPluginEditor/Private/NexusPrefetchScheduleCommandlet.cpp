@@ -0,0 +1,165 @@
+﻿#include "NexusPrefetchScheduleCommandlet.h"
+
+#include "AssetRegistryModule.h"
+#include "LevelSequence.h"
+#include "MovieScene.h"
+#include "NexusUtils.h"
+#include "UnrealNexusData.h"
+#include "Camera/CameraActor.h"
+#include "Camera/CameraComponent.h"
+#include "CineCameraComponent.h"
+#include "Channels/MovieSceneFloatChannel.h"
+#include "Misc/PackageName.h"
+#include "Sections/MovieScene3DTransformSection.h"
+#include "Sections/MovieSceneCameraCutSection.h"
+#include "Tracks/MovieScene3DTransformTrack.h"
+#include "Tracks/MovieSceneCameraCutTrack.h"
+
+// The transform track of the camera, on the actor binding or on one of its components
+static UMovieScene3DTransformTrack* FindCameraTransformTrack(UMovieScene* MovieScene, const FGuid& CameraGuid)
+{
+    if (UMovieScene3DTransformTrack* Track = MovieScene->FindTrack<UMovieScene3DTransformTrack>(CameraGuid))
+    {
+        return Track;
+    }
+    for (int32 i = 0; i < MovieScene->GetPossessableCount(); i ++)
+    {
+        const FMovieScenePossessable& Possessable = MovieScene->GetPossessable(i);
+        if (Possessable.GetParent() != CameraGuid) continue;
+        if (UMovieScene3DTransformTrack* Track = MovieScene->FindTrack<UMovieScene3DTransformTrack>(Possessable.GetGuid()))
+        {
+            return Track;
+        }
+    }
+    return nullptr;
+}
+
+static bool EvaluateCameraTransform(const UMovieScene3DTransformTrack* Track, const FFrameTime Time, FVector& OutLocation, FRotator& OutRotation)
+{
+    for (UMovieSceneSection* Section : Track->GetAllSections())
+    {
+        if (!Section->GetRange().Contains(Time.FrameNumber)) continue;
+        // Translation, rotation as roll pitch yaw, then scale
+        const TArrayView<FMovieSceneFloatChannel*> Channels = Section->GetChannelProxy().GetChannels<FMovieSceneFloatChannel>();
+        if (Channels.Num() < 6) continue;
+        float Values[6] = {};
+        for (int32 i = 0; i < 6; i ++)
+        {
+            Channels[i]->Evaluate(Time, Values[i]);
+        }
+        OutLocation = FVector(Values[0], Values[1], Values[2]);
+        OutRotation = FRotator(Values[4], Values[5], Values[3]);
+        return true;
+    }
+    return false;
+}
+
+void UNexusPrefetchScheduleCommandlet::SampleLevelSequence(const ULevelSequence* Sequence, const float SampleRate, const int32 ViewWidth, TArray<FNexusCameraSample>& OutSamples)
+{
+    UMovieScene* MovieScene = Sequence ? Sequence->GetMovieScene() : nullptr;
+    if (!MovieScene || SampleRate <= 0.0f) return;
+    const UMovieSceneCameraCutTrack* CameraCutTrack = Cast<UMovieSceneCameraCutTrack>(MovieScene->GetCameraCutTrack());
+    if (!CameraCutTrack)
+    {
+        UE_LOG(NexusEditorErrors, Error, TEXT("%s has no camera cut track"), *Sequence->GetName());
+        return;
+    }
+
+    const FFrameRate TickResolution = MovieScene->GetTickResolution();
+    const TRange<FFrameNumber> PlaybackRange = MovieScene->GetPlaybackRange();
+    const FFrameNumber PlaybackStart = PlaybackRange.GetLowerBoundValue();
+    const FFrameTime SampleStep = TickResolution.AsFrameTime(1.0 / SampleRate);
+    for (const UMovieSceneSection* Section : CameraCutTrack->GetAllSections())
+    {
+        const UMovieSceneCameraCutSection* CameraCut = Cast<UMovieSceneCameraCutSection>(Section);
+        if (!CameraCut) continue;
+        const TRange<FFrameNumber> CutRange = TRange<FFrameNumber>::Intersection(CameraCut->GetRange(), PlaybackRange);
+        if (CutRange.IsEmpty() || !CutRange.HasLowerBound() || !CutRange.HasUpperBound()) continue;
+
+        const FGuid CameraGuid = CameraCut->GetCameraBindingID().GetGuid();
+        const UMovieScene3DTransformTrack* TransformTrack = FindCameraTransformTrack(MovieScene, CameraGuid);
+        if (!TransformTrack)
+        {
+            UE_LOG(NexusEditorErrors, Warning, TEXT("The camera of a cut of %s has no transform track, skipping it"), *Sequence->GetName());
+            continue;
+        }
+
+        // The lens of a spawned camera, possessed cameras live in the level and get the default lens
+        FNexusCameraSample Lens;
+        Lens.ViewWidth = ViewWidth;
+        if (const FMovieSceneSpawnable* Spawnable = MovieScene->FindSpawnable(CameraGuid))
+        {
+            if (const ACameraActor* CameraActor = Cast<ACameraActor>(Spawnable->GetObjectTemplate()))
+            {
+                const UCameraComponent* Camera = CameraActor->GetCameraComponent();
+                const UCineCameraComponent* CineCamera = Cast<UCineCameraComponent>(Camera);
+                Lens.FieldOfView = CineCamera ? CineCamera->GetHorizontalFieldOfView() : Camera->FieldOfView;
+                Lens.AspectRatio = CineCamera ? CineCamera->Filmback.SensorAspectRatio : Camera->AspectRatio;
+            }
+        }
+
+        const FFrameNumber CutEnd = CutRange.GetUpperBoundValue();
+        for (FFrameTime Time = CutRange.GetLowerBoundValue(); Time.FrameNumber < CutEnd; Time += SampleStep)
+        {
+            FNexusCameraSample Sample = Lens;
+            if (!EvaluateCameraTransform(TransformTrack, Time, Sample.Location, Sample.Rotation)) continue;
+            Sample.Time = TickResolution.AsSeconds(Time - PlaybackStart);
+            OutSamples.Add(Sample);
+        }
+    }
+}
+
+int32 UNexusPrefetchScheduleCommandlet::Main(const FString& Params)
+{
+    TArray<FString> Tokens, Switches;
+    TMap<FString, FString> ParamsMap;
+    ParseCommandLine(*Params, Tokens, Switches, ParamsMap);
+
+    const FString SequencePath = ParamsMap.FindRef(TEXT("Sequence"));
+    const FString NexusPath = ParamsMap.FindRef(TEXT("Nexus"));
+    ULevelSequence* Sequence = LoadObject<ULevelSequence>(nullptr, *SequencePath);
+    UUnrealNexusData* NexusData = LoadObject<UUnrealNexusData>(nullptr, *NexusPath);
+    if (!Sequence || !NexusData)
+    {
+        UE_LOG(NexusEditorErrors, Error, TEXT("Usage: -run=NexusPrefetchSchedule -Sequence=<level sequence> -Nexus=<nexus asset> [-Output=<package>] [-Transform=<model to world>] [-TargetError=2] [-SampleRate=30] [-ViewWidth=1920]"));
+        return 1;
+    }
+
+    const float TargetError = ParamsMap.Contains(TEXT("TargetError")) ? FCString::Atof(*ParamsMap[TEXT("TargetError")]) : 2.0f;
+    const float SampleRate = ParamsMap.Contains(TEXT("SampleRate")) ? FCString::Atof(*ParamsMap[TEXT("SampleRate")]) : 30.0f;
+    const int32 ViewWidth = ParamsMap.Contains(TEXT("ViewWidth")) ? FCString::Atoi(*ParamsMap[TEXT("ViewWidth")]) : 1920;
+    // Where the component showing the model sits in the level, as written by FTransform::ToString
+    FTransform ModelToWorld = FTransform::Identity;
+    if (ParamsMap.Contains(TEXT("Transform")) && !ModelToWorld.InitFromString(ParamsMap[TEXT("Transform")]))
+    {
+        UE_LOG(NexusEditorErrors, Error, TEXT("Could not parse the transform %s"), *ParamsMap[TEXT("Transform")]);
+        return 1;
+    }
+
+    TArray<FNexusCameraSample> Samples;
+    SampleLevelSequence(Sequence, SampleRate, ViewWidth, Samples);
+    if (Samples.Num() == 0)
+    {
+        UE_LOG(NexusEditorErrors, Error, TEXT("No camera could be sampled from %s"), *Sequence->GetPathName());
+        return 1;
+    }
+
+    FString OutputPath = ParamsMap.FindRef(TEXT("Output"));
+    if (OutputPath.IsEmpty())
+    {
+        OutputPath = Sequence->GetOutermost()->GetName() + TEXT("_NexusPrefetch");
+    }
+    UPackage* Package = CreatePackage(nullptr, *OutputPath);
+    UNexusPrefetchSchedule* Schedule = NewObject<UNexusPrefetchSchedule>(Package, *FPackageName::GetShortName(OutputPath), RF_Public | RF_Standalone);
+    Schedule->Build(NexusData, ModelToWorld, Samples, TargetError);
+    FAssetRegistryModule::AssetCreated(Schedule);
+
+    const FString FileName = FPackageName::LongPackageNameToFilename(OutputPath, FPackageName::GetAssetPackageExtension());
+    if (!UPackage::SavePackage(Package, Schedule, RF_Public | RF_Standalone, *FileName))
+    {
+        UE_LOG(NexusEditorErrors, Error, TEXT("Could not save %s"), *FileName);
+        return 1;
+    }
+    UE_LOG(NexusEditorInfo, Log, TEXT("Scheduled %d of %d nodes over %.2f seconds in %s"), Schedule->Nodes.Num(), NexusData->Nodes.Num(), Schedule->Duration, *OutputPath);
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "UnrealNexusNodeData.h"
 #include "corto/decoder.h"
 #include "Kismet/KismetArrayLibrary.h"
+#include "mikktspace.h"
 
 nx::Node DataUtils::ReadNode(uint8*& Buffer)
 {
@@ -54,3 +55,130 @@ nx::Texture DataUtils::ReadTexture(uint8*& Buffer)
     }
     return Tex;
 }
+
+namespace TangentUtils
+{
+    // Node converted to Unreal space, the way the geometry pool will draw it
+    struct FMikkNode
+    {
+        TArray<FVector> Positions;
+        TArray<FVector> Normals;
+        TArray<FVector2D> TexCoords;
+        const uint16* Indices;
+        int32 FacesCount;
+        
+        // MikkTSpace works per face corner, the corners sharing a vertex are averaged
+        TArray<FVector> TangentSums;
+        TArray<float> SignSums;
+
+        FORCEINLINE int32 GetIndex(const int32 Face, const int32 Corner) const { return Indices[Face * 3 + Corner]; }
+    };
+
+    static FMikkNode& GetMikkNode(const SMikkTSpaceContext* Context)
+    {
+        return *static_cast<FMikkNode*>(Context->m_pUserData);
+    }
+
+    static int MikkGetNumFaces(const SMikkTSpaceContext* Context)
+    {
+        return GetMikkNode(Context).FacesCount;
+    }
+
+    static int MikkGetNumVerticesOfFace(const SMikkTSpaceContext* Context, const int Face)
+    {
+        return 3;
+    }
+
+    static void MikkGetPosition(const SMikkTSpaceContext* Context, float Position[3], const int Face, const int Corner)
+    {
+        const FMikkNode& Node = GetMikkNode(Context);
+        const FVector& Vertex = Node.Positions[Node.GetIndex(Face, Corner)];
+        Position[0] = Vertex.X;
+        Position[1] = Vertex.Y;
+        Position[2] = Vertex.Z;
+    }
+
+    static void MikkGetNormal(const SMikkTSpaceContext* Context, float Normal[3], const int Face, const int Corner)
+    {
+        const FMikkNode& Node = GetMikkNode(Context);
+        const FVector& VertexNormal = Node.Normals[Node.GetIndex(Face, Corner)];
+        Normal[0] = VertexNormal.X;
+        Normal[1] = VertexNormal.Y;
+        Normal[2] = VertexNormal.Z;
+    }
+
+    static void MikkGetTexCoord(const SMikkTSpaceContext* Context, float TexCoord[2], const int Face, const int Corner)
+    {
+        const FMikkNode& Node = GetMikkNode(Context);
+        const FVector2D& VertexTexCoord = Node.TexCoords[Node.GetIndex(Face, Corner)];
+        TexCoord[0] = VertexTexCoord.X;
+        TexCoord[1] = VertexTexCoord.Y;
+    }
+
+    static void MikkSetTSpaceBasic(const SMikkTSpaceContext* Context, const float Tangent[3], const float Sign, const int Face, const int Corner)
+    {
+        FMikkNode& Node = GetMikkNode(Context);
+        const int32 Index = Node.GetIndex(Face, Corner);
+        Node.TangentSums[Index] += FVector(Tangent[0], Tangent[1], Tangent[2]);
+        Node.SignSums[Index] += Sign;
+    }
+}
+
+bool TangentUtils::ComputeTangentFrames(nx::Signature& Sig, nx::NodeData& Data, const nx::Node& Node, TArray<FPackedNormal>& OutTangentFrames)
+{
+    if (!Sig.face.hasIndex() || !Sig.vertex.hasNormals() || Node.nface == 0) return false;
+    
+    const int32 VertexCount = Node.nvert;
+    FMikkNode MikkNode;
+    MikkNode.Positions.SetNumUninitialized(VertexCount);
+    MikkNode.Normals.SetNumUninitialized(VertexCount);
+    MikkNode.TexCoords.SetNumZeroed(VertexCount);
+    MikkNode.TangentSums.SetNumZeroed(VertexCount);
+    MikkNode.SignSums.SetNumZeroed(VertexCount);
+    MikkNode.Indices = Data.faces(Sig, VertexCount);
+    MikkNode.FacesCount = Node.nface;
+
+    const vcg::Point3f* Coords = Data.coords();
+    const vcg::Point3s* Normals = Data.normals(Sig, VertexCount);
+    const vcg::Point2f* TexCoords = Sig.vertex.hasTextures() ? Data.texCoords(Sig, VertexCount) : nullptr;
+    for (int32 i = 0; i < VertexCount; i ++)
+    {
+        // Same swizzle the runtime applies to the positions
+        MikkNode.Positions[i] = FVector(Coords[i].X(), Coords[i].Z(), Coords[i].Y());
+        MikkNode.Normals[i] = FVector(Normals[i].X(), Normals[i].Z(), Normals[i].Y()).GetSafeNormal();
+        if (TexCoords)
+        {
+            MikkNode.TexCoords[i] = FVector2D(TexCoords[i].X(), TexCoords[i].Y());
+        }
+    }
+
+    SMikkTSpaceInterface Interface;
+    FMemory::Memzero(Interface);
+    Interface.m_getNumFaces = MikkGetNumFaces;
+    Interface.m_getNumVerticesOfFace = MikkGetNumVerticesOfFace;
+    Interface.m_getPosition = MikkGetPosition;
+    Interface.m_getNormal = MikkGetNormal;
+    Interface.m_getTexCoord = MikkGetTexCoord;
+    Interface.m_setTSpaceBasic = MikkSetTSpaceBasic;
+
+    SMikkTSpaceContext Context;
+    Context.m_pInterface = &Interface;
+    Context.m_pUserData = &MikkNode;
+    if (!genTangSpaceDefault(&Context)) return false;
+
+    OutTangentFrames.SetNumUninitialized(VertexCount * 2);
+    for (int32 i = 0; i < VertexCount; i ++)
+    {
+        const FVector& Normal = MikkNode.Normals[i];
+        FVector Tangent = (MikkNode.TangentSums[i] - Normal * FVector::DotProduct(Normal, MikkNode.TangentSums[i])).GetSafeNormal();
+        if (Tangent.IsZero())
+        {
+            FVector Bitangent;
+            Normal.FindBestAxisVectors(Tangent, Bitangent);
+        }
+        // The bitangent sign goes in the W of the normal, like the static meshes do
+        OutTangentFrames[i * 2 + 0] = FPackedNormal(Tangent);
+        OutTangentFrames[i * 2 + 1] = FPackedNormal(FVector4(Normal, MikkNode.SignSums[i] < 0.0f ? -1.0f : 1.0f));
+    }
+    return true;
+}
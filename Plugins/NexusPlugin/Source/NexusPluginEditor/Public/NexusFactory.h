@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include "Engine/Texture.h"
 #include "NexusFactory.generated.h"
 
 namespace nx {
@@ -8,13 +9,50 @@ namespace nx {
 
 class UUnrealNexusData;
 
+UENUM()
+enum class ENexusTextureCompression : uint8
+{
+    // 4 bytes per texel, like the decoded jpegs
+    Uncompressed,
+    // Half a byte per texel, no alpha
+    BC1,
+    // One byte per texel, better colors but slower to encode
+    BC7
+};
+
 UCLASS(MinimalAPI, hidecategories=Object)
 class UNexusFactory final : public UFactory
 {
     GENERATED_BODY()
 private:
     static bool ParseHeader(UUnrealNexusData* NexusData, uint8*& Buffer, const uint8* BufferEnd);   
+    void CreateNodeAssets(UUnrealNexusData* Data, const uint8* FileBegin) const;
+    bool CopyContainerFile(UUnrealNexusData* Data) const;
+    void CreateNodeTextures(UUnrealNexusData* Data, const TArray<nx::Texture>& Textures, const uint8* FileBegin) const;
+    void KeepCompressedTextures(UUnrealNexusData* Data, const TArray<nx::Texture>& Textures, const uint8* FileBegin) const;
 public:
+    // Store node payloads outside of the export data so that cooked builds can memory map them
+    UPROPERTY(EditAnywhere, Category=Nexus)
+    bool bMemoryMapNodePayloads = false;
+
+    // Keep the imported file as a single container and stream nodes from it at runtime
+    // instead of creating one asset per node
+    UPROPERTY(EditAnywhere, Category=Nexus)
+    bool bStreamFromContainerFile = false;
+
+    // Keep the textures as the jpegs found in the file and decode them while streaming,
+    // instead of creating texture assets. Smaller on disk, but costs CPU time at runtime
+    UPROPERTY(EditAnywhere, Category=Nexus)
+    bool bKeepCompressedTextures = false;
+
+    // Format of the node textures, they're encoded along with their mip chain at import
+    UPROPERTY(EditAnywhere, Category=Nexus)
+    ENexusTextureCompression TextureCompression = ENexusTextureCompression::BC1;
+
+    // Trades the encoding time of the compressed textures for their quality
+    UPROPERTY(EditAnywhere, Category=Nexus)
+    TEnumAsByte<ETextureCompressionQuality> TextureCompressionQuality = TCQ_Default;
+
     explicit UNexusFactory(const FObjectInitializer& ObjectInitializer);
     static bool ReadDataIntoNexusFile(UUnrealNexusData* UnrealNexusData, uint8*& Buffer, const uint8* BufferEnd);
     void InitData(UUnrealNexusData* Data, uint8*& Buffer, const uint8* FileBegin) const;
@@ -0,0 +1,24 @@
+﻿#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "NexusPrefetchSchedule.h"
+
+#include "NexusPrefetchScheduleCommandlet.generated.h"
+
+class ULevelSequence;
+
+// Builds the prefetch schedule of a nexus asset along the camera cuts of a level sequence:
+// -run=NexusPrefetchSchedule -Sequence=/Game/Shot -Nexus=/Game/Model_Nexus.Model
+//     [-Output=/Game/Shot_NexusPrefetch] [-Transform=<model to world>] [-TargetError=2] [-SampleRate=30] [-ViewWidth=1920]
+UCLASS()
+class UNexusPrefetchScheduleCommandlet final : public UCommandlet
+{
+    GENERATED_BODY()
+public:
+    // Samples the camera cut track, the cameras keep the transform and the field of view of their bindings
+    static void SampleLevelSequence(const ULevelSequence* Sequence, float SampleRate, int32 ViewWidth, TArray<FNexusCameraSample>& OutSamples);
+
+    //~ Begin UCommandlet Interface
+    virtual int32 Main(const FString& Params) override;
+    //~ End UCommandlet Interface
+};
@@ -92,4 +92,11 @@ namespace DataUtils {
     nx::Node ReadNode(uint8*& Buffer);
     nx::Patch ReadPatch(uint8*& Buffer);
     nx::Texture ReadTexture(uint8*& Buffer);
+}
+
+namespace TangentUtils
+{
+    // MikkTSpace tangent frames of an indexed node, two packed normals per vertex in the geometry pool layout.
+    // Returns false if the node has no faces or no normals to build them from
+    bool ComputeTangentFrames(nx::Signature& Sig, nx::NodeData& Data, const nx::Node& Node, TArray<FPackedNormal>& OutTangentFrames);
 }
\ No newline at end of file